@@ -0,0 +1,167 @@
+#ifndef RUSTBUGDETECTOR_FLATCDG_H
+#define RUSTBUGDETECTOR_FLATCDG_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "CFG/CFG.h"
+
+namespace detector {
+
+    // How graphForFunction finds the blocks that depend on a CFG edge A -> B.
+    enum class CDGBuilder {
+        // Walk up the post-dominator tree from B to the nearest common
+        // post-dominator of A and B, as ControlDependenceGraphBase does.
+        NearestCommonAncestor,
+        // Post-dominance frontiers, i.e. dominance frontiers on the reverse CFG
+        // (Cytron et al.), in one bottom-up pass over the post-dominator tree.
+        PostDominanceFrontier,
+    };
+
+    // The builder of every graph built for the detectors (-rbd-cdg-builder). It
+    // lives here rather than in Common/Options.h, since CFG sits below Common.
+    extern llvm::cl::opt<CDGBuilder> CDGBuilderKind;
+
+    // A control dependence edge, tagged with the branch outcome it depends on.
+    struct FlatCDGEdge {
+        unsigned Node;
+        ControlDependenceNode::EdgeType Type;
+    };
+
+    // The graph ControlDependenceGraphBase::graphForFunction builds, laid out flat:
+    // node 0 is the region node of the function entry and node i + 1 is the i-th
+    // block in layout order. The children of a node (by tag, then node) and its
+    // parents are contiguous ranges of two CSR arrays, so building the graph of a
+    // function takes a handful of allocations however many blocks it has.
+    class FlatControlDependenceGraph {
+    public:
+        static const unsigned RootNode = 0;
+        static const unsigned NoNode = ~0u;
+
+        // Both builders give the same graph.
+        void graphForFunction(llvm::Function &F, llvm::PostDominatorTree &PDT,
+                              CDGBuilder Builder = CDGBuilder::NearestCommonAncestor);
+
+        void releaseMemory();
+
+        // New PM: the graph only depends on the CFG.
+        bool invalidate(llvm::Function &F, const llvm::PreservedAnalyses &PA,
+                        llvm::FunctionAnalysisManager::Invalidator &Inv);
+
+        unsigned getNumNodes() const { return vecBlock.size(); }
+
+        // Block of Node, nullptr for RootNode.
+        llvm::BasicBlock *getBlock(unsigned Node) const { return vecBlock[Node]; }
+
+        // Node of BB, NoNode when BB is not in the graph.
+        unsigned getNode(const llvm::BasicBlock *BB) const;
+
+        llvm::ArrayRef<FlatCDGEdge> children(unsigned Node) const {
+            return llvm::makeArrayRef(vecChild).slice(vecChildBegin[Node],
+                                                      vecChildBegin[Node + 1] - vecChildBegin[Node]);
+        }
+
+        llvm::ArrayRef<unsigned> parents(unsigned Node) const {
+            return llvm::makeArrayRef(vecParent).slice(vecParentBegin[Node],
+                                                       vecParentBegin[Node + 1] - vecParentBegin[Node]);
+        }
+
+        // Same queries as ControlDependenceGraphBase. influences takes constant
+        // time once the closure is built and walks up the parents otherwise.
+        bool controls(llvm::BasicBlock *A, llvm::BasicBlock *B) const;
+        bool influences(llvm::BasicBlock *A, llvm::BasicBlock *B) const;
+        bool findPath(llvm::BasicBlock *A, llvm::BasicBlock *B,
+                      std::map<llvm::BasicBlock *, llvm::BasicBlock *> &next_bb) const;
+
+        // Whether any block of Sources influences Target, in one walk up from
+        // Target (or one bit test per source with the closure).
+        bool influencesAny(const llvm::SmallPtrSetImpl<llvm::BasicBlock *> &Sources,
+                           llvm::BasicBlock *Target) const;
+
+        // The blocks that influence B, B included.
+        std::vector<llvm::BasicBlock *> influencedBy(llvm::BasicBlock *B) const;
+
+        // Index the transitive closure of the parent relation: the nodes of a
+        // strongly connected component influence each other, so there is one
+        // bitset row per component, holding the components that reach it.
+        // Takes O(nodes + edges * components / 64) time and components^2 bits.
+        void buildClosure();
+
+        bool hasClosure() const { return ClosureWords != 0; }
+
+    private:
+        // Walk up the parents from Node, itself included, until Found holds.
+        bool findAncestor(unsigned Node, llvm::function_ref<bool(unsigned)> Found) const;
+
+        bool inClosure(unsigned SCC, unsigned AncestorSCC) const {
+            return (vecClosure[size_t(SCC) * ClosureWords + AncestorSCC / 64] >> (AncestorSCC % 64)) & 1;
+        }
+
+        std::vector<llvm::BasicBlock *> vecBlock;
+        llvm::DenseMap<const llvm::BasicBlock *, unsigned> mapBlockNode;
+
+        // Children of Node are vecChild[vecChildBegin[Node] .. vecChildBegin[Node + 1]),
+        // parents vecParent[vecParentBegin[Node] .. vecParentBegin[Node + 1]).
+        std::vector<unsigned> vecChildBegin;
+        std::vector<FlatCDGEdge> vecChild;
+        std::vector<unsigned> vecParentBegin;
+        std::vector<unsigned> vecParent;
+
+        // With the closure: component of each node, numbered ancestors first,
+        // and the row of component SCC at vecClosure[SCC * ClosureWords].
+        std::vector<unsigned> vecNodeSCC;
+        unsigned ClosureWords = 0;
+        std::vector<uint64_t> vecClosure;
+    };
+
+    // New PM analysis, computed once per function and kept by the
+    // FunctionAnalysisManager until a pass changes the CFG.
+    class ControlDependenceAnalysis : public llvm::AnalysisInfoMixin<ControlDependenceAnalysis> {
+        friend llvm::AnalysisInfoMixin<ControlDependenceAnalysis>;
+        static llvm::AnalysisKey Key;
+
+    public:
+        typedef FlatControlDependenceGraph Result;
+
+        explicit ControlDependenceAnalysis(CDGBuilder Builder = CDGBuilder::NearestCommonAncestor)
+                : Builder(Builder) {}
+
+        Result run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+
+    private:
+        CDGBuilder Builder;
+    };
+
+    // Legacy PM wrapper, for function passes that require the graph.
+    class ControlDependenceWrapperPass : public llvm::FunctionPass {
+    public:
+        static char ID;
+
+        ControlDependenceWrapperPass() : FunctionPass(ID) {}
+
+        bool runOnFunction(llvm::Function &F) override;
+
+        void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
+
+        void releaseMemory() override { CDG.releaseMemory(); }
+
+        FlatControlDependenceGraph &getCDG() { return CDG; }
+
+    private:
+        FlatControlDependenceGraph CDG;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_FLATCDG_H
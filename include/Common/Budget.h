@@ -0,0 +1,67 @@
+#ifndef RUSTBUGDETECTOR_BUDGET_H
+#define RUSTBUGDETECTOR_BUDGET_H
+
+#include <chrono>
+#include <vector>
+
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Common/Report.h"
+
+namespace detector {
+
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    // Wall-clock deadline of a whole run (-rbd-deadline-s, 0 for none).
+    class Deadline {
+    public:
+        Deadline();
+
+        bool expired() const;
+
+    private:
+        TimePoint End;
+        bool Enabled;
+    };
+
+    // Limits of the search started from one lock, or of the lock dataflow of one function
+    // (-rbd-max-blocks, -rbd-max-callees, -rbd-lock-time-ms, 0 for none; only the callees have a default limit).
+    // Once a limit is hit every further take fails, so callers only need to stop their worklist.
+    class ExplorationBudget {
+    public:
+        explicit ExplorationBudget(const Deadline &Global);
+
+        bool takeBlock();
+
+        bool takeCallee();
+
+        bool isTruncated() const { return Reason != nullptr; }
+
+        const char *getReason() const { return Reason; }
+
+    private:
+        bool checkTime();
+
+        const Deadline &Global;
+        TimePoint Start;
+        unsigned Blocks;
+        unsigned Callees;
+        const char *Reason;
+    };
+
+    struct TruncatedSearch {
+        ReportSite Lock;
+        const char *Reason;
+    };
+
+    void recordTruncation(llvm::Instruction *LockInst, const ExplorationBudget &Budget,
+                          std::vector<TruncatedSearch> &vecTruncated);
+
+    void recordTruncation(const ReportSite &Lock, const ExplorationBudget &Budget,
+                          std::vector<TruncatedSearch> &vecTruncated);
+
+    void printTruncationSummary(const std::vector<TruncatedSearch> &vecTruncated, llvm::raw_ostream &OS);
+}
+
+#endif //RUSTBUGDETECTOR_BUDGET_H
@@ -0,0 +1,82 @@
+#ifndef RUSTBUGDETECTOR_CALLGRAPHINDEX_H
+#define RUSTBUGDETECTOR_CALLGRAPHINDEX_H
+
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+namespace detector {
+
+    // Call graph of a module, built once and shared by the traversals.
+    // Functions are numbered densely in module order. build() numbers the call sites
+    // by caller and then by position in the caller, whatever order they were added
+    // in; the candidates of one indirect call keep the order they were added in.
+    // The call sites in a function and the call sites of a callee are contiguous
+    // ranges of two CSR arrays.
+    class CallGraphIndex {
+    public:
+        explicit CallGraphIndex(llvm::Module &M);
+
+        // Record I -> Callee. Adding I again replaces its callee.
+        void addCall(llvm::Instruction *I, llvm::Function *Callee);
+
+        // Record a candidate callee of indirect call I (see IndirectCallIndex).
+        // Each candidate is a call site of its own; getCalleeOf(I) stays nullptr.
+        void addIndirectCall(llvm::Instruction *I, llvm::Function *Callee);
+
+        // Number the call sites in program order and lay them out by caller and by
+        // callee; call once, before any query.
+        void build();
+
+        unsigned getNumFuncs() const { return vecFunc.size(); }
+
+        unsigned getNumCallSites() const { return vecSiteInst.size(); }
+
+        llvm::Function *getFunc(unsigned Func) const { return vecFunc[Func]; }
+
+        // Call sites in F, in program order; empty for an unknown F.
+        llvm::ArrayRef<unsigned> callSitesIn(const llvm::Function *F) const;
+
+        // Call sites whose callee is F, by caller and then program order.
+        llvm::ArrayRef<unsigned> callSitesOf(const llvm::Function *F) const;
+
+        llvm::Instruction *getCallInst(unsigned Site) const { return vecSiteInst[Site]; }
+
+        llvm::Function *getCaller(unsigned Site) const { return vecFunc[vecSiteCaller[Site]]; }
+
+        llvm::Function *getCallee(unsigned Site) const { return vecFunc[vecSiteCallee[Site]]; }
+
+        // Callee of call site I, or nullptr when I was not added.
+        llvm::Function *getCalleeOf(const llvm::Instruction *I) const;
+
+        // Call sites of the candidate callees of indirect call I, in the order they were added.
+        llvm::ArrayRef<unsigned> indirectSitesOf(const llvm::Instruction *I) const;
+
+    private:
+        unsigned getFuncId(const llvm::Function *F) const;
+
+        void sortSites();
+
+        std::vector<llvm::Function *> vecFunc;
+        llvm::DenseMap<const llvm::Function *, unsigned> mapFuncId;
+
+        std::vector<llvm::Instruction *> vecSiteInst;
+        std::vector<unsigned> vecSiteCaller;
+        std::vector<unsigned> vecSiteCallee;
+        llvm::DenseMap<const llvm::Instruction *, unsigned> mapSiteId;
+        llvm::DenseMap<const llvm::Instruction *, std::vector<unsigned>> mapIndirectSites;
+
+        // Sites in function F are vecOutSite[vecOutBegin[F] .. vecOutBegin[F + 1]),
+        // sites calling F are vecInSite[vecInBegin[F] .. vecInBegin[F + 1]).
+        std::vector<unsigned> vecOutBegin;
+        std::vector<unsigned> vecOutSite;
+        std::vector<unsigned> vecInBegin;
+        std::vector<unsigned> vecInSite;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_CALLGRAPHINDEX_H
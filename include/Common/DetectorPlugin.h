@@ -0,0 +1,37 @@
+#ifndef RUSTBUGDETECTOR_DETECTORPLUGIN_H
+#define RUSTBUGDETECTOR_DETECTORPLUGIN_H
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+#include "CFG/FlatCDG.h"
+
+namespace detector {
+
+    // Plugin info that registers DetectorPassT as the module pass "detect", the name
+    // the legacy pass has, so a detector runs as
+    //     opt -load-pass-plugin libXXX.so -passes=detect XXX.bc
+    // together with the function analyses of this repo that FuncAnalyses asks for.
+    template <typename DetectorPassT>
+    llvm::PassPluginLibraryInfo getDetectorPluginInfo(const char *PluginName) {
+        return {LLVM_PLUGIN_API_VERSION, PluginName, LLVM_VERSION_STRING,
+                [](llvm::PassBuilder &PB) {
+                    PB.registerAnalysisRegistrationCallback(
+                            [](llvm::FunctionAnalysisManager &FAM) {
+                                FAM.registerPass([] { return ControlDependenceAnalysis(CDGBuilderKind); });
+                            });
+                    PB.registerPipelineParsingCallback(
+                            [](llvm::StringRef Name, llvm::ModulePassManager &MPM,
+                               llvm::ArrayRef<llvm::PassBuilder::PipelineElement>) {
+                                if (Name != "detect") {
+                                    return false;
+                                }
+                                MPM.addPass(DetectorPassT());
+                                return true;
+                            });
+                }};
+    }
+}
+
+#endif //RUSTBUGDETECTOR_DETECTORPLUGIN_H
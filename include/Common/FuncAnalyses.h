@@ -0,0 +1,96 @@
+#ifndef RUSTBUGDETECTOR_FUNCANALYSES_H
+#define RUSTBUGDETECTOR_FUNCANALYSES_H
+
+#include <list>
+#include <memory>
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include "CFG/FlatCDG.h"
+
+namespace detector {
+
+    // The function analyses a detector asks for from its module pass.
+    // A result stays valid until the detector asks for an analysis of another
+    // function, so a detector finishes with one function before the next.
+    class FuncAnalyses {
+    public:
+        virtual ~FuncAnalyses() = default;
+
+        virtual llvm::AAResults &getAA(llvm::Function &F) = 0;
+
+        virtual llvm::DominatorTree &getDomTree(llvm::Function &F) = 0;
+
+        virtual llvm::PostDominatorTree &getPostDomTree(llvm::Function &F) = 0;
+
+        virtual llvm::LoopInfo &getLoopInfo(llvm::Function &F) = 0;
+
+        virtual FlatControlDependenceGraph &getControlDependenceGraph(llvm::Function &F) = 0;
+    };
+
+    // Legacy PM. getAnalysis(F) of a module pass reruns the function passes on
+    // every call and frees the results of the previous function, so the trees
+    // are built here and kept for the last few functions asked for, and the AA
+    // of the last function is kept. P must require AAResultsWrapperPass.
+    class LegacyFuncAnalyses : public FuncAnalyses {
+    public:
+        explicit LegacyFuncAnalyses(llvm::Pass &P);
+
+        llvm::AAResults &getAA(llvm::Function &F) override;
+
+        llvm::DominatorTree &getDomTree(llvm::Function &F) override;
+
+        llvm::PostDominatorTree &getPostDomTree(llvm::Function &F) override;
+
+        llvm::LoopInfo &getLoopInfo(llvm::Function &F) override;
+
+        FlatControlDependenceGraph &getControlDependenceGraph(llvm::Function &F) override;
+
+    private:
+        // The analyses built for one function, each on first use.
+        struct FuncResults {
+            llvm::Function *F;
+            std::unique_ptr<llvm::DominatorTree> DT;
+            std::unique_ptr<llvm::PostDominatorTree> PDT;
+            std::unique_ptr<llvm::LoopInfo> LI;
+            std::unique_ptr<FlatControlDependenceGraph> CDG;
+        };
+
+        FuncResults &getResults(llvm::Function &F);
+
+        llvm::Pass &P;
+        llvm::Function *pAAFunc;
+        llvm::AAResults *pAA;
+        // Most recently used first.
+        std::list<FuncResults> lstResults;
+    };
+
+    // New PM. The FunctionAnalysisManager of the module proxy caches every result,
+    // so each analysis runs at most once per function. ControlDependenceAnalysis
+    // is registered by getDetectorPluginInfo.
+    class NewPMFuncAnalyses : public FuncAnalyses {
+    public:
+        explicit NewPMFuncAnalyses(llvm::FunctionAnalysisManager &FAM) : FAM(FAM) {}
+
+        llvm::AAResults &getAA(llvm::Function &F) override;
+
+        llvm::DominatorTree &getDomTree(llvm::Function &F) override;
+
+        llvm::PostDominatorTree &getPostDomTree(llvm::Function &F) override;
+
+        llvm::LoopInfo &getLoopInfo(llvm::Function &F) override;
+
+        FlatControlDependenceGraph &getControlDependenceGraph(llvm::Function &F) override;
+
+    private:
+        llvm::FunctionAnalysisManager &FAM;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_FUNCANALYSES_H
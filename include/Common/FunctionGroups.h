@@ -0,0 +1,39 @@
+#ifndef RUSTBUGDETECTOR_FUNCTIONGROUPS_H
+#define RUSTBUGDETECTOR_FUNCTIONGROUPS_H
+
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+
+namespace detector {
+
+    // Equivalence classes of functions under llvm::FunctionComparator, the
+    // comparison MergeFunctions uses: same CFG, opcodes, constants and callees,
+    // with all pointer types of an address space alike. Names and debug locations
+    // are not compared, so monomorphizations that differ in their 17h<hash>E
+    // suffix or only in pointer types share a class. The module is not changed.
+    class FunctionGroups {
+    public:
+        // Classes of vecFunc, in the order of their first member, which is the
+        // representative. Candidates are bucketed by FunctionComparator::functionHash first.
+        explicit FunctionGroups(llvm::ArrayRef<llvm::Function *> vecFunc);
+
+        const std::vector<std::vector<llvm::Function *>> &classes() const { return vecClass; }
+
+        unsigned getNumFuncs() const { return NumFuncs; }
+
+        // Pair the instructions of the reachable blocks of two functions of one
+        // class, block by block in reverse post order. False if the CFGs differ.
+        static bool mapInstructions(llvm::Function &From, llvm::Function &To,
+                                    std::map<llvm::Instruction *, llvm::Instruction *> &mapInst);
+
+    private:
+        std::vector<std::vector<llvm::Function *>> vecClass;
+        unsigned NumFuncs;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_FUNCTIONGROUPS_H
@@ -0,0 +1,59 @@
+#ifndef RUSTBUGDETECTOR_GUARDLIFETIME_H
+#define RUSTBUGDETECTOR_GUARDLIFETIME_H
+
+#include <map>
+#include <set>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Value.h"
+
+namespace detector {
+
+    // Where a lock result ends up. A std lock returns Result<Guard, PoisonError>,
+    // which is unwrapped into the guard (setLockGuard); lock_api locks return the guard directly.
+    struct GuardDestSet {
+        std::set<llvm::Value *> setLockGuard;  // Result only, unwrapped guards
+        std::set<llvm::Value *> setDeref;  // Guard only
+        std::set<llvm::Value *> setAutoDrop;
+        std::set<llvm::Value *> setManualDrop;
+        std::set<llvm::Value *> setMovedToOtherFunc;
+        std::set<llvm::Value *> setReturned;
+        std::set<llvm::Value *> setOverwritten;
+        std::set<llvm::Value *> setUnknown;
+    };
+
+    // drop_in_place or mem::drop, the calls that end a guard.
+    bool isGuardDropAPI(llvm::StringRef FuncName);
+
+    // Lock guard lifetime analysis shared by the lock detectors.
+    // The def-use walk of each traced Value is done once and cached.
+    class GuardLifetime {
+    public:
+        enum DestKind {
+            AutoDrop = 1,
+            ManualDrop = 2,
+            MovedToOtherFunc = 4,
+            Returned = 8,
+        };
+
+        explicit GuardLifetime(const llvm::DataLayout &DL) : DL(DL) {}
+
+        const GuardDestSet &traceResult(llvm::Value *ResultValue);
+
+        const GuardDestSet &traceLockGuard(llvm::Value *LockGuardValue);
+
+        // Instructions of the given DestKinds reached from the value returned by a lock,
+        // through the guards unwrapped from it when Wrapped.
+        void collectDestInsts(llvm::Value *ReturnValue, bool Wrapped, unsigned Kinds,
+                              std::set<llvm::Instruction *> &setDestInst);
+
+    private:
+        const llvm::DataLayout &DL;
+        std::map<llvm::Value *, GuardDestSet> mapResultDest;
+        std::map<llvm::Value *, GuardDestSet> mapLockGuardDest;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_GUARDLIFETIME_H
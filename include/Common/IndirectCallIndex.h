@@ -0,0 +1,65 @@
+#ifndef RUSTBUGDETECTOR_INDIRECTCALLINDEX_H
+#define RUSTBUGDETECTOR_INDIRECTCALLINDEX_H
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+#include "Common/CallGraphIndex.h"
+
+namespace detector {
+
+    // Candidate callees of the indirect calls of a module, resolved once from the
+    // constant tables of function pointers in it: the vtables of dyn Trait
+    // objects, whose slots also hold the FnOnce::call_once shims of boxed closures.
+    //
+    // A call through a pointer loaded from a slot of a known vtable gets the
+    // function in that slot. A call through a pointer loaded at a constant offset
+    // of an unknown vtable gets the functions at that offset of every table, and
+    // any other indirect call gets the table functions of its signature. Pointer
+    // types match any pointer type, since self is erased to {}* or i8* in a vtable
+    // call. A call of a cast function gets that function. Calls with more than
+    // -rbd-max-indirect-targets candidates get none.
+    class IndirectCallIndex {
+    public:
+        explicit IndirectCallIndex(llvm::Module &M);
+
+        // Indirect calls with at least one candidate, in module order.
+        llvm::ArrayRef<llvm::Instruction *> indirectCalls() const { return vecIndirectCall; }
+
+        // Candidates of I in table order; empty for direct calls and unresolved ones.
+        llvm::ArrayRef<llvm::Function *> getTargets(const llvm::Instruction *I) const;
+
+    private:
+        void addTableSlots(const llvm::GlobalVariable *Table, llvm::Constant *C, uint64_t Offset);
+
+        void resolve(llvm::Instruction *I, std::vector<llvm::Function *> &vecTarget) const;
+
+        const llvm::DataLayout &DL;
+
+        // (table, byte offset) -> function in that slot.
+        std::map<std::pair<const llvm::GlobalVariable *, uint64_t>, llvm::Function *> mapSlotFunc;
+        // Byte offset -> functions at that offset of any table, and
+        // number of parameters -> table functions, both without duplicates.
+        std::map<uint64_t, std::vector<llvm::Function *>> mapOffsetFuncs;
+        std::map<unsigned, std::vector<llvm::Function *>> mapArityFuncs;
+
+        // Targets of vecIndirectCall[Call] are vecTarget[vecTargetBegin[Call] .. vecTargetBegin[Call + 1]).
+        std::vector<llvm::Instruction *> vecIndirectCall;
+        std::vector<unsigned> vecTargetBegin;
+        std::vector<llvm::Function *> vecTarget;
+        llvm::DenseMap<const llvm::Instruction *, unsigned> mapCallId;
+    };
+
+    // Add an edge from every indirect call of Index to each of its defined candidates.
+    void addIndirectCalls(const IndirectCallIndex &Index, CallGraphIndex &CG);
+}
+
+#endif //RUSTBUGDETECTOR_INDIRECTCALLINDEX_H
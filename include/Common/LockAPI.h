@@ -0,0 +1,13 @@
+#ifndef RUSTBUGDETECTOR_LOCKAPI_H
+#define RUSTBUGDETECTOR_LOCKAPI_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace detector {
+
+    // std, parking_lot and lock_api lock and read/write calls, by mangled name.
+    // NewDoubleLockDetector, the snapshot extractor and the summary database use it.
+    bool isLockAPIName(llvm::StringRef Name);
+}
+
+#endif //RUSTBUGDETECTOR_LOCKAPI_H
@@ -0,0 +1,57 @@
+#ifndef RUSTBUGDETECTOR_LOCKBUCKETINDEX_H
+#define RUSTBUGDETECTOR_LOCKBUCKETINDEX_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+
+namespace detector {
+
+    // Function -> lock sites of one bucket (e.g. one lock type).
+    // Built once per bucket and shared, read-only, by the searches of all its locks.
+    class LockBucketIndex {
+    public:
+        void addLock(llvm::Instruction *LockInst);
+
+        bool contains(llvm::Instruction *I) const;
+
+        // F has a site of the bucket other than ExcludeLock, in O(1) after the lookup of F.
+        bool hasLockOtherThan(llvm::Function *F, llvm::Instruction *ExcludeLock) const;
+
+        // Sites of the bucket in F, in insertion order; empty when there is none.
+        const std::vector<llvm::Instruction *> &getLocks(llvm::Function *F) const;
+
+        unsigned size() const { return setLock.size(); }
+
+    private:
+        std::map<llvm::Function *, std::vector<llvm::Instruction *>> mapFuncLocks;
+        std::set<llvm::Instruction *> setLock;
+    };
+
+    // The sites of a bucket that may alias one lock site, as a view on the bucket index:
+    // every site of the bucket in other functions, and in the lock's own function
+    // either every other site, or only the sites in SameFuncLocks when the client
+    // has narrowed them down (e.g. with alias analysis).
+    class MayAliasLocks {
+    public:
+        MayAliasLocks(const LockBucketIndex &Index, llvm::Instruction *LockInst,
+                      const std::set<llvm::Instruction *> *SameFuncLocks = nullptr);
+
+        bool contains(llvm::Instruction *I) const;
+
+        bool hasLockIn(llvm::Function *F) const;
+
+        void getLocksIn(llvm::Function *F, std::vector<llvm::Instruction *> &vecLock) const;
+
+    private:
+        const LockBucketIndex &Index;
+        llvm::Instruction *LockInst;
+        llvm::Function *LockFunc;
+        const std::set<llvm::Instruction *> *SameFuncLocks;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_LOCKBUCKETINDEX_H
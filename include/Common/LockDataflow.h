@@ -0,0 +1,66 @@
+#ifndef RUSTBUGDETECTOR_LOCKDATAFLOW_H
+#define RUSTBUGDETECTOR_LOCKDATAFLOW_H
+
+#include <vector>
+
+#include "llvm/ADT/BitVector.h"
+
+#include "Common/Budget.h"
+
+namespace detector {
+
+    // Forward may-held lock dataflow over one function, solved for all its locks at once.
+    // Locks are dense local ids, blocks are numbered in reverse post order (entry is 0)
+    // and sites are ids chosen by the client, so the solver does not depend on the IR.
+    //
+    // Each event of a block, in program order, transforms the held set as
+    //   Held -= Kill; Conflict = Held & Check; Held -= Check; Held += Gen
+    // A lock site checks the other locks of its bucket and gens itself,
+    // a drop kills the locks it releases and a call checks the locks its callees may acquire.
+    // A held lock stops at its first conflict, as the per-lock search used to stop propagating.
+    class LockDataflow {
+    public:
+        static const unsigned NoLock = ~0u;
+
+        struct Conflict {
+            unsigned Lock;  // held lock
+            unsigned Site;  // event site that conflicts with it
+            unsigned GenLock;  // lock acquired at Site, NoLock for calls
+        };
+
+        LockDataflow(unsigned NumLocks, unsigned NumBlocks);
+
+        void addEdge(unsigned From, unsigned To);
+
+        void addLock(unsigned Block, unsigned Site, unsigned Lock, const llvm::BitVector &Check);
+
+        void addKill(unsigned Block, unsigned Site, const llvm::BitVector &Kill, const llvm::BitVector &Check);
+
+        // Iterate to the fixpoint, one block per Budget.takeBlock().
+        // On truncation the held sets under-approximate the fixpoint.
+        bool solve(ExplorationBudget &Budget);
+
+        // Conflicts of the solved held sets, in block and event order.
+        void collectConflicts(std::vector<Conflict> &vecConflict) const;
+
+    private:
+        struct Event {
+            unsigned Site;
+            unsigned Gen;
+            llvm::BitVector Kill;
+            llvm::BitVector Check;
+        };
+
+        void applyEvent(const Event &E, llvm::BitVector &Held) const;
+
+        unsigned NumLocks;
+        std::vector<std::vector<unsigned>> vecPreds;
+        std::vector<std::vector<Event>> vecEvents;
+        // Per block summary of its events: Out = (In - BlockKill) + BlockGen
+        std::vector<llvm::BitVector> vecBlockGen;
+        std::vector<llvm::BitVector> vecBlockKill;
+        std::vector<llvm::BitVector> vecIn;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_LOCKDATAFLOW_H
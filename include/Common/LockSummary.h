@@ -0,0 +1,64 @@
+#ifndef RUSTBUGDETECTOR_LOCKSUMMARY_H
+#define RUSTBUGDETECTOR_LOCKSUMMARY_H
+
+#include <vector>
+
+namespace detector {
+
+    // Bottom-up summary of the lock buckets each function may acquire,
+    // either directly or through its transitive callees.
+    // Functions, call sites, lock sites and buckets are dense ids chosen by the client.
+    // The call graph is condensed into SCCs once; every function of an SCC shares one summary.
+    class LockSummary {
+    public:
+        static const unsigned NoSite = ~0u;
+
+        struct CallEdge {
+            unsigned Callee;
+            unsigned CallSite;
+        };
+
+        struct LockSite {
+            unsigned Bucket;
+            unsigned Site;
+        };
+
+        void addCall(unsigned Caller, unsigned Callee, unsigned CallSite);
+
+        void addLock(unsigned Func, unsigned Bucket, unsigned Site);
+
+        void build();
+
+        // Func or one of its transitive callees acquires a lock of Bucket other than ExcludeSite.
+        bool mayAcquire(unsigned Func, unsigned Bucket, unsigned ExcludeSite = NoSite) const;
+
+        // One call chain (call site ids, starting in Func) to a function that directly
+        // acquires a lock of Bucket other than ExcludeSite, plus that function's lock sites.
+        bool findWitness(unsigned Func, unsigned Bucket, unsigned ExcludeSite,
+                         std::vector<unsigned> &CallChain,
+                         unsigned &WitnessFunc,
+                         std::vector<unsigned> &SecondLocks) const;
+
+        // Func is in a call graph cycle, so its callees may reach its own lock sites.
+        bool isRecursive(unsigned Func) const;
+
+        unsigned getNumFuncs() const { return vecCallees.size(); }
+
+        unsigned getNumSCCs() const { return vecSCCLocks.size(); }
+
+    private:
+        void ensureFunc(unsigned Func);
+
+        bool hasDirectLock(unsigned Func, unsigned Bucket, unsigned ExcludeSite) const;
+
+        std::vector<std::vector<CallEdge>> vecCallees;
+        std::vector<std::vector<LockSite>> vecDirectLocks;
+        std::vector<unsigned> vecFuncSCC;
+        // Per SCC, sorted by (Bucket, Site), at most two distinct sites per bucket.
+        // Two are enough to answer queries that exclude one site.
+        std::vector<std::vector<LockSite>> vecSCCLocks;
+        std::vector<bool> vecSCCRecursive;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_LOCKSUMMARY_H
@@ -0,0 +1,49 @@
+#ifndef RUSTBUGDETECTOR_OPTIONS_H
+#define RUSTBUGDETECTOR_OPTIONS_H
+
+#include "llvm/Support/CommandLine.h"
+
+namespace detector {
+
+    // Find lock/drop/call sites through the use lists of the classified callees
+    // instead of scanning every instruction of the module.
+    extern llvm::cl::opt<bool> UseListDiscovery;
+
+    // Solve the lock dataflow once per class of FunctionComparator-equivalent
+    // functions and reuse it for the other members of the class.
+    extern llvm::cl::opt<bool> GroupEquivalentFuncs;
+
+    // Most candidate callees of an indirect call that the traversals follow; 0 stops at indirect calls.
+    extern llvm::cl::opt<unsigned> MaxIndirectTargets;
+
+    // Largest function whose control dependence graph gets a transitive closure index.
+    extern llvm::cl::opt<unsigned> CDGClosureMaxNodes;
+
+    // Number of worker threads for the per-function checks. 1 runs everything in the calling thread.
+    extern llvm::cl::opt<unsigned> NumThreads;
+
+    // Exploration budgets of one lock's search and of the whole run, 0 for unlimited.
+    // Only the callees per lock are bounded by default, so a default run does not depend on timing.
+    extern llvm::cl::opt<unsigned> MaxBlocks;
+    extern llvm::cl::opt<unsigned> MaxCallees;
+    extern llvm::cl::opt<unsigned> LockTimeMs;
+    extern llvm::cl::opt<unsigned> DeadlineSec;
+
+    enum class ReportFormat {
+        Text,
+        JSONLines,
+        SARIF,
+    };
+
+    // Where and how findings are written. An empty path writes to stderr.
+    extern llvm::cl::opt<std::string> ReportOutput;
+    extern llvm::cl::opt<ReportFormat> ReportOutputFormat;
+
+    // Lock facts of external crate functions; callee searches stop at those that never lock.
+    extern llvm::cl::opt<std::string> SummaryDBPath;
+
+    // File, or directory of per-module files, of function summaries kept between runs; empty for no cache.
+    extern llvm::cl::opt<std::string> SummaryCachePath;
+}
+
+#endif //RUSTBUGDETECTOR_OPTIONS_H
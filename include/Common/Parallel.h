@@ -0,0 +1,20 @@
+#ifndef RUSTBUGDETECTOR_PARALLEL_H
+#define RUSTBUGDETECTOR_PARALLEL_H
+
+#include <functional>
+
+#include "llvm/Support/raw_ostream.h"
+
+namespace detector {
+
+    // Run Task(0) .. Task(NumTasks - 1) on up to NumThreads workers.
+    // Every task prints into its own buffer and the buffers are written to OS
+    // in task order, so the output does not depend on NumThreads.
+    // With NumThreads <= 1 the tasks run in order and print to OS directly.
+    // Tasks must only read shared state.
+    void runOrderedTasks(unsigned NumTasks, unsigned NumThreads,
+                         const std::function<void(unsigned, llvm::raw_ostream &)> &Task,
+                         llvm::raw_ostream &OS);
+}
+
+#endif //RUSTBUGDETECTOR_PARALLEL_H
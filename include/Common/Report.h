@@ -0,0 +1,84 @@
+#ifndef RUSTBUGDETECTOR_REPORT_H
+#define RUSTBUGDETECTOR_REPORT_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Common/Options.h"
+
+namespace detector {
+
+    enum class FindingKind {
+        DoubleLock,
+    };
+
+    const char *getFindingKindName(FindingKind Kind);
+
+    // Debug location of one instruction, copied out of the IR.
+    struct ReportSite {
+        std::string Directory;
+        std::string File;
+        unsigned Line;
+        std::string Function;
+    };
+
+    ReportSite makeReportSite(const llvm::Instruction *I);
+
+    struct Finding {
+        FindingKind Kind;
+        ReportSite FirstLock;
+        std::vector<ReportSite> SecondLocks;
+        // Call sites from the function of the first lock down to the one of the second lock(s),
+        // empty when both are in the same function.
+        std::vector<ReportSite> CallChain;
+        // Bitcode file the finding comes from, only set when several modules share a report.
+        std::string Module;
+    };
+
+    Finding makeDoubleLockFinding(const llvm::Instruction *FirstLock,
+                                  const std::vector<llvm::Instruction *> &vecSecondLock,
+                                  const std::vector<llvm::Instruction *> &vecCallChain);
+
+    // The JSON Lines form of one finding, also used to store findings between runs.
+    llvm::json::Value toJSON(const Finding &F);
+    bool fromJSON(const llvm::json::Value &V, Finding &F);
+
+    // One module of a batch run.
+    struct ModuleRun {
+        std::string Module;
+        double Seconds;
+        unsigned NumFindings;
+        bool Failed;
+    };
+
+    // Findings of one run. Detectors add findings from any thread; they are only
+    // formatted and written, in one buffered write, at the end of the run.
+    class ReportCollector {
+    public:
+        void add(const Finding &F);
+
+        void add(const std::vector<Finding> &vecFinding);
+
+        // Move the findings of Other here, tagged with Module, and record its run.
+        void addModule(ReportCollector &Other, const ModuleRun &Run);
+
+        unsigned size() const;
+
+        // Write to -rbd-output (stderr when empty) in -rbd-output-format.
+        bool write(llvm::StringRef ToolName);
+
+        void write(ReportFormat Format, llvm::StringRef ToolName, llvm::raw_ostream &OS) const;
+
+    private:
+        mutable std::mutex Mutex;
+        std::vector<Finding> vecFinding;
+        std::vector<ModuleRun> vecModuleRun;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_REPORT_H
@@ -0,0 +1,204 @@
+#ifndef RUSTBUGDETECTOR_SNAPSHOT_H
+#define RUSTBUGDETECTOR_SNAPSHOT_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Common/Report.h"
+
+// The facts the detectors read from a module, in a flat file that is mapped
+// into memory and read in place, without an LLVMContext or the bitcode reader.
+//
+// Layout (host endian, little-endian hosts only): a SnapshotHeader, then one
+// table per SnapshotTable kind, each a packed array of 32-bit records at a
+// 8-byte aligned offset. Records refer to each other by index; strings are
+// byte offsets into the NUL-terminated string table, whose offset 0 is "".
+namespace detector {
+
+    static const uint32_t SnapshotVersion = 2;
+
+    static const uint32_t NoSnapshotId = ~0u;
+
+    enum SnapshotTable {
+        SnapStrings,  // bytes
+        SnapFuncs,
+        SnapBlocks,
+        SnapSuccs,  // function-local block numbers
+        SnapRPO,  // function-local block numbers, reverse post order from the entry
+        SnapSites,
+        SnapEdges,  // site ids
+        SnapLocs,
+        SnapTypes,
+        NumSnapshotTables
+    };
+
+    struct SnapshotTableRef {
+        uint32_t Offset;
+        uint32_t Count;
+    };
+
+    struct SnapshotHeader {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t NumTables;
+        SnapshotTableRef Tables[NumSnapshotTables];
+    };
+
+    enum SnapshotFuncFlags {
+        FuncDefined = 1,
+    };
+
+    // Every function of the module, in module order. Declarations have no blocks.
+    struct SnapshotFunc {
+        uint32_t Name;
+        uint32_t Flags;
+        uint32_t FirstBlock;
+        uint32_t NumBlocks;
+        uint32_t FirstRPO;
+        uint32_t NumRPO;
+    };
+
+    // Blocks in layout order; the sites of a block are in instruction order.
+    struct SnapshotBlock {
+        uint32_t FirstSucc;
+        uint32_t NumSuccs;
+        uint32_t FirstSite;
+        uint32_t NumSites;
+    };
+
+    enum SnapshotSiteFlags {
+        SiteCall = 1,  // direct call, Callee is set
+        SiteLock = 2,  // std/parking_lot/lock_api lock call
+        SiteDrop = 4,  // drop_in_place or mem::drop call
+        SiteUnwrap = 8,  // Result::unwrap or expect call
+        SiteCell = 16,  // core::cell API call
+        SiteAtomic = 32,  // core::sync::atomic API call
+        SiteIndirect = 64,  // IndirectCallIndex candidate of an indirect call, Callee is set
+    };
+
+    // An instruction a detector looks at: a direct call, or an instruction a lock
+    // result reaches. The edges of a lock are the sites that drop its guard, and
+    // LockType is the type of the locked value, NoSnapshotId when the lock result
+    // could not be traced. An indirect call has one site per candidate callee.
+    struct SnapshotSite {
+        uint32_t Func;
+        uint32_t Block;  // function-local
+        uint32_t Flags;
+        uint32_t Callee;
+        uint32_t Loc;
+        uint32_t LockType;
+        uint32_t FirstEdge;
+        uint32_t NumEdges;
+    };
+
+    // Interned debug location.
+    struct SnapshotLoc {
+        uint32_t Directory;
+        uint32_t File;
+        uint32_t Line;
+    };
+
+    struct SnapshotType {
+        uint32_t Name;
+    };
+
+    // Read side. The tables point into the mapped file.
+    class Snapshot {
+    public:
+        // The file starts with the snapshot magic.
+        static bool isSnapshotFile(llvm::StringRef Path);
+
+        // Map Path and check its version and that every index is in range.
+        bool load(llvm::StringRef Path, llvm::raw_ostream &ErrOS);
+
+        llvm::StringRef getString(uint32_t Offset) const;
+
+        llvm::ArrayRef<SnapshotFunc> funcs() const { return Funcs; }
+
+        llvm::ArrayRef<SnapshotBlock> blocks() const { return Blocks; }
+
+        llvm::ArrayRef<SnapshotSite> sites() const { return Sites; }
+
+        llvm::ArrayRef<SnapshotLoc> locs() const { return Locs; }
+
+        llvm::ArrayRef<SnapshotType> types() const { return Types; }
+
+        llvm::ArrayRef<SnapshotBlock> blocksOf(const SnapshotFunc &F) const {
+            return Blocks.slice(F.FirstBlock, F.NumBlocks);
+        }
+
+        llvm::ArrayRef<uint32_t> rpoOf(const SnapshotFunc &F) const {
+            return RPO.slice(F.FirstRPO, F.NumRPO);
+        }
+
+        llvm::ArrayRef<uint32_t> succsOf(const SnapshotBlock &B) const {
+            return Succs.slice(B.FirstSucc, B.NumSuccs);
+        }
+
+        llvm::ArrayRef<uint32_t> edgesOf(const SnapshotSite &S) const {
+            return Edges.slice(S.FirstEdge, S.NumEdges);
+        }
+
+        // Same as makeReportSite on the instruction of Site.
+        ReportSite makeReportSite(uint32_t Site) const;
+
+    private:
+        bool validate(llvm::raw_ostream &ErrOS) const;
+
+        std::unique_ptr<llvm::MemoryBuffer> Buffer;
+        llvm::StringRef Strings;
+        llvm::ArrayRef<SnapshotFunc> Funcs;
+        llvm::ArrayRef<SnapshotBlock> Blocks;
+        llvm::ArrayRef<uint32_t> Succs;
+        llvm::ArrayRef<uint32_t> RPO;
+        llvm::ArrayRef<SnapshotSite> Sites;
+        llvm::ArrayRef<uint32_t> Edges;
+        llvm::ArrayRef<SnapshotLoc> Locs;
+        llvm::ArrayRef<SnapshotType> Types;
+    };
+
+    // Write side, filled by extractSnapshot.
+    class SnapshotWriter {
+    public:
+        SnapshotWriter();
+
+        uint32_t addString(llvm::StringRef Str);
+
+        uint32_t addLoc(llvm::StringRef Directory, llvm::StringRef File, uint32_t Line);
+
+        bool write(llvm::StringRef Path, llvm::raw_ostream &ErrOS) const;
+
+        std::vector<SnapshotFunc> vecFunc;
+        std::vector<SnapshotBlock> vecBlock;
+        std::vector<uint32_t> vecSucc;
+        std::vector<uint32_t> vecRPO;
+        std::vector<SnapshotSite> vecSite;
+        std::vector<uint32_t> vecEdge;
+        std::vector<SnapshotType> vecType;
+
+    private:
+        std::string Strings;
+        llvm::StringMap<uint32_t> mapString;
+        std::vector<SnapshotLoc> vecLoc;
+        std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> mapLoc;
+    };
+
+    // Combine snapshots extracted from disjoint sets of function bodies of one
+    // module (rbd -shards). Functions are matched by symbol name and lock types
+    // by type name, the keys that stay the same across the processes that
+    // extracted them; every other id is renumbered. The functions keep the
+    // order of the first snapshot, so the detectors report what they report on
+    // a single extraction, in the same order.
+    void mergeSnapshots(llvm::ArrayRef<const Snapshot *> vecSnapshot, SnapshotWriter &Writer);
+}
+
+#endif //RUSTBUGDETECTOR_SNAPSHOT_H
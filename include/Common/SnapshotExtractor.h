@@ -0,0 +1,17 @@
+#ifndef RUSTBUGDETECTOR_SNAPSHOTEXTRACTOR_H
+#define RUSTBUGDETECTOR_SNAPSHOTEXTRACTOR_H
+
+#include "llvm/IR/Module.h"
+
+#include "Common/Snapshot.h"
+
+namespace detector {
+
+    // Fill Writer with the functions, CFGs, API and call sites, guard drop edges
+    // and debug locations of M. Lock guards are traced with GuardLifetime the
+    // same way NewDoubleLockDetector traces them. Functions of a lazily loaded M
+    // that were not materialized keep FuncDefined but get no blocks.
+    void extractSnapshot(llvm::Module &M, SnapshotWriter &Writer);
+}
+
+#endif //RUSTBUGDETECTOR_SNAPSHOTEXTRACTOR_H
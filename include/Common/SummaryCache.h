@@ -0,0 +1,75 @@
+#ifndef RUSTBUGDETECTOR_SUMMARYCACHE_H
+#define RUSTBUGDETECTOR_SUMMARYCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Common/Report.h"
+
+namespace detector {
+
+    // The -rbd-cache file of M: the option itself, or a file named after M in
+    // the directory it names, so modules checked in one run keep separate caches.
+    // Empty without -rbd-cache.
+    std::string getSummaryCacheFile(const llvm::Module &M);
+
+    // Name without the trailing 17h<16 hex digits>E of Rust legacy mangling,
+    // which changes with the crate metadata even when the item does not.
+    std::string getStableFuncName(llvm::StringRef Name);
+
+    // Hash of the stable name and the instruction stream of F: opcodes, types,
+    // operands (stable names for globals, local numbers for values and blocks)
+    // and debug locations. The same for an unchanged body in every run.
+    uint64_t hashFunction(const llvm::Function &F);
+
+    // Hash of a set of function hashes, independent of their order.
+    uint64_t combineHashes(std::vector<uint64_t> vecHash);
+
+    // The instructions of F in order. The cache refers to instructions by their index here.
+    void numberInstructions(llvm::Function &F, std::vector<llvm::Instruction *> &vecInst);
+
+    // What a detector derived from one function in an earlier run.
+    struct FuncSummary {
+        uint64_t Hash;
+        // Hash of every body reachable from the function, its findings depend on all of them.
+        uint64_t DeepHash;
+        // The guard drop sites of each lock site, as instruction indices.
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> vecLockDrop;
+        // False when the search was truncated; the findings are then not reused.
+        bool Complete;
+        std::vector<Finding> vecFinding;
+    };
+
+    // Function summaries keyed by hashFunction, kept in a JSON Lines file between runs.
+    // The drop sites and findings also depend on the facts of the summary
+    // database, so the file is only valid for the database hash FactsHash.
+    class SummaryCache {
+    public:
+        explicit SummaryCache(uint64_t FactsHash = 0) : FactsHash(FactsHash) {}
+
+        // A missing file is an empty cache; a file of another version or
+        // written with another summary database is ignored.
+        bool load(llvm::StringRef Path, llvm::raw_ostream &ErrOS);
+
+        bool save(llvm::StringRef Path, llvm::raw_ostream &ErrOS) const;
+
+        // The summary of a body with this hash, or nullptr.
+        const FuncSummary *lookup(uint64_t Hash) const;
+
+        void insert(const FuncSummary &Summary);
+
+    private:
+        uint64_t FactsHash;
+        std::map<uint64_t, FuncSummary> mapSummary;
+    };
+}
+
+#endif //RUSTBUGDETECTOR_SUMMARYCACHE_H
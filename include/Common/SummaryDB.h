@@ -0,0 +1,62 @@
+#ifndef RUSTBUGDETECTOR_SUMMARYDB_H
+#define RUSTBUGDETECTOR_SUMMARYDB_H
+
+#include <cstdint>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace detector {
+
+    enum SummaryFact {
+        SummaryMayLock = 1,  // reaches a lock API, an indirect call or local-crate code
+        SummaryNeverLocks = 2,
+        SummaryDropsArg = 4,  // releases a guard passed as an argument
+    };
+
+    // Lock facts of external crate functions (std, core, hashbrown, lock_api,
+    // parking_lot, ...), keyed by getStableFuncName so that one database fits
+    // every build. A text file with one "<fact> <name>" line per fact, where the
+    // facts are may-lock, never-locks and drops-arg; may-lock wins over never-locks.
+    class SummaryDB {
+    public:
+        // ErrOS gets the reason when the file cannot be read or has a bad line;
+        // the database is then left as it was.
+        bool load(llvm::StringRef Path, llvm::raw_ostream &ErrOS);
+
+        bool save(llvm::StringRef Path, llvm::raw_ostream &ErrOS) const;
+
+        void addFacts(llvm::StringRef StableName, unsigned Facts);
+
+        // SummaryFact bits of the function named Name, 0 when it is not in the database.
+        unsigned lookup(llvm::StringRef Name) const;
+
+        bool dropsArg(llvm::StringRef Name) const {
+            return !mapFacts.empty() && (lookup(Name) & SummaryDropsArg);
+        }
+
+        // A callee search may stop at F: it never locks, and nothing it reaches in
+        // this module is local-crate code (a closure or Drop impl it was instantiated
+        // with), a lock API or a call through a pointer.
+        bool stopsAt(const llvm::Function &F) const;
+
+        bool empty() const { return mapFacts.empty(); }
+
+        // Hash of the facts independent of their order, 0 for an empty database.
+        uint64_t hash() const;
+
+    private:
+        llvm::StringMap<unsigned> mapFacts;
+    };
+
+    // The database of -rbd-summary-db, read on first use; empty without the option.
+    const SummaryDB &getSummaryDB();
+
+    // Add the facts of every function defined in M outside the local crate.
+    void buildSummaryDB(llvm::Module &M, SummaryDB &DB);
+}
+
+#endif //RUSTBUGDETECTOR_SUMMARYDB_H
@@ -0,0 +1,24 @@
+#ifndef RUSTBUGDETECTOR_USELIST_H
+#define RUSTBUGDETECTOR_USELIST_H
+
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+#include "Common/CallGraphIndex.h"
+
+namespace detector {
+
+    // Direct call/invoke sites of Callee, found through its use list.
+    // Uses as an argument (e.g. a function pointer) are not call sites of Callee.
+    void collectDirectCallSites(llvm::Function *Callee,
+                                std::vector<llvm::Instruction *> &CallSites);
+
+    // Same result as scanning every defined function for direct calls,
+    // but only the users of each function are visited.
+    void collectGlobalCallSitesByUses(llvm::Module &M, CallGraphIndex &CG);
+}
+
+#endif //RUSTBUGDETECTOR_USELIST_H
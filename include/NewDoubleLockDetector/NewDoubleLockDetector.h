@@ -4,11 +4,15 @@
 #include "llvm/Pass.h"
 
 namespace detector {
+    class ReportCollector;
+
     struct NewDoubleLockDetector : public llvm::ModulePass {
 
         static char ID;
 
-        NewDoubleLockDetector();
+        // Findings go to Reports when given (e.g. by the rbd driver), otherwise they are
+        // written at the end of runOnModule.
+        explicit NewDoubleLockDetector(ReportCollector *Reports = nullptr);
 
         void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
 
@@ -17,6 +21,7 @@ namespace detector {
     private:
 
         llvm::Module *pModule;
+        ReportCollector *pReports;
     };
 }
 
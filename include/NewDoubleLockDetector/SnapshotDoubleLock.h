@@ -0,0 +1,15 @@
+#ifndef RUSTBUGDETECTOR_SNAPSHOTDOUBLELOCK_H
+#define RUSTBUGDETECTOR_SNAPSHOTDOUBLELOCK_H
+
+#include "Common/Report.h"
+#include "Common/Snapshot.h"
+
+namespace detector {
+
+    // The query of NewDoubleLockDetector on a snapshot instead of a module:
+    // the same lock summaries and per-function lock dataflow, over the sites,
+    // drop edges and CFGs stored by extractSnapshot. No IR is loaded.
+    void detectDoubleLocks(const Snapshot &S, ReportCollector &Reports);
+}
+
+#endif //RUSTBUGDETECTOR_SNAPSHOTDOUBLELOCK_H
@@ -2,24 +2,39 @@
 #define RUSTBUGDETECTOR_SAMELOCKINSAMEFUNC_H
 
 #include "llvm/Pass.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/IR/DataLayout.h"
 
 namespace detector {
+    class FuncAnalyses;
+    class ReportCollector;
+
     struct SameLockInSameFuncDetector : public llvm::ModulePass {
 
         static char ID;
 
-        SameLockInSameFuncDetector();
+        // Findings go to Reports when given (e.g. by the rbd driver), otherwise they are
+        // written at the end of runOnModule.
+        explicit SameLockInSameFuncDetector(ReportCollector *Reports = nullptr);
 
         void getAnalysisUsage(llvm::AnalysisUsage &AU) const override;
 
         bool runOnModule(llvm::Module &M) override;
 
+        // The detection itself, with the function analyses of either pass manager.
+        bool detect(llvm::Module &M, FuncAnalyses &Analyses);
+
     private:
 
         llvm::Module *pModule;
+        ReportCollector *pReports;
         const llvm::DataLayout *pDL;
     };
+
+    // The detector under the new pass manager, registered as "detect" by the plugin.
+    struct SameLockInSameFuncDetectorPass : public llvm::PassInfoMixin<SameLockInSameFuncDetectorPass> {
+        llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
+    };
 }
 
 
@@ -2,8 +2,11 @@
 #define RUSTBUGDETECTOR_USEAFTERFREEDETECTOR_H
 
 #include "llvm/Pass.h"
+#include "llvm/IR/PassManager.h"
 
 namespace detector {
+    class FuncAnalyses;
+
     struct UseAfterFreeDetector : public llvm::ModulePass {
 
         static char ID;
@@ -14,10 +17,18 @@ namespace detector {
 
         bool runOnModule(llvm::Module &M) override;
 
+        // The detection itself, with the function analyses of either pass manager.
+        bool detect(llvm::Module &M, FuncAnalyses &Analyses);
+
     private:
 
         llvm::Module *pModule;
     };
+
+    // The detector under the new pass manager, registered as "detect" by the plugin.
+    struct UseAfterFreeDetectorPass : public llvm::PassInfoMixin<UseAfterFreeDetectorPass> {
+        llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
+    };
 }
 
 #endif //RUSTBUGDETECTOR_USEAFTERFREEDETECTOR_H
@@ -4,7 +4,7 @@
 #include <string>
 #include <set>
 #include <stack>
-#include <CFG/CFG.h>
+#include <CFG/FlatCDG.h>
 
 #include "llvm/Pass.h"
 #include "llvm/Analysis/AliasAnalysis.h"
@@ -15,8 +15,11 @@
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/TypeFinder.h"
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/Support/Debug.h"
 
 #include "Common/CallerFunc.h"
+#include "Common/DetectorPlugin.h"
+#include "Common/FuncAnalyses.h"
 
 #define DEBUG_TYPE "AtomicControlDepDetector"
 
@@ -28,15 +31,11 @@ namespace detector {
 
     AtomicControlDepDetector::AtomicControlDepDetector() : ModulePass(ID) {
         PassRegistry &Registry = *PassRegistry::getPassRegistry();
-        initializePostDominatorTreeWrapperPassPass(Registry);
-        initializeDominatorTreeWrapperPassPass(Registry);
         initializeAAResultsWrapperPassPass(Registry);
     }
 
     void AtomicControlDepDetector::getAnalysisUsage(AnalysisUsage &AU) const {
         AU.setPreservesAll();
-        AU.addRequired<PostDominatorTreeWrapperPass>();
-        AU.addRequired<DominatorTreeWrapperPass>();
         AU.addRequired<AAResultsWrapperPass>();
     }
 
@@ -114,6 +113,11 @@ namespace detector {
     }
 
     bool AtomicControlDepDetector::runOnModule(Module &M) {
+        LegacyFuncAnalyses Analyses(*this);
+        return detect(M, Analyses);
+    }
+
+    bool AtomicControlDepDetector::detect(Module &M, FuncAnalyses &Analyses) {
 
         std::set<Function *> setAtomicReadFunc;
         std::set<Function *> setAtomicWriteFunc;
@@ -232,11 +236,22 @@ namespace detector {
             if (mapCallerAtomicWrite.find(kv.first) == mapCallerAtomicWrite.end()) {
                 continue;
             }
-            DominatorTree *DT = &getAnalysis<DominatorTreeWrapperPass>(*kv.first).getDomTree();
-            PostDominatorTree *PDT = &getAnalysis<PostDominatorTreeWrapperPass>(*kv.first).getPostDomTree();
-            ControlDependenceGraphBase CDG;
-            CDG.graphForFunction(*kv.first, *PDT);
-            AliasAnalysis &AA = getAnalysis<AAResultsWrapperPass>(*kv.first).getAAResults();
+            DominatorTree *DT = &Analyses.getDomTree(*kv.first);
+            FlatControlDependenceGraph &CDG = Analyses.getControlDependenceGraph(*kv.first);
+            // Blocks that decide whether the function panics.
+            SmallPtrSet<BasicBlock *, 16> setPanicBB;
+            SmallPtrSet<BasicBlock *, 32> setPanicInfluencer;
+            auto itPanic = mapCallerPanic.find(kv.first);
+            if (itPanic != mapCallerPanic.end()) {
+                for (Instruction *PanicInst : itPanic->second) {
+                    if (setPanicBB.insert(PanicInst->getParent()).second) {
+                        for (BasicBlock *BB : CDG.influencedBy(PanicInst->getParent())) {
+                            setPanicInfluencer.insert(BB);
+                        }
+                    }
+                }
+            }
+            AliasAnalysis &AA = Analyses.getAA(*kv.first);
             for (Instruction *AtomicReadInst : kv.second) {
                 for (Instruction *AtomicWriteInst : mapCallerAtomicWrite[kv.first]) {
                     // if the first arg aliases and the read'users control write
@@ -249,16 +264,7 @@ namespace detector {
                             BasicBlock *AtomicReadUserBB = UI->getParent();
                             BasicBlock *AtomicWriteBB = AtomicWriteInst->getParent();
                             if (CDG.influences(AtomicReadUserBB, AtomicWriteBB)) {
-                                bool IsPanic = false;
-                                if (mapCallerPanic.find(kv.first) != mapCallerPanic.end()) {
-                                    for (Instruction *PanicInst : mapCallerPanic[kv.first]) {
-                                        if (CDG.influences(AtomicReadUserBB, PanicInst->getParent())) {
-                                            IsPanic = true;
-                                            break;
-                                        }
-                                    }
-                                }
-                                if (IsPanic) {
+                                if (setPanicInfluencer.count(AtomicReadUserBB)) {
                                     continue;
                                 }
                                 if (mapCallerAtomicReadWrite.find(kv.first) == mapCallerAtomicReadWrite.end()) {
@@ -282,10 +288,8 @@ namespace detector {
                     }
                     if (Influenced) {
                         errs() << "AtomicReadInst controls AtomicWriteInst" << "\n";
-                        AtomicReadInst->print(errs());
-                        errs() << "\n";
-                        AtomicWriteInst->print(errs());
-                        errs() << "\n";
+                        LLVM_DEBUG(AtomicReadInst->print(dbgs()); dbgs() << "\n";
+                                   AtomicWriteInst->print(dbgs()); dbgs() << "\n");
                         printDebugInfo(AtomicReadInst);
                         printDebugInfo(AtomicWriteInst);
                     }
@@ -297,6 +301,14 @@ namespace detector {
         return false;
     }
 
+    PreservedAnalyses AtomicControlDepDetectorPass::run(Module &M, ModuleAnalysisManager &MAM) {
+        FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+        NewPMFuncAnalyses Analyses(FAM);
+        AtomicControlDepDetector Detector;
+        Detector.detect(M, Analyses);
+        return PreservedAnalyses::all();
+    }
+
 }  // namespace detector
 
 
@@ -305,3 +317,9 @@ static RegisterPass<detector::AtomicControlDepDetector> X(
         "Detect Atomic Interior Mutability",
         false,
         true);
+
+#ifndef RBD_LINK_INTO_TOOLS
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo llvmGetPassPluginInfo() {
+    return detector::getDetectorPluginInfo<detector::AtomicControlDepDetectorPass>("AtomicControlDepDetector");
+}
+#endif
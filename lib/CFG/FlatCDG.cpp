@@ -0,0 +1,422 @@
+#include "CFG/FlatCDG.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    cl::opt<CDGBuilder> CDGBuilderKind(
+            "rbd-cdg-builder",
+            cl::desc("Algorithm that builds the control dependence graphs"),
+            cl::values(
+                    clEnumValN(CDGBuilder::NearestCommonAncestor, "nca",
+                               "Walk the post-dominator tree up to the nearest common post-dominator of each branch edge"),
+                    clEnumValN(CDGBuilder::PostDominanceFrontier, "frontier",
+                               "Post-dominance frontiers in one bottom-up pass over the post-dominator tree")),
+            cl::init(CDGBuilder::NearestCommonAncestor));
+
+    namespace {
+    struct RawEdge {
+        unsigned From;
+        unsigned Type;
+        unsigned To;
+
+        bool operator<(const RawEdge &Other) const {
+            if (From != Other.From) {
+                return From < Other.From;
+            }
+            if (Type != Other.Type) {
+                return Type < Other.Type;
+            }
+            return To < Other.To;
+        }
+
+        bool operator==(const RawEdge &Other) const {
+            return From == Other.From && Type == Other.Type && To == Other.To;
+        }
+    };
+    }  // namespace
+
+    // Same as ControlDependenceGraphBase::getEdgeType.
+    static ControlDependenceNode::EdgeType getEdgeType(const BasicBlock *A, const BasicBlock *B) {
+        if (const BranchInst *Br = dyn_cast<BranchInst>(A->getTerminator())) {
+            if (Br->isConditional()) {
+                if (Br->getSuccessor(0) == B) {
+                    return ControlDependenceNode::TRUE;
+                }
+                assert(Br->getSuccessor(1) == B && "Asking for edge type between unconnected basic blocks!");
+                return ControlDependenceNode::FALSE;
+            }
+        }
+        return ControlDependenceNode::OTHER;
+    }
+
+    // Counting sort of the (Key, Value) pairs by key into a CSR, stable in input order.
+    template <typename T>
+    static void buildCSR(unsigned NumNodes, const std::vector<std::pair<unsigned, T>> &vecPair,
+                         std::vector<unsigned> &vecBegin, std::vector<T> &vecValue) {
+        vecBegin.assign(NumNodes + 1, 0);
+        for (const std::pair<unsigned, T> &Pair : vecPair) {
+            ++vecBegin[Pair.first + 1];
+        }
+        for (unsigned Node = 0; Node < NumNodes; ++Node) {
+            vecBegin[Node + 1] += vecBegin[Node];
+        }
+        vecValue.resize(vecPair.size());
+        std::vector<unsigned> vecNext(vecBegin.begin(), vecBegin.end() - 1);
+        for (const std::pair<unsigned, T> &Pair : vecPair) {
+            vecValue[vecNext[Pair.first]++] = Pair.second;
+        }
+    }
+
+    const unsigned FlatControlDependenceGraph::RootNode;
+    const unsigned FlatControlDependenceGraph::NoNode;
+
+    typedef DenseMap<const BasicBlock *, unsigned> BlockNodeMap;
+
+    // B and the blocks up the post-dominator tree from it to the nearest common
+    // post-dominator of A and B (A itself when it is that one) depend on A -> B.
+    static void collectAncestorEdges(Function &F, PostDominatorTree &PDT, const BlockNodeMap &mapBlockNode,
+                                     std::vector<RawEdge> &vecEdge) {
+        for (BasicBlock &BB : F) {
+            BasicBlock *A = &BB;
+            unsigned AN = mapBlockNode.lookup(A);
+            for (BasicBlock *B : successors(A)) {
+                if (A != B && PDT.dominates(B, A)) {
+                    continue;
+                }
+                BasicBlock *L = PDT.findNearestCommonDominator(A, B);
+                unsigned Type = getEdgeType(A, B);
+                if (A == L) {
+                    vecEdge.push_back(RawEdge{AN, Type, AN});
+                }
+                for (DomTreeNode *Cur = PDT.getNode(B); Cur && Cur != PDT.getNode(L); Cur = Cur->getIDom()) {
+                    if (!Cur->getBlock()) {
+                        break;
+                    }
+                    vecEdge.push_back(RawEdge{AN, Type, mapBlockNode.lookup(Cur->getBlock())});
+                }
+            }
+        }
+    }
+
+    // Y depends on the CFG edge X -> S iff Y post-dominates S but does not
+    // strictly post-dominate X, i.e. X -> S is in the post-dominance frontier
+    // of Y, kept as edges rather than blocks for the branch outcome. Children
+    // come before their parent in post order, and the frontier of Y is
+    //     local: X -> Y for each predecessor X of Y that Y does not immediately post-dominate
+    //     up:    X -> S in the frontier of a child of Y, unless Y immediately post-dominates X
+    // A child's frontier is dropped once it has been passed up.
+    static void collectFrontierEdges(Function &F, PostDominatorTree &PDT, const BlockNodeMap &mapBlockNode,
+                                     std::vector<RawEdge> &vecEdge) {
+        typedef std::pair<BasicBlock *, BasicBlock *> CFGEdge;
+        std::vector<std::vector<CFGEdge>> vecFrontier(mapBlockNode.size() + 1);
+        for (DomTreeNode *YN : post_order(PDT.getRootNode())) {
+            BasicBlock *Y = YN->getBlock();
+            if (!Y) {
+                continue;
+            }
+            unsigned Node = mapBlockNode.lookup(Y);
+            std::vector<CFGEdge> &Frontier = vecFrontier[Node];
+            for (BasicBlock *X : predecessors(Y)) {
+                DomTreeNode *XN = PDT.getNode(X);
+                if (XN && XN->getIDom() != YN) {
+                    Frontier.push_back(std::make_pair(X, Y));
+                }
+            }
+            for (DomTreeNode *Child : *YN) {
+                std::vector<CFGEdge> &ChildFrontier = vecFrontier[mapBlockNode.lookup(Child->getBlock())];
+                for (const CFGEdge &E : ChildFrontier) {
+                    if (PDT.getNode(E.first)->getIDom() != YN) {
+                        Frontier.push_back(E);
+                    }
+                }
+                std::vector<CFGEdge>().swap(ChildFrontier);
+            }
+            for (const CFGEdge &E : Frontier) {
+                vecEdge.push_back(RawEdge{mapBlockNode.lookup(E.first), getEdgeType(E.first, E.second), Node});
+            }
+        }
+    }
+
+    void FlatControlDependenceGraph::graphForFunction(Function &F, PostDominatorTree &PDT, CDGBuilder Builder) {
+        releaseMemory();
+        vecBlock.push_back(nullptr);
+        for (BasicBlock &BB : F) {
+            mapBlockNode[&BB] = vecBlock.size();
+            vecBlock.push_back(&BB);
+        }
+
+        std::vector<RawEdge> vecEdge;
+        if (Builder == CDGBuilder::PostDominanceFrontier) {
+            collectFrontierEdges(F, PDT, mapBlockNode, vecEdge);
+        } else {
+            collectAncestorEdges(F, PDT, mapBlockNode, vecEdge);
+        }
+        // ENTRY -> START
+        for (DomTreeNode *Cur = PDT.getNode(&F.getEntryBlock()); Cur; Cur = Cur->getIDom()) {
+            if (Cur->getBlock()) {
+                vecEdge.push_back(RawEdge{RootNode, ControlDependenceNode::OTHER, mapBlockNode[Cur->getBlock()]});
+            }
+        }
+        std::sort(vecEdge.begin(), vecEdge.end());
+        vecEdge.erase(std::unique(vecEdge.begin(), vecEdge.end()), vecEdge.end());
+
+        std::vector<std::pair<unsigned, FlatCDGEdge>> vecChildPair;
+        std::vector<std::pair<unsigned, unsigned>> vecParentPair;
+        for (const RawEdge &E : vecEdge) {
+            FlatCDGEdge Child;
+            Child.Node = E.To;
+            Child.Type = static_cast<ControlDependenceNode::EdgeType>(E.Type);
+            vecChildPair.push_back(std::make_pair(E.From, Child));
+            vecParentPair.push_back(std::make_pair(E.To, E.From));
+        }
+        // A node that is both a true and a false child has its parent once.
+        std::sort(vecParentPair.begin(), vecParentPair.end());
+        vecParentPair.erase(std::unique(vecParentPair.begin(), vecParentPair.end()), vecParentPair.end());
+        buildCSR(vecBlock.size(), vecChildPair, vecChildBegin, vecChild);
+        buildCSR(vecBlock.size(), vecParentPair, vecParentBegin, vecParent);
+    }
+
+    void FlatControlDependenceGraph::releaseMemory() {
+        vecBlock.clear();
+        mapBlockNode.clear();
+        vecChildBegin.clear();
+        vecChild.clear();
+        vecParentBegin.clear();
+        vecParent.clear();
+        vecNodeSCC.clear();
+        ClosureWords = 0;
+        vecClosure.clear();
+    }
+
+    unsigned FlatControlDependenceGraph::getNode(const BasicBlock *BB) const {
+        auto it = mapBlockNode.find(BB);
+        return it != mapBlockNode.end() ? it->second : NoNode;
+    }
+
+    bool FlatControlDependenceGraph::controls(BasicBlock *A, BasicBlock *B) const {
+        unsigned Node = getNode(B);
+        assert(Node != NoNode && "Basic block not in control dependence graph!");
+        // Bounded, since a block can be its own only parent.
+        for (unsigned Step = 0; Step < getNumNodes() && parents(Node).size() == 1; ++Step) {
+            Node = parents(Node).front();
+            if (vecBlock[Node] == A) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool FlatControlDependenceGraph::influences(BasicBlock *A, BasicBlock *B) const {
+        unsigned Node = getNode(B);
+        assert(Node != NoNode && "Basic block not in control dependence graph!");
+        if (hasClosure()) {
+            unsigned ANode = A ? getNode(A) : RootNode;
+            return ANode != NoNode && inClosure(vecNodeSCC[Node], vecNodeSCC[ANode]);
+        }
+        return findAncestor(Node, [&](unsigned Ancestor) { return vecBlock[Ancestor] == A; });
+    }
+
+    bool FlatControlDependenceGraph::influencesAny(const SmallPtrSetImpl<BasicBlock *> &Sources,
+                                                   BasicBlock *Target) const {
+        unsigned Node = getNode(Target);
+        assert(Node != NoNode && "Basic block not in control dependence graph!");
+        if (hasClosure()) {
+            for (BasicBlock *Source : Sources) {
+                unsigned SourceNode = getNode(Source);
+                if (SourceNode != NoNode && inClosure(vecNodeSCC[Node], vecNodeSCC[SourceNode])) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        return findAncestor(Node, [&](unsigned Ancestor) {
+            return vecBlock[Ancestor] && Sources.count(vecBlock[Ancestor]);
+        });
+    }
+
+    std::vector<BasicBlock *> FlatControlDependenceGraph::influencedBy(BasicBlock *B) const {
+        unsigned Node = getNode(B);
+        assert(Node != NoNode && "Basic block not in control dependence graph!");
+        std::vector<BasicBlock *> vecAncestor;
+        if (hasClosure()) {
+            for (unsigned Ancestor = RootNode + 1; Ancestor < getNumNodes(); ++Ancestor) {
+                if (inClosure(vecNodeSCC[Node], vecNodeSCC[Ancestor])) {
+                    vecAncestor.push_back(vecBlock[Ancestor]);
+                }
+            }
+            return vecAncestor;
+        }
+        findAncestor(Node, [&](unsigned Ancestor) {
+            if (vecBlock[Ancestor]) {
+                vecAncestor.push_back(vecBlock[Ancestor]);
+            }
+            return false;
+        });
+        return vecAncestor;
+    }
+
+    bool FlatControlDependenceGraph::findAncestor(unsigned Node, function_ref<bool(unsigned)> Found) const {
+        std::vector<unsigned> WorkList(1, Node);
+        BitVector Visited(getNumNodes());
+        Visited.set(Node);
+        while (!WorkList.empty()) {
+            Node = WorkList.back();
+            WorkList.pop_back();
+            if (Found(Node)) {
+                return true;
+            }
+            for (unsigned Parent : parents(Node)) {
+                if (!Visited.test(Parent)) {
+                    Visited.set(Parent);
+                    WorkList.push_back(Parent);
+                }
+            }
+        }
+        return false;
+    }
+
+    bool FlatControlDependenceGraph::findPath(BasicBlock *A, BasicBlock *B,
+                                              std::map<BasicBlock *, BasicBlock *> &next_bb) const {
+        unsigned Node = getNode(B);
+        assert(Node != NoNode && "Basic block not in control dependence graph!");
+        std::vector<unsigned> WorkList(1, Node);
+        BitVector Processed(getNumNodes());
+        while (!WorkList.empty()) {
+            Node = WorkList.back();
+            WorkList.pop_back();
+            if (vecBlock[Node] == A) {
+                return true;
+            }
+            Processed.set(Node);
+            for (unsigned Parent : parents(Node)) {
+                if (Processed.test(Parent)) {
+                    continue;
+                }
+                next_bb[vecBlock[Parent]] = vecBlock[Node];
+                WorkList.push_back(Parent);
+            }
+        }
+        return false;
+    }
+
+    void FlatControlDependenceGraph::buildClosure() {
+        unsigned NumNodes = getNumNodes();
+        // Tarjan's algorithm over the parent edges, without recursion. A component
+        // is complete only after every component it reaches, i.e. its ancestors.
+        std::vector<unsigned> vecIndex(NumNodes, NoNode);
+        std::vector<unsigned> vecLow(NumNodes);
+        std::vector<unsigned> vecStack;
+        BitVector OnStack(NumNodes);
+        // (node, position of its next parent) of the nodes being visited.
+        std::vector<std::pair<unsigned, unsigned>> vecVisit;
+        // Nodes grouped by component, in component order.
+        std::vector<unsigned> vecSCCOrder;
+        vecNodeSCC.assign(NumNodes, NoNode);
+        unsigned NextIndex = 0;
+        unsigned NumSCCs = 0;
+        for (unsigned Start = 0; Start < NumNodes; ++Start) {
+            if (vecIndex[Start] != NoNode) {
+                continue;
+            }
+            vecIndex[Start] = vecLow[Start] = NextIndex++;
+            vecStack.push_back(Start);
+            OnStack.set(Start);
+            vecVisit.push_back(std::make_pair(Start, 0u));
+            while (!vecVisit.empty()) {
+                unsigned Node = vecVisit.back().first;
+                ArrayRef<unsigned> Parents = parents(Node);
+                if (vecVisit.back().second < Parents.size()) {
+                    unsigned Parent = Parents[vecVisit.back().second++];
+                    if (vecIndex[Parent] == NoNode) {
+                        vecIndex[Parent] = vecLow[Parent] = NextIndex++;
+                        vecStack.push_back(Parent);
+                        OnStack.set(Parent);
+                        vecVisit.push_back(std::make_pair(Parent, 0u));
+                    } else if (OnStack.test(Parent)) {
+                        vecLow[Node] = std::min(vecLow[Node], vecIndex[Parent]);
+                    }
+                    continue;
+                }
+                vecVisit.pop_back();
+                if (!vecVisit.empty()) {
+                    unsigned Child = vecVisit.back().first;
+                    vecLow[Child] = std::min(vecLow[Child], vecLow[Node]);
+                }
+                if (vecLow[Node] != vecIndex[Node]) {
+                    continue;
+                }
+                unsigned Member;
+                do {
+                    Member = vecStack.back();
+                    vecStack.pop_back();
+                    OnStack.reset(Member);
+                    vecNodeSCC[Member] = NumSCCs;
+                    vecSCCOrder.push_back(Member);
+                } while (Member != Node);
+                ++NumSCCs;
+            }
+        }
+
+        // Ancestor components have smaller numbers, so their rows are final
+        // when they are merged into a row.
+        ClosureWords = (NumSCCs + 63) / 64;
+        vecClosure.assign(size_t(NumSCCs) * ClosureWords, 0);
+        for (unsigned Node : vecSCCOrder) {
+            unsigned SCC = vecNodeSCC[Node];
+            uint64_t *Row = &vecClosure[size_t(SCC) * ClosureWords];
+            Row[SCC / 64] |= uint64_t(1) << (SCC % 64);
+            for (unsigned Parent : parents(Node)) {
+                unsigned ParentSCC = vecNodeSCC[Parent];
+                if (ParentSCC == SCC) {
+                    continue;
+                }
+                const uint64_t *ParentRow = &vecClosure[size_t(ParentSCC) * ClosureWords];
+                for (unsigned Word = 0; Word < ClosureWords; ++Word) {
+                    Row[Word] |= ParentRow[Word];
+                }
+            }
+        }
+    }
+
+    bool FlatControlDependenceGraph::invalidate(Function &F, const PreservedAnalyses &PA,
+                                                FunctionAnalysisManager::Invalidator &Inv) {
+        auto PAC = PA.getChecker<ControlDependenceAnalysis>();
+        return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>()
+                 || PAC.preservedSet<CFGAnalyses>());
+    }
+
+    AnalysisKey ControlDependenceAnalysis::Key;
+
+    FlatControlDependenceGraph ControlDependenceAnalysis::run(Function &F, FunctionAnalysisManager &FAM) {
+        FlatControlDependenceGraph CDG;
+        CDG.graphForFunction(F, FAM.getResult<PostDominatorTreeAnalysis>(F), Builder);
+        return CDG;
+    }
+
+    char ControlDependenceWrapperPass::ID = 0;
+
+    bool ControlDependenceWrapperPass::runOnFunction(Function &F) {
+        CDG.graphForFunction(F, getAnalysis<PostDominatorTreeWrapperPass>().getPostDomTree(), CDGBuilderKind);
+        return false;
+    }
+
+    void ControlDependenceWrapperPass::getAnalysisUsage(AnalysisUsage &AU) const {
+        AU.setPreservesAll();
+        AU.addRequired<PostDominatorTreeWrapperPass>();
+    }
+}
+
+static RegisterPass<detector::ControlDependenceWrapperPass> X(
+        "rbd-cdg",
+        "Control Dependence Graph",
+        true,
+        true);
@@ -14,7 +14,9 @@
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/TypeFinder.h"
 
+#include "Common/CallGraphIndex.h"
 #include "Common/CallerFunc.h"
+#include "Common/IndirectCallIndex.h"
 
 #define DEBUG_TYPE "CellIMDetector"
 
@@ -95,7 +97,7 @@ namespace detector {
     }
 
     static bool collectCallees(Function *F,
-                          std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallee) {
+                          CallGraphIndex &CG) {
         if (!F || F->isDeclaration()) {
             return false;
         }
@@ -108,7 +110,7 @@ namespace detector {
                         CallSite CS(I);
                         Function *Callee = CS.getCalledFunction();
                         if (Callee && !Callee->isDeclaration()) {
-                            mapCallerCallee[F].insert(std::make_pair(I, Callee));
+                            CG.addCall(I, Callee);
                         }
                     }
                 }
@@ -186,7 +188,7 @@ namespace detector {
     static bool containsCellIM (
             Function *SyncImmuFunc,
             std::set<Function *> &setCellIMFunc,
-            std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallSites,
+            const CallGraphIndex &CG,
             std::vector<Function *> &vecTrack
             ) {
 
@@ -203,13 +205,12 @@ namespace detector {
             if (setCellIMFunc.find(Curr) != setCellIMFunc.end()) {
                 return true;
             }
-            if (mapCallerCallSites.find(Curr) == mapCallerCallSites.end()) {
-                continue;
-            }
-            for (auto &kv : mapCallerCallSites[Curr]) {
-                if (setCellIMFunc.find(kv.second) != setCellIMFunc.end()) {
+            for (unsigned Site : CG.callSitesIn(Curr)) {
+                Instruction *CallInst = CG.getCallInst(Site);
+                Function *Callee = CG.getCallee(Site);
+                if (setCellIMFunc.find(Callee) != setCellIMFunc.end()) {
 //                    // Track
-                    vecTrack.push_back(kv.second);
+                    vecTrack.push_back(Callee);
                     Function *TrackCurr = Curr;
                     while (TrackCurr != SyncImmuFunc) {
                         vecTrack.push_back(TrackCurr);
@@ -218,11 +219,11 @@ namespace detector {
                     vecTrack.push_back(SyncImmuFunc);
                     return true;
                 }
-                if (isSelfToSelfCI(kv.first)) {
-                    if (Visited.find(kv.second) == Visited.end()) {
-                        WorkList.push_back(kv.second);
-                        Visited.insert(kv.second);
-                        CalleeTracker[kv.second] = Curr;
+                if (isSelfToSelfCI(CallInst)) {
+                    if (Visited.find(Callee) == Visited.end()) {
+                        WorkList.push_back(Callee);
+                        Visited.insert(Callee);
+                        CalleeTracker[Callee] = Curr;
                     }
                 }
             }
@@ -248,10 +249,10 @@ namespace detector {
     static bool collectCellIMCallers(
             std::set<Function *> &setSyncImmuFunc,
             std::set<Function *> &setCellIMFunc,
-            std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallSites) {
+            const CallGraphIndex &CG) {
         for (Function *SyncImmuFunc : setSyncImmuFunc) {
             std::vector<Function *> vecTracker;
-            if (containsCellIM(SyncImmuFunc, setCellIMFunc, mapCallerCallSites, vecTracker)) {
+            if (containsCellIM(SyncImmuFunc, setCellIMFunc, CG, vecTracker)) {
                 if (Instruction *FirstInst = SyncImmuFunc->getEntryBlock().getFirstNonPHIOrDbgOrLifetime()) {
                     printDebugInfo(FirstInst);
                 }
@@ -306,7 +307,7 @@ namespace detector {
             }
         }
 
-        std::map<Function *, std::map<Instruction *, Function *>> mapCallerCallSites;
+        CallGraphIndex CG(M);
         std::map<Function *, Function *> mapCellIMCallerCallee;
         std::set<Function *> setCellIMFunc;
         std::map<Function *, Function *> Parents;
@@ -314,14 +315,17 @@ namespace detector {
             if (isCellIMFunc(&F)) {
                 setCellIMFunc.insert(&F);
             } else {
-                collectCallees(&F, mapCallerCallSites);
+                collectCallees(&F, CG);
             }
         }
 //        errs() << "CellIMFunc:\n";
 //        for (Function *F : setCellIMFunc) {
 //            errs().write_escaped(F->getName()) << "\n";
 //        }
-        collectCellIMCallers(setSyncImmuFunc, setCellIMFunc, mapCallerCallSites);
+        IndirectCallIndex Indirect(M);
+        addIndirectCalls(Indirect, CG);
+        CG.build();
+        collectCellIMCallers(setSyncImmuFunc, setCellIMFunc, CG);
         return false;
     }
 
@@ -0,0 +1,92 @@
+#include "Common/Budget.h"
+
+#include "Common/Options.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    Deadline::Deadline() : Enabled(DeadlineSec != 0) {
+        End = std::chrono::steady_clock::now() + std::chrono::seconds(DeadlineSec);
+    }
+
+    bool Deadline::expired() const {
+        return Enabled && std::chrono::steady_clock::now() >= End;
+    }
+
+    ExplorationBudget::ExplorationBudget(const Deadline &Global)
+            : Global(Global), Start(std::chrono::steady_clock::now()),
+              Blocks(0), Callees(0), Reason(nullptr) {
+    }
+
+    bool ExplorationBudget::checkTime() {
+        if (Global.expired()) {
+            Reason = "global deadline";
+            return false;
+        }
+        if (LockTimeMs != 0
+            && std::chrono::steady_clock::now() - Start >= std::chrono::milliseconds(LockTimeMs)) {
+            Reason = "time limit";
+            return false;
+        }
+        return true;
+    }
+
+    bool ExplorationBudget::takeBlock() {
+        if (Reason) {
+            return false;
+        }
+        if (MaxBlocks != 0 && Blocks >= MaxBlocks) {
+            Reason = "block limit";
+            return false;
+        }
+        ++Blocks;
+        return checkTime();
+    }
+
+    bool ExplorationBudget::takeCallee() {
+        if (Reason) {
+            return false;
+        }
+        if (MaxCallees != 0 && Callees >= MaxCallees) {
+            Reason = "callee limit";
+            return false;
+        }
+        ++Callees;
+        return checkTime();
+    }
+
+    void recordTruncation(Instruction *LockInst, const ExplorationBudget &Budget,
+                          std::vector<TruncatedSearch> &vecTruncated) {
+        if (!Budget.isTruncated()) {
+            return;
+        }
+        recordTruncation(makeReportSite(LockInst), Budget, vecTruncated);
+    }
+
+    void recordTruncation(const ReportSite &Lock, const ExplorationBudget &Budget,
+                          std::vector<TruncatedSearch> &vecTruncated) {
+        if (!Budget.isTruncated()) {
+            return;
+        }
+        TruncatedSearch TS;
+        TS.Lock = Lock;
+        TS.Reason = Budget.getReason();
+        vecTruncated.push_back(TS);
+    }
+
+    void printTruncationSummary(const std::vector<TruncatedSearch> &vecTruncated, raw_ostream &OS) {
+        if (vecTruncated.empty()) {
+            return;
+        }
+        OS << "Truncated Searches: " << vecTruncated.size() << "\n";
+        for (const TruncatedSearch &TS : vecTruncated) {
+            OS << TS.Reason << ": " << TS.Lock.Function << "\n";
+            if (!TS.Lock.File.empty()) {
+                OS << " " << TS.Lock.Directory << ' '
+                   << TS.Lock.File << ' '
+                   << TS.Lock.Line << "\n";
+            }
+        }
+    }
+}
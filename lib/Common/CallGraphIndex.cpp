@@ -0,0 +1,153 @@
+#include "Common/CallGraphIndex.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace detector {
+
+    CallGraphIndex::CallGraphIndex(Module &M) {
+        for (Function &F : M) {
+            mapFuncId[&F] = vecFunc.size();
+            vecFunc.push_back(&F);
+        }
+    }
+
+    unsigned CallGraphIndex::getFuncId(const Function *F) const {
+        auto it = mapFuncId.find(F);
+        assert(it != mapFuncId.end() && "Function of another module");
+        return it->second;
+    }
+
+    void CallGraphIndex::addCall(Instruction *I, Function *Callee) {
+        auto it = mapSiteId.find(I);
+        if (it != mapSiteId.end()) {
+            vecSiteCallee[it->second] = getFuncId(Callee);
+            return;
+        }
+        mapSiteId[I] = vecSiteInst.size();
+        vecSiteInst.push_back(I);
+        vecSiteCaller.push_back(getFuncId(I->getFunction()));
+        vecSiteCallee.push_back(getFuncId(Callee));
+    }
+
+    void CallGraphIndex::addIndirectCall(Instruction *I, Function *Callee) {
+        mapIndirectSites[I].push_back(vecSiteInst.size());
+        vecSiteInst.push_back(I);
+        vecSiteCaller.push_back(getFuncId(I->getFunction()));
+        vecSiteCallee.push_back(getFuncId(Callee));
+    }
+
+    // Counting sort of the sites by caller and by callee, stable in site order.
+    static void buildCSR(unsigned NumFuncs, const std::vector<unsigned> &vecSiteKey,
+                         std::vector<unsigned> &vecBegin, std::vector<unsigned> &vecSite) {
+        vecBegin.assign(NumFuncs + 1, 0);
+        for (unsigned Key : vecSiteKey) {
+            ++vecBegin[Key + 1];
+        }
+        for (unsigned F = 0; F < NumFuncs; ++F) {
+            vecBegin[F + 1] += vecBegin[F];
+        }
+        vecSite.resize(vecSiteKey.size());
+        std::vector<unsigned> vecNext(vecBegin.begin(), vecBegin.end() - 1);
+        for (unsigned Site = 0; Site < vecSiteKey.size(); ++Site) {
+            vecSite[vecNext[vecSiteKey[Site]]++] = Site;
+        }
+    }
+
+    // Detectors add sites as they find them, e.g. by walking use-lists, whose order
+    // depends on how the module was built. Renumber them by caller and position.
+    void CallGraphIndex::sortSites() {
+        DenseMap<const Instruction *, unsigned> mapPosition;
+        std::vector<bool> vecHasSite(vecFunc.size(), false);
+        for (unsigned Caller : vecSiteCaller) {
+            vecHasSite[Caller] = true;
+        }
+        for (unsigned Func = 0; Func < vecFunc.size(); ++Func) {
+            if (!vecHasSite[Func]) {
+                continue;
+            }
+            unsigned Position = 0;
+            for (BasicBlock &B : *vecFunc[Func]) {
+                for (Instruction &I : B) {
+                    mapPosition[&I] = Position++;
+                }
+            }
+        }
+
+        std::vector<unsigned> vecOrder(vecSiteInst.size());
+        for (unsigned Site = 0; Site < vecOrder.size(); ++Site) {
+            vecOrder[Site] = Site;
+        }
+        // Stable, so the candidates of an indirect call keep the order they were added in.
+        std::stable_sort(vecOrder.begin(), vecOrder.end(), [&](unsigned A, unsigned B) {
+            if (vecSiteCaller[A] != vecSiteCaller[B]) {
+                return vecSiteCaller[A] < vecSiteCaller[B];
+            }
+            return mapPosition.lookup(vecSiteInst[A]) < mapPosition.lookup(vecSiteInst[B]);
+        });
+
+        std::vector<unsigned> vecNewId(vecOrder.size());
+        std::vector<Instruction *> vecInst(vecOrder.size());
+        std::vector<unsigned> vecCaller(vecOrder.size());
+        std::vector<unsigned> vecCallee(vecOrder.size());
+        for (unsigned NewId = 0; NewId < vecOrder.size(); ++NewId) {
+            unsigned Site = vecOrder[NewId];
+            vecNewId[Site] = NewId;
+            vecInst[NewId] = vecSiteInst[Site];
+            vecCaller[NewId] = vecSiteCaller[Site];
+            vecCallee[NewId] = vecSiteCallee[Site];
+        }
+        vecSiteInst.swap(vecInst);
+        vecSiteCaller.swap(vecCaller);
+        vecSiteCallee.swap(vecCallee);
+        for (auto &InstSite : mapSiteId) {
+            InstSite.second = vecNewId[InstSite.second];
+        }
+        for (auto &InstSites : mapIndirectSites) {
+            for (unsigned &Site : InstSites.second) {
+                Site = vecNewId[Site];
+            }
+        }
+    }
+
+    void CallGraphIndex::build() {
+        sortSites();
+        buildCSR(vecFunc.size(), vecSiteCaller, vecOutBegin, vecOutSite);
+        buildCSR(vecFunc.size(), vecSiteCallee, vecInBegin, vecInSite);
+    }
+
+    ArrayRef<unsigned> CallGraphIndex::callSitesIn(const Function *F) const {
+        auto it = mapFuncId.find(F);
+        if (it == mapFuncId.end()) {
+            return ArrayRef<unsigned>();
+        }
+        return makeArrayRef(vecOutSite).slice(vecOutBegin[it->second],
+                                              vecOutBegin[it->second + 1] - vecOutBegin[it->second]);
+    }
+
+    ArrayRef<unsigned> CallGraphIndex::callSitesOf(const Function *F) const {
+        auto it = mapFuncId.find(F);
+        if (it == mapFuncId.end()) {
+            return ArrayRef<unsigned>();
+        }
+        return makeArrayRef(vecInSite).slice(vecInBegin[it->second],
+                                             vecInBegin[it->second + 1] - vecInBegin[it->second]);
+    }
+
+    Function *CallGraphIndex::getCalleeOf(const Instruction *I) const {
+        auto it = mapSiteId.find(I);
+        if (it == mapSiteId.end()) {
+            return nullptr;
+        }
+        return vecFunc[vecSiteCallee[it->second]];
+    }
+
+    ArrayRef<unsigned> CallGraphIndex::indirectSitesOf(const Instruction *I) const {
+        auto it = mapIndirectSites.find(I);
+        if (it == mapIndirectSites.end()) {
+            return ArrayRef<unsigned>();
+        }
+        return it->second;
+    }
+}
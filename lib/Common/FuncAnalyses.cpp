@@ -0,0 +1,99 @@
+#include "Common/FuncAnalyses.h"
+
+#include "Common/Options.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    // Clients ask influences many times per function, so small enough graphs get the closure.
+    static FlatControlDependenceGraph &indexClosure(FlatControlDependenceGraph &CDG) {
+        if (!CDG.hasClosure() && CDG.getNumNodes() <= CDGClosureMaxNodes) {
+            CDG.buildClosure();
+        }
+        return CDG;
+    }
+
+    // Functions whose analyses LegacyFuncAnalyses keeps. Detectors come back to a
+    // function they just left, e.g. NewCellIM walking up callers, and a few are
+    // enough for that while bounding the memory of the largest results.
+    static const unsigned MaxCachedFuncs = 8;
+
+    LegacyFuncAnalyses::LegacyFuncAnalyses(Pass &P) : P(P), pAAFunc(nullptr), pAA(nullptr) {}
+
+    AAResults &LegacyFuncAnalyses::getAA(Function &F) {
+        if (pAAFunc != &F) {
+            pAA = &P.getAnalysis<AAResultsWrapperPass>(F).getAAResults();
+            pAAFunc = &F;
+        }
+        return *pAA;
+    }
+
+    LegacyFuncAnalyses::FuncResults &LegacyFuncAnalyses::getResults(Function &F) {
+        for (auto it = lstResults.begin(); it != lstResults.end(); ++it) {
+            if (it->F == &F) {
+                lstResults.splice(lstResults.begin(), lstResults, it);
+                return lstResults.front();
+            }
+        }
+        if (lstResults.size() == MaxCachedFuncs) {
+            lstResults.pop_back();
+        }
+        lstResults.emplace_front();
+        lstResults.front().F = &F;
+        return lstResults.front();
+    }
+
+    DominatorTree &LegacyFuncAnalyses::getDomTree(Function &F) {
+        std::unique_ptr<DominatorTree> &DT = getResults(F).DT;
+        if (!DT) {
+            DT.reset(new DominatorTree(F));
+        }
+        return *DT;
+    }
+
+    PostDominatorTree &LegacyFuncAnalyses::getPostDomTree(Function &F) {
+        std::unique_ptr<PostDominatorTree> &PDT = getResults(F).PDT;
+        if (!PDT) {
+            PDT.reset(new PostDominatorTree(F));
+        }
+        return *PDT;
+    }
+
+    LoopInfo &LegacyFuncAnalyses::getLoopInfo(Function &F) {
+        std::unique_ptr<LoopInfo> &LI = getResults(F).LI;
+        if (!LI) {
+            LI.reset(new LoopInfo(getDomTree(F)));
+        }
+        return *LI;
+    }
+
+    FlatControlDependenceGraph &LegacyFuncAnalyses::getControlDependenceGraph(Function &F) {
+        std::unique_ptr<FlatControlDependenceGraph> &CDG = getResults(F).CDG;
+        if (!CDG) {
+            CDG.reset(new FlatControlDependenceGraph());
+            CDG->graphForFunction(F, getPostDomTree(F), CDGBuilderKind);
+        }
+        return indexClosure(*CDG);
+    }
+
+    AAResults &NewPMFuncAnalyses::getAA(Function &F) {
+        return FAM.getResult<AAManager>(F);
+    }
+
+    DominatorTree &NewPMFuncAnalyses::getDomTree(Function &F) {
+        return FAM.getResult<DominatorTreeAnalysis>(F);
+    }
+
+    PostDominatorTree &NewPMFuncAnalyses::getPostDomTree(Function &F) {
+        return FAM.getResult<PostDominatorTreeAnalysis>(F);
+    }
+
+    LoopInfo &NewPMFuncAnalyses::getLoopInfo(Function &F) {
+        return FAM.getResult<LoopAnalysis>(F);
+    }
+
+    FlatControlDependenceGraph &NewPMFuncAnalyses::getControlDependenceGraph(Function &F) {
+        return indexClosure(FAM.getResult<ControlDependenceAnalysis>(F));
+    }
+}
@@ -0,0 +1,48 @@
+#include "Common/FunctionGroups.h"
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Transforms/Utils/FunctionComparator.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    FunctionGroups::FunctionGroups(ArrayRef<Function *> vecFunc) : NumFuncs(vecFunc.size()) {
+        GlobalNumberState GlobalNumbers;
+        // Hash -> classes whose representative has it.
+        std::map<FunctionComparator::FunctionHash, std::vector<unsigned>> mapHashClasses;
+        for (Function *F : vecFunc) {
+            std::vector<unsigned> &vecCandidate = mapHashClasses[FunctionComparator::functionHash(*F)];
+            bool Grouped = false;
+            for (unsigned Class : vecCandidate) {
+                if (FunctionComparator(vecClass[Class].front(), F, &GlobalNumbers).compare() == 0) {
+                    vecClass[Class].push_back(F);
+                    Grouped = true;
+                    break;
+                }
+            }
+            if (!Grouped) {
+                vecCandidate.push_back(vecClass.size());
+                vecClass.push_back(std::vector<Function *>(1, F));
+            }
+        }
+    }
+
+    bool FunctionGroups::mapInstructions(Function &From, Function &To, std::map<Instruction *, Instruction *> &mapInst) {
+        ReversePostOrderTraversal<Function *> FromRPOT(&From);
+        ReversePostOrderTraversal<Function *> ToRPOT(&To);
+        auto itTo = ToRPOT.begin();
+        for (BasicBlock *FromBB : FromRPOT) {
+            if (itTo == ToRPOT.end() || FromBB->size() != (*itTo)->size()) {
+                return false;
+            }
+            auto itToInst = (*itTo)->begin();
+            for (Instruction &I : *FromBB) {
+                mapInst[&I] = &*itToInst++;
+            }
+            ++itTo;
+        }
+        return itTo == ToRPOT.end();
+    }
+}
@@ -0,0 +1,462 @@
+#include "Common/GuardLifetime.h"
+
+#include <list>
+
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/Debug.h"
+
+#include "Common/CallerFunc.h"
+#include "Common/SummaryDB.h"
+
+#define DEBUG_TYPE "GuardLifetime"
+
+using namespace llvm;
+
+namespace detector {
+
+    static bool isResultToInnerAPI(StringRef FuncName) {
+        return FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6unwrap17h")
+               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$9unwrap_or17h")
+               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$14unwrap_or_else17h")
+               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$17unwrap_or_default17h")
+               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6expect17h");
+    }
+
+    static bool isResultToResultAPI(StringRef FuncName) {
+        return FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$7map_err17h")
+               || FuncName.startswith(
+                "_ZN73_$LT$core..result..Result$LT$T$C$E$GT$$u20$as$u20$core..ops..try..Try$GT$11into_result17h");
+//        FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$3map17h") -> T->U
+//        || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$2ok17h") -> Option
+    }
+
+    static bool isAutoDropAPI(StringRef FuncName) {
+        return FuncName.startswith("_ZN4core3ptr18real_drop_in_place17h");
+    }
+
+    // mem::drop, or a function the summary database says releases its argument.
+    static bool isManualDropAPI(StringRef FuncName) {
+        return FuncName.startswith("_ZN4core3mem4drop17h") || getSummaryDB().dropsArg(FuncName);
+    }
+
+    bool isGuardDropAPI(StringRef FuncName) {
+        return isAutoDropAPI(FuncName) || FuncName.startswith("_ZN4core3mem4drop17h");
+    }
+
+    static bool isDerefAPI(StringRef FuncName) {
+        return FuncName.startswith(
+                "_ZN81_$LT$std..sync..mutex..MutexGuard$LT$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
+               || FuncName.startswith(
+                "_ZN84_$LT$std..sync..mutex..MutexGuard$LT$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
+               || FuncName.startswith(
+                "_ZN84_$LT$lock_api..mutex..MutexGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
+               || FuncName.startswith(
+                "_ZN87_$LT$lock_api..mutex..MutexGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
+               || FuncName.startswith(
+                "_ZN88_$LT$std..sync..rwlock..RwLockWriteGuard$LT$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
+               || FuncName.startswith(
+                "_ZN91_$LT$std..sync..rwlock..RwLockWriteGuard$LT$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
+               || FuncName.startswith(
+                "_ZN87_$LT$std..sync..rwlock..RwLockReadGuard$LT$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
+               || FuncName.startswith(
+                "_ZN90_$LT$std..sync..rwlock..RwLockReadGuard$LT$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
+               || FuncName.startswith(
+                "_ZN90_$LT$lock_api..rwlock..RwLockReadGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
+               || FuncName.startswith(
+                "_ZN93_$LT$lock_api..rwlock..RwLockReadGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
+               || FuncName.startswith(
+                "_ZN91_$LT$lock_api..rwlock..RwLockWriteGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
+               || FuncName.startswith(
+                "_ZN94_$LT$lock_api..rwlock..RwLockWriteGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h");
+    }
+
+    enum class ResultState {
+        WrappedInResult = 0,  // Init
+        MovedToOtherInst = 1,
+        Unwrapped = 2,  // Term
+        AutoDropped = 3,  // Term
+        ManualDropped = 4,  // Term
+        MovedToOtherFunc = 5, // Term  // consider as unlock
+        Returned = 6,  // Term
+        Overwritten = 7,  // Term
+        Unknown = 8  // Term
+    };
+
+    static bool getNextValueForResult(Use *InputUse, Value *&Output, ResultState &RS, const DataLayout &DL) {
+        User *InputUser = InputUse->getUser();
+        if (Instruction *I = dyn_cast<Instruction>(InputUser)) {
+            if (isCallOrInvokeInst(I)) {
+                CallSite CS;
+                if (Function *F = getCalledFunc(I, CS)) {
+                    StringRef FuncName = F->getName();
+                    if (isResultToInnerAPI(FuncName)) {
+                        if (F->getReturnType()->isVoidTy()) {
+                            Output = GetUnderlyingObject(I->getOperand(0), DL);
+                        } else {
+                            Output = I;
+                        }
+                        RS = ResultState::Unwrapped;
+                        return false;
+                    } else if (isResultToResultAPI(FuncName)) {
+//                        // Debug
+//                        errs() << "Is Result To Result API\n";
+//                        I->print(errs());
+//                        errs() << "\n";
+//                        printDebugInfo(I);
+//                        errs().write_escaped(I->getFunction()->getName()) << "\n\n";
+                        if (F->getReturnType()->isVoidTy()) {
+                            Output = GetUnderlyingObject(I->getOperand(0), DL);
+                        } else {
+                            Output = I;
+                        }
+                        RS = ResultState::MovedToOtherInst;
+                        return true;
+                    } else if (isAutoDropAPI(FuncName)) {
+                        Output = I;
+                        RS = ResultState::AutoDropped;
+                        return false;
+                    } else if (isManualDropAPI(FuncName)) {
+                        Output = I;
+                        RS = ResultState::ManualDropped;
+                        return false;
+                    } else if (MemTransferInst *MI = dyn_cast<MemTransferInst>(I)) {
+                        if (MI->getOperandUse(0) == *InputUse) {
+                            Output = I;
+                            RS = ResultState::Overwritten;
+                            return false;
+                        } else {
+                            Output = GetUnderlyingObject(MI->getOperand(0), DL);
+                            RS = ResultState::MovedToOtherInst;
+                            return true;
+                        }
+                    } else if (isa<MemSetInst>(I)) {
+                        Output = I;
+                        RS = ResultState::Overwritten;
+                        return false;
+                    } else {
+                        Output = I;
+                        RS = ResultState::MovedToOtherFunc;
+                        return false;
+                    }
+                } else {
+                    Output = I;
+                    RS = ResultState::MovedToOtherFunc;
+                    return false;
+                }
+            } else if (isa<LoadInst>(I)) {
+                Output = I;
+                RS = ResultState::MovedToOtherInst;
+                return true;
+            } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+                if (SI->getOperandUse(1) == *InputUse) {
+                    Output = I;
+                    RS = ResultState::Overwritten;
+                    return false;
+                } else {
+                    Output = GetUnderlyingObject(SI->getOperand(1), DL);
+                    RS = ResultState::MovedToOtherInst;
+                    return true;
+                }
+            } else if (isa<InsertValueInst>(I)) {
+                Output = I;
+                RS = ResultState::MovedToOtherInst;
+                return true;
+            } else if (isa<CastInst>(I)) {
+                Output = I;
+                RS = ResultState::MovedToOtherInst;
+                return true;
+            } else if (isa<GetElementPtrInst>(I)) {
+                Output = I;
+                RS = ResultState::MovedToOtherInst;
+                return true;
+            } else if (isa<ExtractValueInst>(I)) {
+                Output = I;
+                RS = ResultState::MovedToOtherInst;
+                return true;
+            } else if (isa<ReturnInst>(I)) {
+                Output = I;
+                RS = ResultState::Returned;
+                return false;
+            } else {
+                Output = I;
+                RS = ResultState::Unknown;
+                return false;
+            }
+        } else {
+            Output = InputUser;
+            RS = ResultState::Unknown;
+            return false;
+        }
+    }
+
+    static bool runFSMForResult(Value *ResultValue, GuardDestSet &Dest, const DataLayout &DL) {
+
+        Value *NextValue = ResultValue;
+        std::list<Value *> WorkList;
+        std::set<Value *> Visited;
+        WorkList.push_back(NextValue);
+        Visited.insert(NextValue);
+        ResultState RS = ResultState::WrappedInResult;
+//        errs() << "NextValue:\n";
+//        NextValue->print(errs());
+//        errs() << "\n";
+        while (!WorkList.empty()) {
+            NextValue = WorkList.front();
+            WorkList.pop_front();
+            if (User *NI = dyn_cast<User>(NextValue)) {
+                for (Use &U : NI->uses()) {
+                    Value *CurrNextValue = nullptr;
+                    if (getNextValueForResult(&U, CurrNextValue, RS, DL)) {
+                        if (Visited.find(CurrNextValue) == Visited.end()) {
+                            WorkList.push_back(CurrNextValue);
+                            Visited.insert(CurrNextValue);
+                        }
+                    } else {
+                        if (RS == ResultState::Unwrapped) {
+                            Dest.setLockGuard.insert(CurrNextValue);
+                        } else if (RS == ResultState::AutoDropped) {
+                            Dest.setAutoDrop.insert(CurrNextValue);
+                        } else if (RS == ResultState::ManualDropped) {
+                            Dest.setManualDrop.insert(CurrNextValue);
+                        } else if (RS == ResultState::MovedToOtherFunc) {
+                            Dest.setMovedToOtherFunc.insert(CurrNextValue);
+                        } else if (RS == ResultState::Returned) {
+                            Dest.setReturned.insert(CurrNextValue);
+                        } else if (RS == ResultState::Overwritten) {
+                            Dest.setOverwritten.insert(CurrNextValue);
+                        } else if (RS == ResultState::Unknown) {
+                            Dest.setUnknown.insert(CurrNextValue);
+                        } else {
+                            assert(false && "Cannot Reach to Result Parsing!");
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    enum class LockGuardState {
+        Unwrapped = 0,  // Init
+        MovedToOtherInst = 1,
+        Dereferenced = 2,  // Term  // further drop not related
+        AutoDropped = 3,  // Term
+        ManualDropped = 4,  // Term
+        MovedToOtherFunc = 5, // Term  // consider as unlock
+        Returned = 6,  // Term
+        Overwritten = 7,  // Term
+        Unknown = 8  // Term
+    };
+
+    static bool getNextValueForLockGuard(Use *InputUse, Value *&Output, LockGuardState &LGS, const DataLayout &DL) {
+        User *InputUser = InputUse->getUser();
+        if (Instruction *I = dyn_cast<Instruction>(InputUser)) {
+            if (isCallOrInvokeInst(I)) {
+                CallSite CS;
+                if (Function *F = getCalledFunc(I, CS)) {
+                    StringRef FuncName = F->getName();
+                    if (isAutoDropAPI(FuncName)) {
+                        Output = I;
+                        LGS = LockGuardState::AutoDropped;
+                        return false;
+                    } else if (isManualDropAPI(FuncName)) {
+                        Output = I;
+                        LGS = LockGuardState::ManualDropped;
+                        return false;
+                    } else if (isDerefAPI(FuncName)) {
+                        if (F->getReturnType()->isVoidTy()) {
+                            Output = GetUnderlyingObject(I->getOperand(0), DL);
+                        } else {
+                            Output = I;
+                        }
+                        LGS = LockGuardState::Dereferenced;
+                        return false;
+                    } else if (MemTransferInst *MI = dyn_cast<MemTransferInst>(I)) {
+                        if (MI->getOperandUse(0) == *InputUse) {
+                            Output = I;
+                            LGS = LockGuardState::Overwritten;
+                            return false;
+                        } else {
+                            Output = GetUnderlyingObject(MI->getOperand(0), DL);
+                            LGS = LockGuardState::MovedToOtherInst;
+                            return true;
+                        }
+                    } else if (isa<MemSetInst>(I)) {
+                        Output = I;
+                        LGS = LockGuardState::Overwritten;
+                        return false;
+                    } else {
+                        Output = I;
+                        LLVM_DEBUG(dbgs() << "Moved to other func\n" << *I << "\n";
+                                   dbgs().write_escaped(I->getFunction()->getName()) << "\n\n");
+                        LGS = LockGuardState::MovedToOtherFunc;
+                        return false;
+                    }
+                } else {
+                    Output = I;
+                    LGS = LockGuardState::MovedToOtherFunc;
+                    return false;
+                }
+            } else if (isa<LoadInst>(I)) {
+                Output = I;
+                LGS = LockGuardState::MovedToOtherInst;
+                return true;
+            } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+                if (SI->getOperandUse(1) == *InputUse) {
+                    Output = I;
+                    LGS = LockGuardState::Overwritten;
+                    return false;
+                } else {
+//                    SI->print(errs());
+//                    errs() << "\n";
+                    Output = GetUnderlyingObject(SI->getOperand(1), DL);
+//                    errs() << "Stored Value\n";
+//                    Output->print(errs());
+//                    errs() << "\n";
+                    LGS = LockGuardState::MovedToOtherInst;
+                    return true;
+                }
+            } else if (isa<InsertValueInst>(I)) {
+                Output = I;
+                LGS = LockGuardState::MovedToOtherInst;
+                return true;
+            } else if (isa<CastInst>(I)) {
+                Output = I;
+                LGS = LockGuardState::MovedToOtherInst;
+                return true;
+            } else if (isa<GetElementPtrInst>(I)) {
+                Output = I;
+                LGS = LockGuardState::MovedToOtherInst;
+                return true;
+            } else if (isa<ExtractValueInst>(I)) {
+                Output = I;
+                LGS = LockGuardState::MovedToOtherInst;
+                return true;
+            } else if (isa<ReturnInst>(I)) {
+                Output = I;
+                LGS = LockGuardState::Returned;
+                return false;
+            } else {
+                Output = I;
+                LGS = LockGuardState::Unknown;
+                return false;
+            }
+        } else {
+            Output = InputUser;
+            LGS = LockGuardState::Unknown;
+            return false;
+        }
+    }
+
+    static bool runFSMForLockGuard(Value *LockGuardValue, GuardDestSet &Dest, const DataLayout &DL) {
+
+        Value *NextValue = LockGuardValue;
+        std::list<Value *> WorkList;
+        std::set<Value *> Visited;
+        WorkList.push_back(NextValue);
+        Visited.insert(NextValue);
+        LockGuardState LGS = LockGuardState::Unwrapped;
+//        errs() << "NextValue:\n";
+//        NextValue->print(errs());
+//        errs() << "\n";
+        while (!WorkList.empty()) {
+            NextValue = WorkList.front();
+            WorkList.pop_front();
+            if (User *NI = dyn_cast<User>(NextValue)) {
+                for (Use &U : NI->uses()) {
+                    Value *CurrNextValue = nullptr;
+                    if (getNextValueForLockGuard(&U, CurrNextValue, LGS, DL)) {
+                        if (Visited.find(CurrNextValue) == Visited.end()) {
+                            WorkList.push_back(CurrNextValue);
+                            Visited.insert(CurrNextValue);
+                        }
+                    } else {
+                        if (LGS == LockGuardState::Dereferenced) {
+                            Dest.setDeref.insert(CurrNextValue);
+                        } else if (LGS == LockGuardState::AutoDropped) {
+                            Dest.setAutoDrop.insert(CurrNextValue);
+                        } else if (LGS == LockGuardState::ManualDropped) {
+                            Dest.setManualDrop.insert(CurrNextValue);
+                        } else if (LGS == LockGuardState::MovedToOtherFunc) {
+//                            errs() << "!!!Moved to Other Func\n";
+//                            CurrNextValue->print(errs());
+//                            errs() << "\n";
+                            Dest.setMovedToOtherFunc.insert(CurrNextValue);
+                        } else if (LGS == LockGuardState::Returned) {
+                            Dest.setReturned.insert(CurrNextValue);
+                        } else if (LGS == LockGuardState::Overwritten) {
+                            Dest.setOverwritten.insert(CurrNextValue);
+                        } else if (LGS == LockGuardState::Unknown) {
+                            Dest.setUnknown.insert(CurrNextValue);
+                        } else {
+                            assert(false && "Cannot Reach to LockGuard Parsing!");
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    const GuardDestSet &GuardLifetime::traceResult(Value *ResultValue) {
+        auto it = mapResultDest.find(ResultValue);
+        if (it != mapResultDest.end()) {
+            return it->second;
+        }
+        GuardDestSet &Dest = mapResultDest[ResultValue];
+        runFSMForResult(ResultValue, Dest, DL);
+        return Dest;
+    }
+
+    const GuardDestSet &GuardLifetime::traceLockGuard(Value *LockGuardValue) {
+        auto it = mapLockGuardDest.find(LockGuardValue);
+        if (it != mapLockGuardDest.end()) {
+            return it->second;
+        }
+        GuardDestSet &Dest = mapLockGuardDest[LockGuardValue];
+        runFSMForLockGuard(LockGuardValue, Dest, DL);
+        return Dest;
+    }
+
+    static void insertDestInsts(const GuardDestSet &Dest, unsigned Kinds,
+                                std::set<Instruction *> &setDestInst) {
+        std::set<Value *> setValue;
+        if (Kinds & GuardLifetime::AutoDrop) {
+            setValue.insert(Dest.setAutoDrop.begin(), Dest.setAutoDrop.end());
+        }
+        if (Kinds & GuardLifetime::ManualDrop) {
+            setValue.insert(Dest.setManualDrop.begin(), Dest.setManualDrop.end());
+        }
+        if (Kinds & GuardLifetime::MovedToOtherFunc) {
+            setValue.insert(Dest.setMovedToOtherFunc.begin(), Dest.setMovedToOtherFunc.end());
+        }
+        if (Kinds & GuardLifetime::Returned) {
+            setValue.insert(Dest.setReturned.begin(), Dest.setReturned.end());
+        }
+        for (Value *V : setValue) {
+            if (Instruction *I = dyn_cast<Instruction>(V)) {
+                setDestInst.insert(I);
+            }
+        }
+    }
+
+    void GuardLifetime::collectDestInsts(Value *ReturnValue, bool Wrapped, unsigned Kinds,
+                                         std::set<Instruction *> &setDestInst) {
+        if (!ReturnValue) {
+            return;
+        }
+        if (!Wrapped) {
+            insertDestInsts(traceLockGuard(ReturnValue), Kinds, setDestInst);
+            return;
+        }
+        const GuardDestSet &ResultDest = traceResult(ReturnValue);
+        insertDestInsts(ResultDest, Kinds, setDestInst);
+        for (Value *LockGuardValue : ResultDest.setLockGuard) {
+            insertDestInsts(traceLockGuard(LockGuardValue), Kinds, setDestInst);
+        }
+    }
+}
@@ -0,0 +1,175 @@
+#include "Common/IndirectCallIndex.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+
+#include "Common/Options.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    static void addUnique(std::vector<Function *> &vecFunc, Function *F) {
+        if (std::find(vecFunc.begin(), vecFunc.end(), F) == vecFunc.end()) {
+            vecFunc.push_back(F);
+        }
+    }
+
+    static bool isCompatibleType(Type *A, Type *B) {
+        return A == B || (A->isPointerTy() && B->isPointerTy());
+    }
+
+    static bool isCompatibleCallee(FunctionType *CallTy, const Function *F) {
+        FunctionType *FTy = F->getFunctionType();
+        if (FTy->getNumParams() != CallTy->getNumParams() || FTy->isVarArg() != CallTy->isVarArg()) {
+            return false;
+        }
+        if (!isCompatibleType(FTy->getReturnType(), CallTy->getReturnType())) {
+            return false;
+        }
+        for (unsigned Param = 0; Param < FTy->getNumParams(); ++Param) {
+            if (!isCompatibleType(FTy->getParamType(Param), CallTy->getParamType(Param))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    IndirectCallIndex::IndirectCallIndex(Module &M) : DL(M.getDataLayout()) {
+        vecTargetBegin.push_back(0);
+        if (MaxIndirectTargets == 0) {
+            return;
+        }
+        for (GlobalVariable &GV : M.globals()) {
+            if (GV.isConstant() && GV.hasDefinitiveInitializer()) {
+                addTableSlots(&GV, GV.getInitializer(), 0);
+            }
+        }
+        for (Function &F : M) {
+            for (BasicBlock &BB : F) {
+                for (Instruction &I : BB) {
+                    if (!isa<CallInst>(I) && !isa<InvokeInst>(I)) {
+                        continue;
+                    }
+                    unsigned Begin = vecTarget.size();
+                    resolve(&I, vecTarget);
+                    if (vecTarget.size() == Begin) {
+                        continue;
+                    }
+                    mapCallId[&I] = vecIndirectCall.size();
+                    vecIndirectCall.push_back(&I);
+                    vecTargetBegin.push_back(vecTarget.size());
+                }
+            }
+        }
+    }
+
+    // Record the functions stored in C, which sits at Offset bytes into Table.
+    void IndirectCallIndex::addTableSlots(const GlobalVariable *Table, Constant *C, uint64_t Offset) {
+        if (C->getType()->isPointerTy()) {
+            Function *F = dyn_cast<Function>(C->stripPointerCasts());
+            if (!F) {
+                return;
+            }
+            mapSlotFunc[std::make_pair(Table, Offset)] = F;
+            addUnique(mapOffsetFuncs[Offset], F);
+            addUnique(mapArityFuncs[F->getFunctionType()->getNumParams()], F);
+            return;
+        }
+        if (ConstantStruct *CS = dyn_cast<ConstantStruct>(C)) {
+            const StructLayout *SL = DL.getStructLayout(CS->getType());
+            for (unsigned Field = 0; Field < CS->getNumOperands(); ++Field) {
+                addTableSlots(Table, CS->getOperand(Field), Offset + SL->getElementOffset(Field));
+            }
+        } else if (ConstantArray *CA = dyn_cast<ConstantArray>(C)) {
+            uint64_t ElementSize = DL.getTypeAllocSize(CA->getType()->getElementType());
+            for (unsigned Element = 0; Element < CA->getNumOperands(); ++Element) {
+                addTableSlots(Table, CA->getOperand(Element), Offset + Element * ElementSize);
+            }
+        }
+    }
+
+    // Candidates of I, appended to vecTarget; none when there are more than MaxIndirectTargets.
+    void IndirectCallIndex::resolve(Instruction *I, std::vector<Function *> &vecTarget) const {
+        CallSite CS(I);
+        if (CS.getCalledFunction()) {
+            return;
+        }
+        Value *Called = CS.getCalledValue()->stripPointerCasts();
+        if (isa<InlineAsm>(Called)) {
+            return;
+        }
+        FunctionType *CallTy = cast<CallBase>(I)->getFunctionType();
+        // A direct call through a cast of the callee.
+        if (Function *F = dyn_cast<Function>(Called)) {
+            vecTarget.push_back(F);
+            return;
+        }
+
+        std::vector<Function *> vecCandidate;
+        bool Resolved = false;
+        if (LoadInst *Slot = dyn_cast<LoadInst>(Called)) {
+            Value *Ptr = Slot->getPointerOperand();
+            APInt Offset(DL.getPointerSizeInBits(Ptr->getType()->getPointerAddressSpace()), 0);
+            Value *Table = Ptr->stripAndAccumulateInBoundsConstantOffsets(DL, Offset);
+            if (!Offset.isNegative()) {
+                uint64_t SlotOffset = Offset.getZExtValue();
+                GlobalVariable *GV = dyn_cast<GlobalVariable>(Table);
+                if (GV && GV->isConstant()) {
+                    auto itSlot = mapSlotFunc.find(std::make_pair(GV, SlotOffset));
+                    if (itSlot != mapSlotFunc.end() && isCompatibleCallee(CallTy, itSlot->second)) {
+                        vecCandidate.push_back(itSlot->second);
+                    }
+                    Resolved = true;
+                } else if (!GV) {
+                    auto itOffset = mapOffsetFuncs.find(SlotOffset);
+                    if (itOffset != mapOffsetFuncs.end()) {
+                        for (Function *F : itOffset->second) {
+                            if (isCompatibleCallee(CallTy, F)) {
+                                vecCandidate.push_back(F);
+                            }
+                        }
+                    }
+                    Resolved = !vecCandidate.empty();
+                }
+            }
+        }
+        if (!Resolved) {
+            auto itArity = mapArityFuncs.find(CallTy->getNumParams());
+            if (itArity != mapArityFuncs.end()) {
+                for (Function *F : itArity->second) {
+                    if (isCompatibleCallee(CallTy, F)) {
+                        vecCandidate.push_back(F);
+                    }
+                }
+            }
+        }
+        if (vecCandidate.size() <= MaxIndirectTargets) {
+            vecTarget.insert(vecTarget.end(), vecCandidate.begin(), vecCandidate.end());
+        }
+    }
+
+    ArrayRef<Function *> IndirectCallIndex::getTargets(const Instruction *I) const {
+        auto it = mapCallId.find(I);
+        if (it == mapCallId.end()) {
+            return ArrayRef<Function *>();
+        }
+        return makeArrayRef(vecTarget).slice(vecTargetBegin[it->second],
+                                             vecTargetBegin[it->second + 1] - vecTargetBegin[it->second]);
+    }
+
+    void addIndirectCalls(const IndirectCallIndex &Index, CallGraphIndex &CG) {
+        for (Instruction *I : Index.indirectCalls()) {
+            for (Function *Target : Index.getTargets(I)) {
+                if (!Target->isDeclaration()) {
+                    CG.addIndirectCall(I, Target);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#include "Common/LockAPI.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    bool isLockAPIName(StringRef Name) {
+        if (Name.find("mutex") != StringRef::npos || Name.find("Mutex") != StringRef::npos) {
+            if (Name.find("raw_mutex") != StringRef::npos || Name.find("RawMutex") != StringRef::npos) {
+                return false;
+            }
+            return Name.find("GT$4lock") != StringRef::npos;
+        } else if (Name.find("rwlock") != StringRef::npos || Name.find("RwLock") != StringRef::npos) {
+            if (Name.startswith("HandyRwLock$LT$T$GT$$GT$2rl")
+                || Name.startswith("HandyRwLock$LT$T$GT$$GT$2wl")) {
+                return true;
+            } else if (Name.find("raw_rwlock") != StringRef::npos || Name.find("RawRwLock") != StringRef::npos) {
+                return false;
+            }
+            return Name.find("$GT$4read") != StringRef::npos || Name.find("$GT$5write") != StringRef::npos;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,69 @@
+#include "Common/LockBucketIndex.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    void LockBucketIndex::addLock(Instruction *LockInst) {
+        if (setLock.insert(LockInst).second) {
+            mapFuncLocks[LockInst->getFunction()].push_back(LockInst);
+        }
+    }
+
+    bool LockBucketIndex::contains(Instruction *I) const {
+        return setLock.find(I) != setLock.end();
+    }
+
+    bool LockBucketIndex::hasLockOtherThan(Function *F, Instruction *ExcludeLock) const {
+        auto it = mapFuncLocks.find(F);
+        if (it == mapFuncLocks.end()) {
+            return false;
+        }
+        // Sites are distinct, so a second one is never ExcludeLock.
+        return it->second.size() > 1 || it->second.front() != ExcludeLock;
+    }
+
+    const std::vector<Instruction *> &LockBucketIndex::getLocks(Function *F) const {
+        static const std::vector<Instruction *> NoLocks;
+        auto it = mapFuncLocks.find(F);
+        if (it == mapFuncLocks.end()) {
+            return NoLocks;
+        }
+        return it->second;
+    }
+
+    MayAliasLocks::MayAliasLocks(const LockBucketIndex &Index, Instruction *LockInst,
+                                 const std::set<Instruction *> *SameFuncLocks)
+            : Index(Index), LockInst(LockInst), LockFunc(LockInst->getFunction()),
+              SameFuncLocks(SameFuncLocks) {
+    }
+
+    bool MayAliasLocks::contains(Instruction *I) const {
+        if (I == LockInst) {
+            return false;
+        }
+        if (SameFuncLocks && I->getFunction() == LockFunc) {
+            return SameFuncLocks->find(I) != SameFuncLocks->end();
+        }
+        return Index.contains(I);
+    }
+
+    bool MayAliasLocks::hasLockIn(Function *F) const {
+        if (SameFuncLocks && F == LockFunc) {
+            return !SameFuncLocks->empty();
+        }
+        return Index.hasLockOtherThan(F, LockInst);
+    }
+
+    void MayAliasLocks::getLocksIn(Function *F, std::vector<Instruction *> &vecLock) const {
+        if (SameFuncLocks && F == LockFunc) {
+            vecLock.insert(vecLock.end(), SameFuncLocks->begin(), SameFuncLocks->end());
+            return;
+        }
+        for (Instruction *I : Index.getLocks(F)) {
+            if (I != LockInst) {
+                vecLock.push_back(I);
+            }
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#include "Common/LockDataflow.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    const unsigned LockDataflow::NoLock;
+
+    LockDataflow::LockDataflow(unsigned NumLocks, unsigned NumBlocks)
+            : NumLocks(NumLocks), vecPreds(NumBlocks), vecEvents(NumBlocks),
+              vecBlockGen(NumBlocks, BitVector(NumLocks)),
+              vecBlockKill(NumBlocks, BitVector(NumLocks)),
+              vecIn(NumBlocks, BitVector(NumLocks)) {
+    }
+
+    void LockDataflow::addEdge(unsigned From, unsigned To) {
+        vecPreds[To].push_back(From);
+    }
+
+    void LockDataflow::addLock(unsigned Block, unsigned Site, unsigned Lock, const BitVector &Check) {
+        Event E;
+        E.Site = Site;
+        E.Gen = Lock;
+        E.Kill = BitVector(NumLocks);
+        E.Check = Check;
+        vecBlockGen[Block].reset(Check);
+        vecBlockGen[Block].set(Lock);
+        vecBlockKill[Block] |= Check;
+        vecBlockKill[Block].reset(Lock);
+        vecEvents[Block].push_back(E);
+    }
+
+    void LockDataflow::addKill(unsigned Block, unsigned Site, const BitVector &Kill, const BitVector &Check) {
+        Event E;
+        E.Site = Site;
+        E.Gen = NoLock;
+        E.Kill = Kill;
+        E.Check = Check;
+        vecBlockGen[Block].reset(Kill);
+        vecBlockGen[Block].reset(Check);
+        vecBlockKill[Block] |= Kill;
+        vecBlockKill[Block] |= Check;
+        vecEvents[Block].push_back(E);
+    }
+
+    void LockDataflow::applyEvent(const Event &E, BitVector &Held) const {
+        Held.reset(E.Kill);
+        Held.reset(E.Check);
+        if (E.Gen != NoLock) {
+            Held.set(E.Gen);
+        }
+    }
+
+    // Blocks are already in reverse post order, so sweeping them in order
+    // converges in a few passes on reducible CFGs.
+    bool LockDataflow::solve(ExplorationBudget &Budget) {
+        unsigned NumBlocks = vecIn.size();
+        std::vector<BitVector> vecOut(NumBlocks, BitVector(NumLocks));
+        BitVector In(NumLocks);
+        bool Changed = true;
+        while (Changed) {
+            Changed = false;
+            for (unsigned B = 0; B < NumBlocks; ++B) {
+                if (!Budget.takeBlock()) {
+                    return false;
+                }
+                In.reset();
+                for (unsigned Pred : vecPreds[B]) {
+                    In |= vecOut[Pred];
+                }
+                vecIn[B] = In;
+                In.reset(vecBlockKill[B]);
+                In |= vecBlockGen[B];
+                if (In != vecOut[B]) {
+                    vecOut[B] = In;
+                    Changed = true;
+                }
+            }
+        }
+        return true;
+    }
+
+    void LockDataflow::collectConflicts(std::vector<Conflict> &vecConflict) const {
+        BitVector Held(NumLocks);
+        for (unsigned B = 0; B < vecIn.size(); ++B) {
+            Held = vecIn[B];
+            for (const Event &E : vecEvents[B]) {
+                Held.reset(E.Kill);
+                BitVector Conflicting = Held;
+                Conflicting &= E.Check;
+                for (int Lock = Conflicting.find_first(); Lock != -1; Lock = Conflicting.find_next(Lock)) {
+                    Conflict C;
+                    C.Lock = Lock;
+                    C.Site = E.Site;
+                    C.GenLock = E.Gen;
+                    vecConflict.push_back(C);
+                }
+                applyEvent(E, Held);
+            }
+        }
+    }
+}
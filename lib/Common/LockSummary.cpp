@@ -0,0 +1,224 @@
+#include "Common/LockSummary.h"
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <stack>
+
+namespace detector {
+
+    const unsigned LockSummary::NoSite;
+
+    static bool compareLockSite(const LockSummary::LockSite &A, const LockSummary::LockSite &B) {
+        if (A.Bucket != B.Bucket) {
+            return A.Bucket < B.Bucket;
+        }
+        return A.Site < B.Site;
+    }
+
+    // Merge Src into Dst, keeping at most two distinct sites per bucket.
+    static void mergeLockSites(std::vector<LockSummary::LockSite> &Dst,
+                               const std::vector<LockSummary::LockSite> &Src) {
+        if (Src.empty()) {
+            return;
+        }
+        std::vector<LockSummary::LockSite> Merged;
+        Merged.reserve(Dst.size() + Src.size());
+        std::merge(Dst.begin(), Dst.end(), Src.begin(), Src.end(),
+                   std::back_inserter(Merged), compareLockSite);
+        Dst.clear();
+        for (LockSummary::LockSite &LS : Merged) {
+            if (!Dst.empty() && Dst.back().Bucket == LS.Bucket) {
+                if (Dst.back().Site == LS.Site) {
+                    continue;
+                }
+                if (Dst.size() >= 2 && Dst[Dst.size() - 2].Bucket == LS.Bucket) {
+                    continue;
+                }
+            }
+            Dst.push_back(LS);
+        }
+    }
+
+    void LockSummary::ensureFunc(unsigned Func) {
+        if (Func >= vecCallees.size()) {
+            vecCallees.resize(Func + 1);
+            vecDirectLocks.resize(Func + 1);
+        }
+    }
+
+    void LockSummary::addCall(unsigned Caller, unsigned Callee, unsigned CallSite) {
+        ensureFunc(Caller);
+        ensureFunc(Callee);
+        CallEdge Edge;
+        Edge.Callee = Callee;
+        Edge.CallSite = CallSite;
+        vecCallees[Caller].push_back(Edge);
+    }
+
+    void LockSummary::addLock(unsigned Func, unsigned Bucket, unsigned Site) {
+        ensureFunc(Func);
+        LockSite LS;
+        LS.Bucket = Bucket;
+        LS.Site = Site;
+        vecDirectLocks[Func].push_back(LS);
+    }
+
+    // Iterative Tarjan. SCCs are completed callees first,
+    // so each SCC can merge the already finished summaries of the SCCs it calls.
+    void LockSummary::build() {
+        unsigned NumFuncs = vecCallees.size();
+        const unsigned Unvisited = ~0u;
+        std::vector<unsigned> vecIndex(NumFuncs, Unvisited);
+        std::vector<unsigned> vecLowLink(NumFuncs, 0);
+        std::vector<bool> vecOnStack(NumFuncs, false);
+        std::vector<unsigned> SCCStack;
+        vecFuncSCC.assign(NumFuncs, Unvisited);
+        vecSCCLocks.clear();
+        vecSCCRecursive.clear();
+
+        for (std::vector<LockSite> &Locks : vecDirectLocks) {
+            std::sort(Locks.begin(), Locks.end(), compareLockSite);
+        }
+
+        unsigned NextIndex = 0;
+        // (Func, next edge to visit)
+        std::stack<std::pair<unsigned, unsigned>> DFSStack;
+        for (unsigned Root = 0; Root < NumFuncs; ++Root) {
+            if (vecIndex[Root] != Unvisited) {
+                continue;
+            }
+            DFSStack.push(std::make_pair(Root, 0));
+            vecIndex[Root] = vecLowLink[Root] = NextIndex++;
+            SCCStack.push_back(Root);
+            vecOnStack[Root] = true;
+            while (!DFSStack.empty()) {
+                unsigned Func = DFSStack.top().first;
+                unsigned &EdgeIdx = DFSStack.top().second;
+                if (EdgeIdx < vecCallees[Func].size()) {
+                    unsigned Callee = vecCallees[Func][EdgeIdx++].Callee;
+                    if (vecIndex[Callee] == Unvisited) {
+                        vecIndex[Callee] = vecLowLink[Callee] = NextIndex++;
+                        SCCStack.push_back(Callee);
+                        vecOnStack[Callee] = true;
+                        DFSStack.push(std::make_pair(Callee, 0));
+                    } else if (vecOnStack[Callee]) {
+                        vecLowLink[Func] = std::min(vecLowLink[Func], vecIndex[Callee]);
+                    }
+                    continue;
+                }
+                DFSStack.pop();
+                if (!DFSStack.empty()) {
+                    unsigned Parent = DFSStack.top().first;
+                    vecLowLink[Parent] = std::min(vecLowLink[Parent], vecLowLink[Func]);
+                }
+                if (vecLowLink[Func] != vecIndex[Func]) {
+                    continue;
+                }
+                unsigned SCCId = vecSCCLocks.size();
+                std::vector<unsigned> Members;
+                unsigned Member;
+                do {
+                    Member = SCCStack.back();
+                    SCCStack.pop_back();
+                    vecOnStack[Member] = false;
+                    vecFuncSCC[Member] = SCCId;
+                    Members.push_back(Member);
+                } while (Member != Func);
+
+                std::vector<LockSite> Summary;
+                for (unsigned M : Members) {
+                    mergeLockSites(Summary, vecDirectLocks[M]);
+                }
+                bool Recursive = Members.size() > 1;
+                for (unsigned M : Members) {
+                    for (CallEdge &Edge : vecCallees[M]) {
+                        unsigned CalleeSCC = vecFuncSCC[Edge.Callee];
+                        if (CalleeSCC != SCCId) {
+                            mergeLockSites(Summary, vecSCCLocks[CalleeSCC]);
+                        } else {
+                            Recursive = true;
+                        }
+                    }
+                }
+                vecSCCLocks.push_back(Summary);
+                vecSCCRecursive.push_back(Recursive);
+            }
+        }
+    }
+
+    static bool hasLockOtherThan(const std::vector<LockSummary::LockSite> &Locks,
+                                 unsigned Bucket, unsigned ExcludeSite) {
+        LockSummary::LockSite Key;
+        Key.Bucket = Bucket;
+        Key.Site = 0;
+        auto It = std::lower_bound(Locks.begin(), Locks.end(), Key, compareLockSite);
+        for (; It != Locks.end() && It->Bucket == Bucket; ++It) {
+            if (It->Site != ExcludeSite) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool LockSummary::mayAcquire(unsigned Func, unsigned Bucket, unsigned ExcludeSite) const {
+        if (Func >= vecFuncSCC.size()) {
+            return false;
+        }
+        return hasLockOtherThan(vecSCCLocks[vecFuncSCC[Func]], Bucket, ExcludeSite);
+    }
+
+    bool LockSummary::isRecursive(unsigned Func) const {
+        return Func < vecFuncSCC.size() && vecSCCRecursive[vecFuncSCC[Func]];
+    }
+
+    bool LockSummary::hasDirectLock(unsigned Func, unsigned Bucket, unsigned ExcludeSite) const {
+        return hasLockOtherThan(vecDirectLocks[Func], Bucket, ExcludeSite);
+    }
+
+    // Breadth-first through callees whose summary contains the bucket,
+    // so the chain found is a shortest one and every step is guaranteed to lead somewhere.
+    bool LockSummary::findWitness(unsigned Func, unsigned Bucket, unsigned ExcludeSite,
+                                  std::vector<unsigned> &CallChain,
+                                  unsigned &WitnessFunc,
+                                  std::vector<unsigned> &SecondLocks) const {
+        if (!mayAcquire(Func, Bucket, ExcludeSite)) {
+            return false;
+        }
+        // Func -> (Parent Func, Call Site)
+        std::map<unsigned, std::pair<unsigned, unsigned>> mapParent;
+        std::list<unsigned> WorkList;
+        WorkList.push_back(Func);
+        mapParent[Func] = std::make_pair(NoSite, NoSite);
+        while (!WorkList.empty()) {
+            unsigned Curr = WorkList.front();
+            WorkList.pop_front();
+            if (hasDirectLock(Curr, Bucket, ExcludeSite)) {
+                WitnessFunc = Curr;
+                for (const LockSite &LS : vecDirectLocks[Curr]) {
+                    if (LS.Bucket == Bucket && LS.Site != ExcludeSite) {
+                        SecondLocks.push_back(LS.Site);
+                    }
+                }
+                std::vector<unsigned> Reversed;
+                while (mapParent[Curr].first != NoSite) {
+                    Reversed.push_back(mapParent[Curr].second);
+                    Curr = mapParent[Curr].first;
+                }
+                CallChain.assign(Reversed.rbegin(), Reversed.rend());
+                return true;
+            }
+            for (const CallEdge &Edge : vecCallees[Curr]) {
+                if (mapParent.find(Edge.Callee) != mapParent.end()) {
+                    continue;
+                }
+                if (!mayAcquire(Edge.Callee, Bucket, ExcludeSite)) {
+                    continue;
+                }
+                mapParent[Edge.Callee] = std::make_pair(Curr, Edge.CallSite);
+                WorkList.push_back(Edge.Callee);
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,80 @@
+#include "Common/Options.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    cl::opt<bool> UseListDiscovery(
+            "rbd-use-list-discovery",
+            cl::desc("Discover call sites by walking the users of classified functions"),
+            cl::init(true));
+
+    cl::opt<bool> GroupEquivalentFuncs(
+            "rbd-group-equivalent",
+            cl::desc("Check one function of each class of equivalent monomorphizations and reuse it for the rest"),
+            cl::init(true));
+
+    cl::opt<unsigned> MaxIndirectTargets(
+            "rbd-max-indirect-targets",
+            cl::desc("Follow an indirect call into its vtable or signature candidates when there are at most this many (0 to stop at indirect calls)"),
+            cl::init(8));
+
+    cl::opt<unsigned> CDGClosureMaxNodes(
+            "rbd-cdg-closure-max-nodes",
+            cl::desc("Precompute which blocks influence which in the control dependence graphs of functions with at most this many blocks (0 to search on every query)"),
+            cl::init(4096));
+
+    cl::opt<unsigned> NumThreads(
+            "rbd-threads",
+            cl::desc("Number of worker threads (output is identical for any value)"),
+            cl::init(1));
+
+    cl::opt<unsigned> MaxBlocks(
+            "rbd-max-blocks",
+            cl::desc("Max basic blocks explored from one lock or function (0 for unlimited)"),
+            cl::init(0));
+
+    // Finite by default: the callee searches from some locks (LightSync::maintain_sync
+    // in ethcore-sync) otherwise run for hours.
+    cl::opt<unsigned> MaxCallees(
+            "rbd-max-callees",
+            cl::desc("Max callee functions explored from one lock or function (0 for unlimited)"),
+            cl::init(10000));
+
+    cl::opt<unsigned> LockTimeMs(
+            "rbd-lock-time-ms",
+            cl::desc("Max wall time in milliseconds spent on one lock or function (0 for unlimited)"),
+            cl::init(0));
+
+    cl::opt<unsigned> DeadlineSec(
+            "rbd-deadline-s",
+            cl::desc("Global deadline in seconds, searches after it are truncated (0 for none)"),
+            cl::init(0));
+
+    cl::opt<std::string> ReportOutput(
+            "rbd-output",
+            cl::desc("Write findings to this file instead of stderr"),
+            cl::value_desc("filename"),
+            cl::init(""));
+
+    cl::opt<ReportFormat> ReportOutputFormat(
+            "rbd-output-format",
+            cl::desc("Format of the findings (text on stderr, jsonl with -rbd-output by default)"),
+            cl::values(
+                    clEnumValN(ReportFormat::Text, "text", "Human readable text"),
+                    clEnumValN(ReportFormat::JSONLines, "jsonl", "One JSON object per finding and line"),
+                    clEnumValN(ReportFormat::SARIF, "sarif", "SARIF 2.1.0 log")),
+            cl::init(ReportFormat::Text));
+
+    cl::opt<std::string> SummaryCachePath(
+            "rbd-cache",
+            cl::desc("Reuse the summaries of unchanged functions from this file (or a file per module in this directory) and update it"),
+            cl::value_desc("path"),
+            cl::init(""));
+
+    cl::opt<std::string> SummaryDBPath(
+            "rbd-summary-db",
+            cl::desc("Read the lock facts of std, lock_api, parking_lot and other external functions from this file"),
+            cl::value_desc("filename"),
+            cl::init(""));
+}
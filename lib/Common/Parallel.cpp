@@ -0,0 +1,45 @@
+#include "Common/Parallel.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+namespace detector {
+
+    void runOrderedTasks(unsigned NumTasks, unsigned NumThreads,
+                         const std::function<void(unsigned, raw_ostream &)> &Task,
+                         raw_ostream &OS) {
+        if (NumThreads <= 1 || NumTasks <= 1) {
+            for (unsigned i = 0; i < NumTasks; ++i) {
+                Task(i, OS);
+            }
+            return;
+        }
+        if (NumThreads > NumTasks) {
+            NumThreads = NumTasks;
+        }
+
+        std::vector<std::string> vecBuffer(NumTasks);
+        std::atomic<unsigned> NextTask(0);
+        std::vector<std::thread> Workers;
+        for (unsigned t = 0; t < NumThreads; ++t) {
+            Workers.push_back(std::thread([&]() {
+                unsigned i;
+                while ((i = NextTask++) < NumTasks) {
+                    raw_string_ostream Buffer(vecBuffer[i]);
+                    Task(i, Buffer);
+                    Buffer.flush();
+                }
+            }));
+        }
+        for (std::thread &Worker : Workers) {
+            Worker.join();
+        }
+        for (std::string &Buffer : vecBuffer) {
+            OS << Buffer;
+        }
+    }
+}
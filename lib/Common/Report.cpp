@@ -0,0 +1,338 @@
+#include "Common/Report.h"
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DebugLoc.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    const char *getFindingKindName(FindingKind Kind) {
+        switch (Kind) {
+            case FindingKind::DoubleLock:
+                return "double-lock";
+        }
+        return "unknown";
+    }
+
+    static const char *getFindingMessage(FindingKind Kind) {
+        switch (Kind) {
+            case FindingKind::DoubleLock:
+                return "Lock may be acquired again while it is held";
+        }
+        return "";
+    }
+
+    ReportSite makeReportSite(const Instruction *I) {
+        ReportSite Site;
+        Site.Line = 0;
+        Site.Function = I->getFunction()->getName().str();
+        const DebugLoc &Loc = I->getDebugLoc();
+        if (Loc) {
+            Site.Directory = Loc->getDirectory().str();
+            Site.File = Loc->getFilename().str();
+            Site.Line = Loc.getLine();
+        }
+        return Site;
+    }
+
+    Finding makeDoubleLockFinding(const Instruction *FirstLock,
+                                  const std::vector<Instruction *> &vecSecondLock,
+                                  const std::vector<Instruction *> &vecCallChain) {
+        Finding F;
+        F.Kind = FindingKind::DoubleLock;
+        F.FirstLock = makeReportSite(FirstLock);
+        for (Instruction *I : vecSecondLock) {
+            F.SecondLocks.push_back(makeReportSite(I));
+        }
+        for (Instruction *I : vecCallChain) {
+            F.CallChain.push_back(makeReportSite(I));
+        }
+        return F;
+    }
+
+    void ReportCollector::add(const Finding &F) {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        vecFinding.push_back(F);
+    }
+
+    void ReportCollector::add(const std::vector<Finding> &vecNew) {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        vecFinding.insert(vecFinding.end(), vecNew.begin(), vecNew.end());
+    }
+
+    void ReportCollector::addModule(ReportCollector &Other, const ModuleRun &Run) {
+        std::vector<Finding> vecOther;
+        {
+            std::lock_guard<std::mutex> Lock(Other.Mutex);
+            vecOther.swap(Other.vecFinding);
+        }
+        std::lock_guard<std::mutex> Lock(Mutex);
+        for (Finding &F : vecOther) {
+            F.Module = Run.Module;
+            vecFinding.push_back(std::move(F));
+        }
+        vecModuleRun.push_back(Run);
+    }
+
+    unsigned ReportCollector::size() const {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        return vecFinding.size();
+    }
+
+    // Same layout as the README: the project dir, the file path and the line number.
+    static void printSiteText(const ReportSite &Site, raw_ostream &OS) {
+        if (Site.File.empty()) {
+            return;
+        }
+        OS << ' ' << Site.Directory << ' ' << Site.File << ' ' << Site.Line << '\n';
+    }
+
+    static void printFindingText(const Finding &F, raw_ostream &OS) {
+        if (!F.Module.empty()) {
+            OS << "In " << F.Module << ":\n";
+        }
+        OS << "Double Lock Happens! First Lock:\n";
+        printSiteText(F.FirstLock, OS);
+        if (!F.CallChain.empty()) {
+            if (!F.SecondLocks.empty()) {
+                OS << F.SecondLocks.front().Function << '\n';
+            }
+            printSiteText(F.CallChain.front(), OS);
+        }
+        OS << "Second Lock(s):\n";
+        for (const ReportSite &Site : F.SecondLocks) {
+            printSiteText(Site, OS);
+        }
+        if (F.CallChain.size() > 1) {
+            OS << "Call Chain:\n";
+            for (const ReportSite &Site : F.CallChain) {
+                printSiteText(Site, OS);
+            }
+        }
+        OS << '\n';
+    }
+
+    static json::Value toJSON(const ReportSite &Site) {
+        return json::Object{
+                {"directory", Site.Directory},
+                {"file", Site.File},
+                {"line", static_cast<int64_t>(Site.Line)},
+                {"function", Site.Function},
+        };
+    }
+
+    static json::Value toJSON(const std::vector<ReportSite> &vecSite) {
+        json::Array Sites;
+        for (const ReportSite &Site : vecSite) {
+            Sites.push_back(toJSON(Site));
+        }
+        return std::move(Sites);
+    }
+
+    json::Value toJSON(const Finding &F) {
+        json::Object Object{
+                {"kind", getFindingKindName(F.Kind)},
+                {"first", toJSON(F.FirstLock)},
+                {"second", toJSON(F.SecondLocks)},
+                {"callChain", toJSON(F.CallChain)},
+        };
+        if (!F.Module.empty()) {
+            Object["module"] = F.Module;
+        }
+        return std::move(Object);
+    }
+
+    static bool fromJSON(const json::Value &V, ReportSite &Site) {
+        const json::Object *Object = V.getAsObject();
+        if (!Object) {
+            return false;
+        }
+        Optional<StringRef> Directory = Object->getString("directory");
+        Optional<StringRef> File = Object->getString("file");
+        Optional<int64_t> Line = Object->getInteger("line");
+        Optional<StringRef> Function = Object->getString("function");
+        if (!Directory || !File || !Line || !Function) {
+            return false;
+        }
+        Site.Directory = Directory->str();
+        Site.File = File->str();
+        Site.Line = *Line;
+        Site.Function = Function->str();
+        return true;
+    }
+
+    static bool fromJSON(const json::Value *V, std::vector<ReportSite> &vecSite) {
+        const json::Array *Sites = V ? V->getAsArray() : nullptr;
+        if (!Sites) {
+            return false;
+        }
+        for (const json::Value &SiteValue : *Sites) {
+            ReportSite Site;
+            if (!fromJSON(SiteValue, Site)) {
+                return false;
+            }
+            vecSite.push_back(Site);
+        }
+        return true;
+    }
+
+    bool fromJSON(const json::Value &V, Finding &F) {
+        const json::Object *Object = V.getAsObject();
+        if (!Object) {
+            return false;
+        }
+        Optional<StringRef> Kind = Object->getString("kind");
+        if (!Kind || *Kind != getFindingKindName(FindingKind::DoubleLock)) {
+            return false;
+        }
+        F.Kind = FindingKind::DoubleLock;
+        const json::Value *First = Object->get("first");
+        if (!First || !fromJSON(*First, F.FirstLock)) {
+            return false;
+        }
+        if (Optional<StringRef> Module = Object->getString("module")) {
+            F.Module = Module->str();
+        }
+        return fromJSON(Object->get("second"), F.SecondLocks) && fromJSON(Object->get("callChain"), F.CallChain);
+    }
+
+    static json::Value toJSON(const ModuleRun &Run) {
+        return json::Object{
+                {"kind", "module"},
+                {"module", Run.Module},
+                {"seconds", Run.Seconds},
+                {"findings", static_cast<int64_t>(Run.NumFindings)},
+                {"failed", Run.Failed},
+        };
+    }
+
+    static json::Value toSARIFLocation(const ReportSite &Site) {
+        std::string URI = Site.File;
+        if (!Site.Directory.empty() && !Site.File.empty() && Site.File[0] != '/') {
+            URI = Site.Directory + "/" + Site.File;
+        }
+        json::Object Physical{{"artifactLocation", json::Object{{"uri", URI}}}};
+        if (Site.Line != 0) {
+            Physical["region"] = json::Object{{"startLine", static_cast<int64_t>(Site.Line)}};
+        }
+        return json::Object{
+                {"physicalLocation", std::move(Physical)},
+                {"logicalLocations", json::Array{json::Object{{"fullyQualifiedName", Site.Function}}}},
+        };
+    }
+
+    static json::Value toSARIFResult(const Finding &F) {
+        json::Array Related;
+        for (const ReportSite &Site : F.SecondLocks) {
+            Related.push_back(toSARIFLocation(Site));
+        }
+        json::Object Result{
+                {"ruleId", getFindingKindName(F.Kind)},
+                {"level", "warning"},
+                {"message", json::Object{{"text", getFindingMessage(F.Kind)}}},
+                {"locations", json::Array{toSARIFLocation(F.FirstLock)}},
+                {"relatedLocations", std::move(Related)},
+        };
+        if (!F.Module.empty()) {
+            Result["properties"] = json::Object{{"module", F.Module}};
+        }
+        if (!F.CallChain.empty()) {
+            json::Array Flow;
+            Flow.push_back(json::Object{{"location", toSARIFLocation(F.FirstLock)}});
+            for (const ReportSite &Site : F.CallChain) {
+                Flow.push_back(json::Object{{"location", toSARIFLocation(Site)}});
+            }
+            for (const ReportSite &Site : F.SecondLocks) {
+                Flow.push_back(json::Object{{"location", toSARIFLocation(Site)}});
+            }
+            Result["codeFlows"] = json::Array{
+                    json::Object{{"threadFlows", json::Array{json::Object{{"locations", std::move(Flow)}}}}}};
+        }
+        return std::move(Result);
+    }
+
+    void ReportCollector::write(ReportFormat Format, StringRef ToolName, raw_ostream &OS) const {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        switch (Format) {
+            case ReportFormat::Text:
+                for (const Finding &F : vecFinding) {
+                    printFindingText(F, OS);
+                }
+                if (!vecModuleRun.empty()) {
+                    OS << "Modules:\n";
+                }
+                for (const ModuleRun &Run : vecModuleRun) {
+                    OS << ' ' << format("%.3f", Run.Seconds) << "s " << Run.NumFindings << ' ' << Run.Module
+                       << (Run.Failed ? " failed\n" : "\n");
+                }
+                break;
+            case ReportFormat::JSONLines:
+                for (const Finding &F : vecFinding) {
+                    OS << toJSON(F) << '\n';
+                }
+                for (const ModuleRun &Run : vecModuleRun) {
+                    OS << toJSON(Run) << '\n';
+                }
+                break;
+            case ReportFormat::SARIF: {
+                json::Array Rules{json::Object{
+                        {"id", getFindingKindName(FindingKind::DoubleLock)},
+                        {"shortDescription", json::Object{{"text", getFindingMessage(FindingKind::DoubleLock)}}},
+                }};
+                json::Array Results;
+                for (const Finding &F : vecFinding) {
+                    Results.push_back(toSARIFResult(F));
+                }
+                json::Object Run{
+                        {"tool", json::Object{{"driver", json::Object{
+                                {"name", ToolName},
+                                {"rules", std::move(Rules)},
+                        }}}},
+                        {"results", std::move(Results)},
+                };
+                if (!vecModuleRun.empty()) {
+                    json::Array Modules;
+                    for (const ModuleRun &ModRun : vecModuleRun) {
+                        Modules.push_back(toJSON(ModRun));
+                    }
+                    Run["properties"] = json::Object{{"modules", std::move(Modules)}};
+                }
+                json::Object Log{
+                        {"version", "2.1.0"},
+                        {"$schema", "https://json.schemastore.org/sarif-2.1.0.json"},
+                        {"runs", json::Array{std::move(Run)}},
+                };
+                OS << json::Value(std::move(Log)) << '\n';
+                break;
+            }
+        }
+    }
+
+    bool ReportCollector::write(StringRef ToolName) {
+        ReportFormat Format = ReportOutputFormat;
+        if (ReportOutput.empty()) {
+            // errs() is unbuffered, so format everything first and write it once.
+            std::string Buffer;
+            raw_string_ostream BufferOS(Buffer);
+            write(Format, ToolName, BufferOS);
+            errs() << BufferOS.str();
+            return true;
+        }
+        if (ReportOutputFormat.getNumOccurrences() == 0) {
+            Format = ReportFormat::JSONLines;
+        }
+        std::error_code EC;
+        raw_fd_ostream OS(ReportOutput, EC, sys::fs::OF_Text);
+        if (EC) {
+            errs() << "Cannot open " << ReportOutput << ": " << EC.message() << '\n';
+            return false;
+        }
+        write(Format, ToolName, OS);
+        return true;
+    }
+}
@@ -0,0 +1,360 @@
+#include "Common/Snapshot.h"
+
+#include <cstring>
+#include <vector>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    static const char SnapshotMagic[8] = {'R', 'B', 'D', 'S', 'N', 'A', 'P', '\0'};
+
+    bool Snapshot::isSnapshotFile(StringRef Path) {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+                MemoryBuffer::getFileSlice(Path, sizeof(SnapshotMagic), 0);
+        if (!Buffer || (*Buffer)->getBufferSize() < sizeof(SnapshotMagic)) {
+            return false;
+        }
+        return std::memcmp((*Buffer)->getBufferStart(), SnapshotMagic, sizeof(SnapshotMagic)) == 0;
+    }
+
+    template <typename RecordT>
+    static bool getTable(const MemoryBuffer &Buffer, const SnapshotTableRef &Ref, ArrayRef<RecordT> &Table) {
+        uint64_t End = static_cast<uint64_t>(Ref.Offset) + static_cast<uint64_t>(Ref.Count) * sizeof(RecordT);
+        if (Ref.Offset % alignof(RecordT) != 0 || End > Buffer.getBufferSize()) {
+            return false;
+        }
+        Table = makeArrayRef(reinterpret_cast<const RecordT *>(Buffer.getBufferStart() + Ref.Offset), Ref.Count);
+        return true;
+    }
+
+    bool Snapshot::load(StringRef Path, raw_ostream &ErrOS) {
+        // Large files are mapped, not read.
+        ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path, -1, false);
+        if (!File) {
+            ErrOS << "Cannot read " << Path << ": " << File.getError().message() << '\n';
+            return false;
+        }
+        Buffer = std::move(*File);
+        if (!sys::IsLittleEndianHost || Buffer->getBufferSize() < sizeof(SnapshotHeader)) {
+            ErrOS << Path << ": not a snapshot\n";
+            return false;
+        }
+        const SnapshotHeader *Header = reinterpret_cast<const SnapshotHeader *>(Buffer->getBufferStart());
+        if (std::memcmp(Header->Magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0) {
+            ErrOS << Path << ": not a snapshot\n";
+            return false;
+        }
+        if (Header->Version != SnapshotVersion || Header->NumTables != NumSnapshotTables) {
+            ErrOS << Path << ": snapshot version " << Header->Version << ", expected "
+                  << SnapshotVersion << "; extract it again\n";
+            return false;
+        }
+        ArrayRef<char> StringBytes;
+        if (!getTable(*Buffer, Header->Tables[SnapStrings], StringBytes)
+            || !getTable(*Buffer, Header->Tables[SnapFuncs], Funcs)
+            || !getTable(*Buffer, Header->Tables[SnapBlocks], Blocks)
+            || !getTable(*Buffer, Header->Tables[SnapSuccs], Succs)
+            || !getTable(*Buffer, Header->Tables[SnapRPO], RPO)
+            || !getTable(*Buffer, Header->Tables[SnapSites], Sites)
+            || !getTable(*Buffer, Header->Tables[SnapEdges], Edges)
+            || !getTable(*Buffer, Header->Tables[SnapLocs], Locs)
+            || !getTable(*Buffer, Header->Tables[SnapTypes], Types)) {
+            ErrOS << Path << ": truncated snapshot\n";
+            return false;
+        }
+        Strings = StringRef(StringBytes.data(), StringBytes.size());
+        return validate(ErrOS);
+    }
+
+    static bool inRange(uint32_t First, uint32_t Count, size_t Size) {
+        return static_cast<uint64_t>(First) + Count <= Size;
+    }
+
+    static bool validString(StringRef Strings, uint32_t Offset) {
+        return Offset < Strings.size() && Strings.find('\0', Offset) != StringRef::npos;
+    }
+
+    bool Snapshot::validate(raw_ostream &ErrOS) const {
+        bool Valid = Strings.empty() || Strings.back() == '\0';
+        for (const SnapshotFunc &F : Funcs) {
+            Valid &= validString(Strings, F.Name);
+            Valid &= inRange(F.FirstBlock, F.NumBlocks, Blocks.size());
+            Valid &= inRange(F.FirstRPO, F.NumRPO, RPO.size());
+            if (!Valid) {
+                break;
+            }
+            for (uint32_t B : RPO.slice(F.FirstRPO, F.NumRPO)) {
+                Valid &= B < F.NumBlocks;
+            }
+            for (const SnapshotBlock &B : Blocks.slice(F.FirstBlock, F.NumBlocks)) {
+                Valid &= inRange(B.FirstSucc, B.NumSuccs, Succs.size());
+                Valid &= inRange(B.FirstSite, B.NumSites, Sites.size());
+                if (!Valid) {
+                    break;
+                }
+                for (uint32_t Succ : Succs.slice(B.FirstSucc, B.NumSuccs)) {
+                    Valid &= Succ < F.NumBlocks;
+                }
+            }
+        }
+        for (const SnapshotSite &S : Sites) {
+            Valid &= S.Func < Funcs.size() && S.Block < Funcs[S.Func].NumBlocks;
+            Valid &= S.Callee == NoSnapshotId || S.Callee < Funcs.size();
+            Valid &= !(S.Flags & (SiteCall | SiteIndirect)) || S.Callee != NoSnapshotId;
+            Valid &= S.Loc == NoSnapshotId || S.Loc < Locs.size();
+            Valid &= S.LockType == NoSnapshotId || S.LockType < Types.size();
+            Valid &= inRange(S.FirstEdge, S.NumEdges, Edges.size());
+        }
+        for (uint32_t Edge : Edges) {
+            Valid &= Edge < Sites.size();
+        }
+        for (const SnapshotLoc &L : Locs) {
+            Valid &= validString(Strings, L.Directory) && validString(Strings, L.File);
+        }
+        for (const SnapshotType &T : Types) {
+            Valid &= validString(Strings, T.Name);
+        }
+        if (!Valid) {
+            ErrOS << "Corrupt snapshot: an index is out of range\n";
+        }
+        return Valid;
+    }
+
+    StringRef Snapshot::getString(uint32_t Offset) const {
+        return StringRef(Strings.data() + Offset);
+    }
+
+    ReportSite Snapshot::makeReportSite(uint32_t Site) const {
+        const SnapshotSite &S = Sites[Site];
+        ReportSite RS;
+        RS.Line = 0;
+        RS.Function = getString(Funcs[S.Func].Name).str();
+        if (S.Loc != NoSnapshotId) {
+            RS.Directory = getString(Locs[S.Loc].Directory).str();
+            RS.File = getString(Locs[S.Loc].File).str();
+            RS.Line = Locs[S.Loc].Line;
+        }
+        return RS;
+    }
+
+    SnapshotWriter::SnapshotWriter() : Strings(1, '\0') {
+        mapString[""] = 0;
+    }
+
+    uint32_t SnapshotWriter::addString(StringRef Str) {
+        auto It = mapString.find(Str);
+        if (It != mapString.end()) {
+            return It->second;
+        }
+        uint32_t Offset = Strings.size();
+        Strings.append(Str.begin(), Str.end());
+        Strings.push_back('\0');
+        mapString[Str] = Offset;
+        return Offset;
+    }
+
+    uint32_t SnapshotWriter::addLoc(StringRef Directory, StringRef File, uint32_t Line) {
+        SnapshotLoc Loc;
+        Loc.Directory = addString(Directory);
+        Loc.File = addString(File);
+        Loc.Line = Line;
+        auto Key = std::make_tuple(Loc.Directory, Loc.File, Loc.Line);
+        auto It = mapLoc.find(Key);
+        if (It != mapLoc.end()) {
+            return It->second;
+        }
+        uint32_t Id = vecLoc.size();
+        vecLoc.push_back(Loc);
+        mapLoc[Key] = Id;
+        return Id;
+    }
+
+    namespace {
+    // Lays the tables out after the header, each at an 8-byte aligned offset.
+    class TableLayout {
+    public:
+        explicit TableLayout(SnapshotHeader &Header) : Header(Header), Size(sizeof(SnapshotHeader)) {}
+
+        void add(SnapshotTable Kind, const void *Data, size_t Count, size_t RecordSize) {
+            Size = alignTo(Size, 8);
+            Header.Tables[Kind].Offset = Size;
+            Header.Tables[Kind].Count = Count;
+            vecData.push_back(std::make_pair(Data, Count * RecordSize));
+            Size += Count * RecordSize;
+        }
+
+        void write(raw_ostream &OS) const {
+            uint64_t Pos = sizeof(SnapshotHeader);
+            OS.write(reinterpret_cast<const char *>(&Header), sizeof(SnapshotHeader));
+            for (const std::pair<const void *, size_t> &Data : vecData) {
+                uint64_t Aligned = alignTo(Pos, 8);
+                OS.write_zeros(Aligned - Pos);
+                OS.write(static_cast<const char *>(Data.first), Data.second);
+                Pos = Aligned + Data.second;
+            }
+        }
+
+        uint64_t getSize() const { return Size; }
+
+    private:
+        SnapshotHeader &Header;
+        uint64_t Size;
+        std::vector<std::pair<const void *, size_t>> vecData;
+    };
+    }  // namespace
+
+    template <typename RecordT>
+    static void addTable(TableLayout &Layout, SnapshotTable Kind, const std::vector<RecordT> &Table) {
+        Layout.add(Kind, Table.data(), Table.size(), sizeof(RecordT));
+    }
+
+    bool SnapshotWriter::write(StringRef Path, raw_ostream &ErrOS) const {
+        SnapshotHeader Header;
+        std::memset(&Header, 0, sizeof(Header));
+        std::memcpy(Header.Magic, SnapshotMagic, sizeof(SnapshotMagic));
+        Header.Version = SnapshotVersion;
+        Header.NumTables = NumSnapshotTables;
+
+        TableLayout Layout(Header);
+        Layout.add(SnapStrings, Strings.data(), Strings.size(), 1);
+        addTable(Layout, SnapFuncs, vecFunc);
+        addTable(Layout, SnapBlocks, vecBlock);
+        addTable(Layout, SnapSuccs, vecSucc);
+        addTable(Layout, SnapRPO, vecRPO);
+        addTable(Layout, SnapSites, vecSite);
+        addTable(Layout, SnapEdges, vecEdge);
+        addTable(Layout, SnapLocs, vecLoc);
+        addTable(Layout, SnapTypes, vecType);
+        if (Layout.getSize() > UINT32_MAX) {
+            ErrOS << "Cannot write " << Path << ": the snapshot exceeds 4 GiB\n";
+            return false;
+        }
+
+        std::error_code EC;
+        raw_fd_ostream OS(Path, EC, sys::fs::OF_None);
+        if (EC) {
+            ErrOS << "Cannot open " << Path << ": " << EC.message() << '\n';
+            return false;
+        }
+        Layout.write(OS);
+        return true;
+    }
+
+    void mergeSnapshots(ArrayRef<const Snapshot *> vecSnapshot, SnapshotWriter &Writer) {
+        // Function and type ids of every input in the merged tables.
+        StringMap<uint32_t> mapFuncId;
+        std::vector<std::vector<uint32_t>> vecFuncMap(vecSnapshot.size());
+        std::vector<uint32_t> vecBodyOwner;  // per merged function, the input with its blocks
+        for (unsigned In = 0; In < vecSnapshot.size(); ++In) {
+            const Snapshot &S = *vecSnapshot[In];
+            for (const SnapshotFunc &F : S.funcs()) {
+                auto itFunc = mapFuncId.insert(std::make_pair(S.getString(F.Name), Writer.vecFunc.size()));
+                if (itFunc.second) {
+                    SnapshotFunc MF;
+                    MF.Name = Writer.addString(S.getString(F.Name));
+                    MF.Flags = 0;
+                    MF.FirstBlock = 0;
+                    MF.NumBlocks = 0;
+                    MF.FirstRPO = 0;
+                    MF.NumRPO = 0;
+                    Writer.vecFunc.push_back(MF);
+                    vecBodyOwner.push_back(NoSnapshotId);
+                }
+                uint32_t Func = itFunc.first->second;
+                Writer.vecFunc[Func].Flags |= F.Flags;
+                if (F.NumBlocks != 0 && vecBodyOwner[Func] == NoSnapshotId) {
+                    vecBodyOwner[Func] = In;
+                }
+                vecFuncMap[In].push_back(Func);
+            }
+        }
+        StringMap<uint32_t> mapTypeId;
+        std::vector<std::vector<uint32_t>> vecTypeMap(vecSnapshot.size());
+        for (unsigned In = 0; In < vecSnapshot.size(); ++In) {
+            const Snapshot &S = *vecSnapshot[In];
+            for (const SnapshotType &T : S.types()) {
+                auto itType = mapTypeId.insert(std::make_pair(S.getString(T.Name), Writer.vecType.size()));
+                if (itType.second) {
+                    SnapshotType MT;
+                    MT.Name = Writer.addString(S.getString(T.Name));
+                    Writer.vecType.push_back(MT);
+                }
+                vecTypeMap[In].push_back(itType.first->second);
+            }
+        }
+
+        // Bodies in merged function order; edges are renumbered once every site is placed.
+        std::vector<std::vector<uint32_t>> vecSiteMap(vecSnapshot.size());
+        for (unsigned In = 0; In < vecSnapshot.size(); ++In) {
+            vecSiteMap[In].assign(vecSnapshot[In]->sites().size(), NoSnapshotId);
+        }
+        std::vector<std::pair<unsigned, uint32_t>> vecMergedSite;  // input and its site id
+        std::vector<uint32_t> vecInFunc(Writer.vecFunc.size(), NoSnapshotId);
+        for (unsigned In = 0; In < vecSnapshot.size(); ++In) {
+            for (uint32_t Func = 0; Func < vecFuncMap[In].size(); ++Func) {
+                if (vecBodyOwner[vecFuncMap[In][Func]] == In) {
+                    vecInFunc[vecFuncMap[In][Func]] = Func;
+                }
+            }
+        }
+        for (uint32_t Func = 0; Func < Writer.vecFunc.size(); ++Func) {
+            if (vecBodyOwner[Func] == NoSnapshotId) {
+                continue;
+            }
+            unsigned In = vecBodyOwner[Func];
+            const Snapshot &S = *vecSnapshot[In];
+            const SnapshotFunc &F = S.funcs()[vecInFunc[Func]];
+            SnapshotFunc &MF = Writer.vecFunc[Func];
+            MF.FirstBlock = Writer.vecBlock.size();
+            MF.NumBlocks = F.NumBlocks;
+            for (const SnapshotBlock &B : S.blocksOf(F)) {
+                SnapshotBlock MB;
+                MB.FirstSucc = Writer.vecSucc.size();
+                MB.NumSuccs = B.NumSuccs;
+                ArrayRef<uint32_t> Succs = S.succsOf(B);
+                Writer.vecSucc.insert(Writer.vecSucc.end(), Succs.begin(), Succs.end());
+                MB.FirstSite = Writer.vecSite.size();
+                MB.NumSites = B.NumSites;
+                for (uint32_t Site = B.FirstSite; Site < B.FirstSite + B.NumSites; ++Site) {
+                    SnapshotSite MS = S.sites()[Site];
+                    MS.Func = Func;
+                    if (MS.Callee != NoSnapshotId) {
+                        MS.Callee = vecFuncMap[In][MS.Callee];
+                    }
+                    if (MS.Loc != NoSnapshotId) {
+                        const SnapshotLoc &L = S.locs()[MS.Loc];
+                        MS.Loc = Writer.addLoc(S.getString(L.Directory), S.getString(L.File), L.Line);
+                    }
+                    if (MS.LockType != NoSnapshotId) {
+                        MS.LockType = vecTypeMap[In][MS.LockType];
+                    }
+                    vecSiteMap[In][Site] = Writer.vecSite.size();
+                    vecMergedSite.push_back(std::make_pair(In, Site));
+                    Writer.vecSite.push_back(MS);
+                }
+                Writer.vecBlock.push_back(MB);
+            }
+            MF.FirstRPO = Writer.vecRPO.size();
+            MF.NumRPO = F.NumRPO;
+            ArrayRef<uint32_t> RPO = S.rpoOf(F);
+            Writer.vecRPO.insert(Writer.vecRPO.end(), RPO.begin(), RPO.end());
+        }
+        for (uint32_t Site = 0; Site < Writer.vecSite.size(); ++Site) {
+            const Snapshot &S = *vecSnapshot[vecMergedSite[Site].first];
+            SnapshotSite &MS = Writer.vecSite[Site];
+            MS.FirstEdge = Writer.vecEdge.size();
+            for (uint32_t Edge : S.edgesOf(S.sites()[vecMergedSite[Site].second])) {
+                uint32_t MergedEdge = vecSiteMap[vecMergedSite[Site].first][Edge];
+                if (MergedEdge != NoSnapshotId) {
+                    Writer.vecEdge.push_back(MergedEdge);
+                }
+            }
+            MS.NumEdges = Writer.vecEdge.size() - MS.FirstEdge;
+        }
+    }
+}
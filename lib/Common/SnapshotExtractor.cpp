@@ -0,0 +1,240 @@
+#include "Common/SnapshotExtractor.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DebugLoc.h"
+#include "llvm/IR/Instructions.h"
+
+#include "Common/GuardLifetime.h"
+#include "Common/IndirectCallIndex.h"
+#include "Common/LockAPI.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    static unsigned getSiteFlags(StringRef Name) {
+        unsigned Flags = SiteCall;
+        if (isLockAPIName(Name)) {
+            Flags |= SiteLock;
+        }
+        if (Name.find("drop_in_place") != StringRef::npos || Name.startswith("_ZN4core3mem4drop17h")) {
+            Flags |= SiteDrop;
+        }
+        if (Name.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6unwrap")
+            || Name.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6expect")) {
+            Flags |= SiteUnwrap;
+        }
+        if (Name.startswith("_ZN4core4cell")) {
+            Flags |= SiteCell;
+        }
+        if (Name.startswith("_ZN4core4sync6atomic")) {
+            Flags |= SiteAtomic;
+        }
+        return Flags;
+    }
+
+    // The lock result and the locked value, as parseLockInst in NewDoubleLockDetector:
+    // std::sync::Mutex::lock returns its LockResult through the first argument.
+    static bool parseLockInst(CallSite CS, Value *&ReturnValue, Value *&LockValue) {
+        if (CS.getCalledFunction()->getReturnType()->isVoidTy()) {
+            if (CS.getNumArgOperands() < 2) {
+                return false;
+            }
+            ReturnValue = CS.getArgOperand(0);
+            LockValue = CS.getArgOperand(1);
+            return true;
+        }
+        if (CS.getNumArgOperands() < 1) {
+            return false;
+        }
+        ReturnValue = CS.getInstruction();
+        LockValue = CS.getArgOperand(0);
+        return true;
+    }
+
+    static Function *getDirectCallee(Instruction &I) {
+        if (!isa<CallInst>(I) && !isa<InvokeInst>(I)) {
+            return nullptr;
+        }
+        return CallSite(&I).getCalledFunction();
+    }
+
+    static uint32_t getLocId(Instruction &I, SnapshotWriter &Writer) {
+        if (const DebugLoc &Loc = I.getDebugLoc()) {
+            return Writer.addLoc(Loc->getDirectory(), Loc->getFilename(), Loc.getLine());
+        }
+        return NoSnapshotId;
+    }
+
+    // One site per candidate callee of indirect call I, in the order of the index.
+    static void addIndirectSites(Instruction &I, uint32_t Block, std::map<Function *, uint32_t> &mapFuncId,
+                                 const IndirectCallIndex &Indirect, SnapshotWriter &Writer,
+                                 std::vector<Instruction *> &vecSiteInst) {
+        for (Function *Target : Indirect.getTargets(&I)) {
+            SnapshotSite Site;
+            Site.Func = mapFuncId[I.getFunction()];
+            Site.Block = Block;
+            Site.Flags = SiteIndirect;
+            Site.Callee = mapFuncId[Target];
+            Site.Loc = getLocId(I, Writer);
+            Site.LockType = NoSnapshotId;
+            Site.FirstEdge = 0;
+            Site.NumEdges = 0;
+            vecSiteInst.push_back(&I);
+            Writer.vecSite.push_back(Site);
+        }
+    }
+
+    namespace {
+    struct LockFacts {
+        Type *LockType;
+        std::set<Instruction *> setDropInst;
+    };
+    }  // namespace
+
+    void extractSnapshot(Module &M, SnapshotWriter &Writer) {
+        std::map<Function *, uint32_t> mapFuncId;
+        for (Function &F : M) {
+            mapFuncId[&F] = Writer.vecFunc.size();
+            SnapshotFunc SF;
+            SF.Name = Writer.addString(F.getName());
+            SF.Flags = F.isDeclaration() ? 0 : FuncDefined;
+            SF.FirstBlock = 0;
+            SF.NumBlocks = 0;
+            SF.FirstRPO = 0;
+            SF.NumRPO = 0;
+            Writer.vecFunc.push_back(SF);
+        }
+
+        // Lock guards first, so that every drop they reach becomes a site.
+        GuardLifetime GL(M.getDataLayout());
+        std::map<Instruction *, LockFacts> mapLock;
+        std::set<Instruction *> setDropInst;
+        for (Function &F : M) {
+            for (BasicBlock &BB : F) {
+                for (Instruction &I : BB) {
+                    Function *Callee = getDirectCallee(I);
+                    if (!Callee || !isLockAPIName(Callee->getName())) {
+                        continue;
+                    }
+                    Value *ReturnValue = nullptr;
+                    Value *LockValue = nullptr;
+                    if (!parseLockInst(CallSite(&I), ReturnValue, LockValue)) {
+                        continue;
+                    }
+                    Instruction *RI = dyn_cast<Instruction>(ReturnValue);
+                    if (!RI) {
+                        continue;
+                    }
+                    LockFacts &Facts = mapLock[&I];
+                    Facts.LockType = LockValue->getType();
+                    // std::sync locks return the guard wrapped in a LockResult.
+                    bool Wrapped = Callee->getName().startswith("_ZN3std4sync");
+                    GL.collectDestInsts(RI, Wrapped, GuardLifetime::AutoDrop | GuardLifetime::ManualDrop,
+                                        Facts.setDropInst);
+                    setDropInst.insert(Facts.setDropInst.begin(), Facts.setDropInst.end());
+                }
+            }
+        }
+
+        IndirectCallIndex Indirect(M);
+        std::map<Type *, uint32_t> mapTypeId;
+        std::map<Instruction *, uint32_t> mapSiteId;
+        std::vector<Instruction *> vecSiteInst;
+        for (Function &F : M) {
+            // Bodies left unmaterialized by a shard are extracted by another one.
+            if (F.isDeclaration() || F.empty()) {
+                continue;
+            }
+            SnapshotFunc &SF = Writer.vecFunc[mapFuncId[&F]];
+            SF.FirstBlock = Writer.vecBlock.size();
+            std::map<BasicBlock *, uint32_t> mapBlockId;
+            uint32_t NumBlocks = 0;
+            for (BasicBlock &BB : F) {
+                mapBlockId[&BB] = NumBlocks++;
+            }
+            for (BasicBlock &BB : F) {
+                SnapshotBlock SB;
+                SB.FirstSucc = Writer.vecSucc.size();
+                for (BasicBlock *Succ : successors(&BB)) {
+                    Writer.vecSucc.push_back(mapBlockId[Succ]);
+                }
+                SB.NumSuccs = Writer.vecSucc.size() - SB.FirstSucc;
+                SB.FirstSite = Writer.vecSite.size();
+                for (Instruction &I : BB) {
+                    Function *Callee = getDirectCallee(I);
+                    if (!Callee) {
+                        addIndirectSites(I, mapBlockId[&BB], mapFuncId, Indirect, Writer, vecSiteInst);
+                    }
+                    if (!Callee && setDropInst.find(&I) == setDropInst.end()) {
+                        continue;
+                    }
+                    SnapshotSite Site;
+                    Site.Func = mapFuncId[&F];
+                    Site.Block = mapBlockId[&BB];
+                    Site.Flags = Callee ? getSiteFlags(Callee->getName()) : 0;
+                    Site.Callee = Callee ? mapFuncId[Callee] : NoSnapshotId;
+                    Site.Loc = getLocId(I, Writer);
+                    Site.LockType = NoSnapshotId;
+                    auto itLock = mapLock.find(&I);
+                    if (itLock != mapLock.end()) {
+                        auto itType = mapTypeId.find(itLock->second.LockType);
+                        if (itType == mapTypeId.end()) {
+                            std::string Name;
+                            raw_string_ostream OS(Name);
+                            itLock->second.LockType->print(OS);
+                            SnapshotType ST;
+                            ST.Name = Writer.addString(OS.str());
+                            itType = mapTypeId.insert(std::make_pair(itLock->second.LockType,
+                                                                     Writer.vecType.size())).first;
+                            Writer.vecType.push_back(ST);
+                        }
+                        Site.LockType = itType->second;
+                    }
+                    Site.FirstEdge = 0;
+                    Site.NumEdges = 0;
+                    mapSiteId[&I] = Writer.vecSite.size();
+                    vecSiteInst.push_back(&I);
+                    Writer.vecSite.push_back(Site);
+                }
+                SB.NumSites = Writer.vecSite.size() - SB.FirstSite;
+                Writer.vecBlock.push_back(SB);
+            }
+            SF.NumBlocks = Writer.vecBlock.size() - SF.FirstBlock;
+            SF.FirstRPO = Writer.vecRPO.size();
+            ReversePostOrderTraversal<Function *> RPOT(&F);
+            for (BasicBlock *BB : RPOT) {
+                Writer.vecRPO.push_back(mapBlockId[BB]);
+            }
+            SF.NumRPO = Writer.vecRPO.size() - SF.FirstRPO;
+        }
+
+        // Guard drop edges, in site order so the file is the same in every run.
+        for (uint32_t LockSite = 0; LockSite < vecSiteInst.size(); ++LockSite) {
+            auto itLock = mapLock.find(vecSiteInst[LockSite]);
+            if (itLock == mapLock.end()) {
+                continue;
+            }
+            std::vector<uint32_t> vecDrop;
+            for (Instruction *DropInst : itLock->second.setDropInst) {
+                auto itSite = mapSiteId.find(DropInst);
+                if (itSite != mapSiteId.end()) {
+                    vecDrop.push_back(itSite->second);
+                }
+            }
+            std::sort(vecDrop.begin(), vecDrop.end());
+            SnapshotSite &Site = Writer.vecSite[LockSite];
+            Site.FirstEdge = Writer.vecEdge.size();
+            Site.NumEdges = vecDrop.size();
+            Writer.vecEdge.insert(Writer.vecEdge.end(), vecDrop.begin(), vecDrop.end());
+        }
+    }
+}
@@ -0,0 +1,355 @@
+#include "Common/SummaryCache.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include "Common/Options.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    // Bumped whenever the hash or the stored facts change meaning.
+    static const int64_t CacheVersion = 2;
+
+    std::string getSummaryCacheFile(const Module &M) {
+        if (SummaryCachePath.empty() || !sys::fs::is_directory(SummaryCachePath)) {
+            return SummaryCachePath;
+        }
+        SmallString<128> Path(SummaryCachePath);
+        sys::path::append(Path, sys::path::filename(M.getModuleIdentifier()) + ".rbd-cache");
+        return Path.str().str();
+    }
+
+    std::string getStableFuncName(StringRef Name) {
+        // _ZN...17h0123456789abcdefE
+        const size_t HashLen = 3 + 16 + 1;
+        if (Name.size() <= HashLen || !Name.endswith("E")) {
+            return Name.str();
+        }
+        StringRef Hash = Name.substr(Name.size() - HashLen, HashLen);
+        if (!Hash.startswith("17h")) {
+            return Name.str();
+        }
+        for (char C : Hash.substr(3, 16)) {
+            if (!isHexDigit(C)) {
+                return Name.str();
+            }
+        }
+        return (Name.drop_back(HashLen) + "E").str();
+    }
+
+    namespace {
+    // Feeds the structure of one function into an MD5.
+    class FunctionHasher {
+    public:
+        explicit FunctionHasher(const Function &F) {
+            for (const Argument &Arg : F.args()) {
+                addLocal(&Arg);
+            }
+            for (const BasicBlock &BB : F) {
+                addLocal(&BB);
+                for (const Instruction &I : BB) {
+                    addLocal(&I);
+                }
+            }
+        }
+
+        uint64_t hash(const Function &F) {
+            addString(getStableFuncName(F.getName()));
+            addType(F.getFunctionType());
+            for (const BasicBlock &BB : F) {
+                addInt(BB.size());
+                for (const Instruction &I : BB) {
+                    addInst(I);
+                }
+            }
+            MD5::MD5Result Result;
+            Hash.final(Result);
+            return Result.low();
+        }
+
+    private:
+        void addLocal(const Value *V) {
+            unsigned Id = mapLocal.size();
+            mapLocal[V] = Id;
+        }
+
+        void addInt(uint64_t V) {
+            uint8_t Bytes[8];
+            for (unsigned i = 0; i < 8; ++i) {
+                Bytes[i] = static_cast<uint8_t>(V >> (8 * i));
+            }
+            Hash.update(makeArrayRef(Bytes));
+        }
+
+        void addString(StringRef S) {
+            addInt(S.size());
+            Hash.update(S);
+        }
+
+        void addAPInt(const APInt &Val) {
+            addInt(Val.getBitWidth());
+            for (unsigned i = 0; i < Val.getNumWords(); ++i) {
+                addInt(Val.getRawData()[i]);
+            }
+        }
+
+        void addType(Type *Ty) {
+            auto it = mapTypeName.find(Ty);
+            if (it == mapTypeName.end()) {
+                std::string Name;
+                raw_string_ostream OS(Name);
+                Ty->print(OS);
+                it = mapTypeName.insert(std::make_pair(Ty, OS.str())).first;
+            }
+            addString(it->second);
+        }
+
+        void addValue(const Value *V) {
+            auto itLocal = mapLocal.find(V);
+            if (itLocal != mapLocal.end()) {
+                addInt('L');
+                addInt(itLocal->second);
+                return;
+            }
+            addInt(V->getValueID());
+            addType(V->getType());
+            if (const GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
+                // Private constants are renumbered between builds, so only their contents count.
+                const GlobalVariable *GVar = dyn_cast<GlobalVariable>(GV);
+                if (GVar && GVar->hasLocalLinkage()) {
+                    if (GVar->hasInitializer()) {
+                        if (const ConstantDataSequential *Data =
+                                dyn_cast<ConstantDataSequential>(GVar->getInitializer())) {
+                            addString(Data->getRawDataValues());
+                        }
+                    }
+                    return;
+                }
+                addString(getStableFuncName(GV->getName()));
+            } else if (const ConstantInt *CI = dyn_cast<ConstantInt>(V)) {
+                addAPInt(CI->getValue());
+            } else if (const ConstantFP *CFP = dyn_cast<ConstantFP>(V)) {
+                addAPInt(CFP->getValueAPF().bitcastToAPInt());
+            } else if (const ConstantDataSequential *Data = dyn_cast<ConstantDataSequential>(V)) {
+                addString(Data->getRawDataValues());
+            } else if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(V)) {
+                addInt(CE->getOpcode());
+                for (const Value *Op : CE->operands()) {
+                    addValue(Op);
+                }
+            } else if (const Constant *C = dyn_cast<Constant>(V)) {
+                for (const Value *Op : C->operands()) {
+                    addValue(Op);
+                }
+            } else if (const InlineAsm *Asm = dyn_cast<InlineAsm>(V)) {
+                addString(Asm->getAsmString());
+                addString(Asm->getConstraintString());
+            }
+            // Metadata operands of debug intrinsics only count by kind.
+        }
+
+        void addInst(const Instruction &I) {
+            addInt(I.getOpcode());
+            addType(I.getType());
+            addInt(I.getRawSubclassOptionalData());
+            if (const CmpInst *Cmp = dyn_cast<CmpInst>(&I)) {
+                addInt(Cmp->getPredicate());
+            } else if (const AllocaInst *Alloca = dyn_cast<AllocaInst>(&I)) {
+                addType(Alloca->getAllocatedType());
+            } else if (const GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(&I)) {
+                addType(GEP->getSourceElementType());
+            }
+            addInt(I.getNumOperands());
+            for (const Value *Op : I.operands()) {
+                addValue(Op);
+            }
+            // The reports quote the debug locations.
+            const DebugLoc &Loc = I.getDebugLoc();
+            if (Loc) {
+                addInt(Loc.getLine());
+                addInt(Loc.getCol());
+                addString(Loc->getDirectory());
+                addString(Loc->getFilename());
+            } else {
+                addInt(0);
+            }
+        }
+
+        MD5 Hash;
+        DenseMap<const Value *, unsigned> mapLocal;
+        DenseMap<Type *, std::string> mapTypeName;
+    };
+    }  // namespace
+
+    uint64_t hashFunction(const Function &F) {
+        FunctionHasher Hasher(F);
+        return Hasher.hash(F);
+    }
+
+    uint64_t combineHashes(std::vector<uint64_t> vecHash) {
+        std::sort(vecHash.begin(), vecHash.end());
+        vecHash.erase(std::unique(vecHash.begin(), vecHash.end()), vecHash.end());
+        MD5 Hash;
+        for (uint64_t H : vecHash) {
+            Hash.update(utohexstr(H));
+            Hash.update(",");
+        }
+        MD5::MD5Result Result;
+        Hash.final(Result);
+        return Result.low();
+    }
+
+    void numberInstructions(Function &F, std::vector<Instruction *> &vecInst) {
+        for (BasicBlock &BB : F) {
+            for (Instruction &I : BB) {
+                vecInst.push_back(&I);
+            }
+        }
+    }
+
+    static json::Value toJSON(const FuncSummary &Summary) {
+        json::Array LockDrops;
+        for (const std::pair<unsigned, std::vector<unsigned>> &LockDrop : Summary.vecLockDrop) {
+            json::Array Drops;
+            for (unsigned Drop : LockDrop.second) {
+                Drops.push_back(static_cast<int64_t>(Drop));
+            }
+            LockDrops.push_back(json::Array{static_cast<int64_t>(LockDrop.first), std::move(Drops)});
+        }
+        json::Array Findings;
+        for (const Finding &F : Summary.vecFinding) {
+            Findings.push_back(toJSON(F));
+        }
+        return json::Object{
+                {"hash", utohexstr(Summary.Hash)},
+                {"deepHash", utohexstr(Summary.DeepHash)},
+                {"lockDrops", std::move(LockDrops)},
+                {"complete", Summary.Complete},
+                {"findings", std::move(Findings)},
+        };
+    }
+
+    static bool fromJSON(const json::Value *V, uint64_t &Hash) {
+        Optional<StringRef> Hex = V ? V->getAsString() : None;
+        return Hex && !Hex->getAsInteger(16, Hash);
+    }
+
+    static bool fromJSON(const json::Value &V, FuncSummary &Summary) {
+        const json::Object *Object = V.getAsObject();
+        if (!Object || !fromJSON(Object->get("hash"), Summary.Hash)
+            || !fromJSON(Object->get("deepHash"), Summary.DeepHash)) {
+            return false;
+        }
+        Optional<bool> Complete = Object->getBoolean("complete");
+        const json::Array *LockDrops = Object->getArray("lockDrops");
+        const json::Array *Findings = Object->getArray("findings");
+        if (!Complete || !LockDrops || !Findings) {
+            return false;
+        }
+        Summary.Complete = *Complete;
+        for (const json::Value &LockDropValue : *LockDrops) {
+            const json::Array *LockDrop = LockDropValue.getAsArray();
+            if (!LockDrop || LockDrop->size() != 2) {
+                return false;
+            }
+            Optional<int64_t> Lock = (*LockDrop)[0].getAsInteger();
+            const json::Array *Drops = (*LockDrop)[1].getAsArray();
+            if (!Lock || !Drops) {
+                return false;
+            }
+            std::vector<unsigned> vecDrop;
+            for (const json::Value &DropValue : *Drops) {
+                Optional<int64_t> Drop = DropValue.getAsInteger();
+                if (!Drop) {
+                    return false;
+                }
+                vecDrop.push_back(*Drop);
+            }
+            Summary.vecLockDrop.push_back(std::make_pair(static_cast<unsigned>(*Lock), vecDrop));
+        }
+        for (const json::Value &FindingValue : *Findings) {
+            Finding F;
+            if (!fromJSON(FindingValue, F)) {
+                return false;
+            }
+            Summary.vecFinding.push_back(F);
+        }
+        return true;
+    }
+
+    bool SummaryCache::load(StringRef Path, raw_ostream &ErrOS) {
+        mapSummary.clear();
+        ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(Path);
+        if (!Buffer) {
+            if (Buffer.getError() == std::errc::no_such_file_or_directory) {
+                return true;
+            }
+            ErrOS << "Cannot read " << Path << ": " << Buffer.getError().message() << '\n';
+            return false;
+        }
+        SmallVector<StringRef, 0> vecLine;
+        (*Buffer)->getBuffer().split(vecLine, '\n', -1, false);
+        for (unsigned Line = 0; Line < vecLine.size(); ++Line) {
+            Expected<json::Value> V = json::parse(vecLine[Line]);
+            if (!V) {
+                ErrOS << Path << ':' << Line + 1 << ": " << toString(V.takeError()) << '\n';
+                mapSummary.clear();
+                return false;
+            }
+            if (Line == 0) {
+                const json::Object *Header = V->getAsObject();
+                Optional<int64_t> Version = Header ? Header->getInteger("version") : None;
+                Optional<StringRef> Facts = Header ? Header->getString("facts") : None;
+                if (!Version || *Version != CacheVersion || !Facts || *Facts != utohexstr(FactsHash)) {
+                    return true;
+                }
+                continue;
+            }
+            FuncSummary Summary;
+            if (!fromJSON(*V, Summary)) {
+                ErrOS << Path << ':' << Line + 1 << ": not a function summary\n";
+                mapSummary.clear();
+                return false;
+            }
+            mapSummary[Summary.Hash] = Summary;
+        }
+        return true;
+    }
+
+    bool SummaryCache::save(StringRef Path, raw_ostream &ErrOS) const {
+        std::error_code EC;
+        raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+        if (EC) {
+            ErrOS << "Cannot open " << Path << ": " << EC.message() << '\n';
+            return false;
+        }
+        OS << json::Value(json::Object{{"version", CacheVersion}, {"facts", utohexstr(FactsHash)}}) << '\n';
+        for (const std::pair<const uint64_t, FuncSummary> &HashSummary : mapSummary) {
+            OS << toJSON(HashSummary.second) << '\n';
+        }
+        return true;
+    }
+
+    const FuncSummary *SummaryCache::lookup(uint64_t Hash) const {
+        auto it = mapSummary.find(Hash);
+        return it != mapSummary.end() ? &it->second : nullptr;
+    }
+
+    void SummaryCache::insert(const FuncSummary &Summary) {
+        mapSummary[Summary.Hash] = Summary;
+    }
+}
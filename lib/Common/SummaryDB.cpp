@@ -0,0 +1,239 @@
+#include "Common/SummaryDB.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include "Common/CallerFunc.h"
+#include "Common/GuardLifetime.h"
+#include "Common/LockAPI.h"
+#include "Common/Options.h"
+#include "Common/SummaryCache.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    static const char *FactNames[] = {"may-lock", "never-locks", "drops-arg"};
+
+    static const unsigned NumFacts = sizeof(FactNames) / sizeof(FactNames[0]);
+
+    bool SummaryDB::load(StringRef Path, raw_ostream &ErrOS) {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(Path);
+        if (!Buffer) {
+            ErrOS << "rbd: " << Path << ": " << Buffer.getError().message() << '\n';
+            return false;
+        }
+        // The facts join this database only once the whole file has been read.
+        SummaryDB Loaded;
+        SmallVector<StringRef, 0> vecLine;
+        (*Buffer)->getBuffer().split(vecLine, '\n');
+        for (unsigned Line = 0; Line < vecLine.size(); ++Line) {
+            StringRef Text = vecLine[Line].trim();
+            if (Text.empty() || Text.startswith("#")) {
+                continue;
+            }
+            std::pair<StringRef, StringRef> FactName = Text.split(' ');
+            unsigned Fact = 0;
+            while (Fact < NumFacts && FactName.first != FactNames[Fact]) {
+                ++Fact;
+            }
+            StringRef Name = FactName.second.trim();
+            if (Fact == NumFacts || Name.empty()) {
+                ErrOS << "rbd: " << Path << ':' << Line + 1 << ": expected \"<fact> <name>\"\n";
+                return false;
+            }
+            Loaded.addFacts(Name, 1u << Fact);
+        }
+        for (const StringMapEntry<unsigned> &Entry : Loaded.mapFacts) {
+            addFacts(Entry.getKey(), Entry.getValue());
+        }
+        return true;
+    }
+
+    uint64_t SummaryDB::hash() const {
+        if (mapFacts.empty()) {
+            return 0;
+        }
+        std::vector<StringRef> vecName;
+        for (const StringMapEntry<unsigned> &Entry : mapFacts) {
+            vecName.push_back(Entry.getKey());
+        }
+        std::sort(vecName.begin(), vecName.end());
+        MD5 Hash;
+        for (StringRef Name : vecName) {
+            Hash.update(Name);
+            Hash.update(" ");
+            Hash.update(utostr(mapFacts.lookup(Name)));
+            Hash.update("\n");
+        }
+        MD5::MD5Result Result;
+        Hash.final(Result);
+        return Result.low();
+    }
+
+    bool SummaryDB::save(StringRef Path, raw_ostream &ErrOS) const {
+        std::error_code EC;
+        raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+        if (EC) {
+            ErrOS << "rbd: " << Path << ": " << EC.message() << '\n';
+            return false;
+        }
+        std::vector<StringRef> vecName;
+        for (const StringMapEntry<unsigned> &Entry : mapFacts) {
+            vecName.push_back(Entry.getKey());
+        }
+        std::sort(vecName.begin(), vecName.end());
+        OS << "# rbd summary database: <fact> <name without its 17h...E hash>\n";
+        for (StringRef Name : vecName) {
+            unsigned Facts = mapFacts.lookup(Name);
+            for (unsigned Fact = 0; Fact < NumFacts; ++Fact) {
+                if (Facts & (1u << Fact)) {
+                    OS << FactNames[Fact] << ' ' << Name << '\n';
+                }
+            }
+        }
+        return true;
+    }
+
+    void SummaryDB::addFacts(StringRef StableName, unsigned Facts) {
+        unsigned &Known = mapFacts[StableName];
+        Known |= Facts;
+        if (Known & SummaryMayLock) {
+            Known &= ~SummaryNeverLocks;
+        }
+    }
+
+    unsigned SummaryDB::lookup(StringRef Name) const {
+        return mapFacts.lookup(getStableFuncName(Name));
+    }
+
+    // Same test as isLocalCrateInst in the detectors: library code has no directory.
+    static bool isLocalCrateFunc(const Function &F) {
+        const DISubprogram *SP = F.getSubprogram();
+        return SP && !SP->getDirectory().empty();
+    }
+
+    bool SummaryDB::stopsAt(const Function &F) const {
+        if (mapFacts.empty() || !(lookup(F.getName()) & SummaryNeverLocks)) {
+            return false;
+        }
+        // The fact covers every monomorphization of F, so check what this one reaches:
+        // drop_in_place of a local type calls its Drop impl a few calls down.
+        std::set<const Function *> Visited;
+        std::vector<const Function *> WorkList;
+        Visited.insert(&F);
+        WorkList.push_back(&F);
+        while (!WorkList.empty()) {
+            const Function *Curr = WorkList.back();
+            WorkList.pop_back();
+            for (const Instruction &I : instructions(*Curr)) {
+                ImmutableCallSite CS(&I);
+                if (!CS) {
+                    continue;
+                }
+                const Function *Callee = CS.getCalledFunction();
+                if (!Callee) {
+                    // Same as buildSummaryDB: a call through a pointer may lock.
+                    if (!isa<InlineAsm>(CS.getCalledValue())) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (isLocalCrateFunc(*Callee) || isLockAPIName(Callee->getName())) {
+                    return false;
+                }
+                if (!Callee->isDeclaration() && Visited.insert(Callee).second) {
+                    WorkList.push_back(Callee);
+                }
+            }
+        }
+        return true;
+    }
+
+    static SummaryDB loadOptionSummaryDB() {
+        SummaryDB DB;
+        if (!SummaryDBPath.empty() && !DB.load(SummaryDBPath, errs())) {
+            // A partly read file would stop the callee searches at the wrong functions.
+            errs() << "rbd: running without -rbd-summary-db\n";
+        }
+        return DB;
+    }
+
+    const SummaryDB &getSummaryDB() {
+        // Initialized once, also when the detectors of several modules run on threads.
+        static const SummaryDB DB = loadOptionSummaryDB();
+        return DB;
+    }
+
+    void buildSummaryDB(Module &M, SummaryDB &DB) {
+        // May-lock starts at the functions that lock, call through a pointer or
+        // call back into the local crate, and flows from callees to callers.
+        std::map<Function *, std::vector<Function *>> mapCallers;
+        std::set<Function *> setMayLock;
+        std::vector<Function *> WorkList;
+        std::set<Function *> setDropsArg;
+        for (Function &F : M) {
+            if (F.isDeclaration()) {
+                continue;
+            }
+            bool Seed = isLockAPIName(F.getName());
+            for (Instruction &I : instructions(F)) {
+                if (!isCallOrInvokeInst(&I)) {
+                    continue;
+                }
+                CallSite CS;
+                Function *Callee = getCalledFunc(&I, CS);
+                if (!Callee) {
+                    Seed |= !isa<InlineAsm>(CS.getCalledValue());
+                    continue;
+                }
+                if (isLockAPIName(Callee->getName()) || isLocalCrateFunc(*Callee)) {
+                    Seed = true;
+                }
+                mapCallers[Callee].push_back(&F);
+                if (isGuardDropAPI(Callee->getName())) {
+                    for (unsigned Arg = 0; Arg < CS.getNumArgOperands(); ++Arg) {
+                        if (isa<Argument>(CS.getArgOperand(Arg)->stripPointerCasts())) {
+                            setDropsArg.insert(&F);
+                        }
+                    }
+                }
+            }
+            if (Seed && setMayLock.insert(&F).second) {
+                WorkList.push_back(&F);
+            }
+        }
+        while (!WorkList.empty()) {
+            Function *Callee = WorkList.back();
+            WorkList.pop_back();
+            for (Function *Caller : mapCallers[Callee]) {
+                if (setMayLock.insert(Caller).second) {
+                    WorkList.push_back(Caller);
+                }
+            }
+        }
+
+        for (Function &F : M) {
+            if (F.isDeclaration() || !F.hasName() || isLocalCrateFunc(F)) {
+                continue;
+            }
+            unsigned Facts = setMayLock.count(&F) ? SummaryMayLock : SummaryNeverLocks;
+            if (setDropsArg.count(&F)) {
+                Facts |= SummaryDropsArg;
+            }
+            DB.addFacts(getStableFuncName(F.getName()), Facts);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#include "Common/UseList.h"
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    void collectDirectCallSites(Function *Callee, std::vector<Instruction *> &CallSites) {
+        if (!Callee) {
+            return;
+        }
+        for (Use &U : Callee->uses()) {
+            Instruction *I = dyn_cast<Instruction>(U.getUser());
+            if (!I || isa<DbgInfoIntrinsic>(I)) {
+                continue;
+            }
+            if (!isa<CallInst>(I) && !isa<InvokeInst>(I)) {
+                continue;
+            }
+            CallSite CS(I);
+            if (!CS.isCallee(&U)) {
+                continue;
+            }
+            CallSites.push_back(I);
+        }
+    }
+
+    void collectGlobalCallSitesByUses(Module &M, CallGraphIndex &CG) {
+        for (Function &Callee : M) {
+            std::vector<Instruction *> CallSites;
+            collectDirectCallSites(&Callee, CallSites);
+            for (Instruction *I : CallSites) {
+                CG.addCall(I, &Callee);
+            }
+        }
+    }
+}
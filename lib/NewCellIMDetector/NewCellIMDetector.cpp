@@ -4,7 +4,7 @@
 #include <string>
 #include <set>
 #include <stack>
-#include <CFG/CFG.h>
+#include <CFG/FlatCDG.h>
 
 #include "llvm/Pass.h"
 #include "llvm/Analysis/AliasAnalysis.h"
@@ -16,7 +16,11 @@
 #include "llvm/IR/TypeFinder.h"
 #include "llvm/Analysis/PostDominators.h"
 
+#include "Common/CallGraphIndex.h"
 #include "Common/CallerFunc.h"
+#include "Common/DetectorPlugin.h"
+#include "Common/FuncAnalyses.h"
+#include "Common/IndirectCallIndex.h"
 
 #define DEBUG_TYPE "CellIMDetector"
 
@@ -28,15 +32,11 @@ namespace detector {
 
     NewCellIMDetector::NewCellIMDetector() : ModulePass(ID) {
         PassRegistry &Registry = *PassRegistry::getPassRegistry();
-        initializePostDominatorTreeWrapperPassPass(Registry);
-        initializeDominatorTreeWrapperPassPass(Registry);
         initializeAAResultsWrapperPassPass(Registry);
     }
 
     void NewCellIMDetector::getAnalysisUsage(AnalysisUsage &AU) const {
         AU.setPreservesAll();
-        AU.addRequired<PostDominatorTreeWrapperPass>();
-        AU.addRequired<DominatorTreeWrapperPass>();
         AU.addRequired<AAResultsWrapperPass>();
     }
 
@@ -190,7 +190,7 @@ namespace detector {
     }
 
     static bool collectCallees(Function *F,
-                               std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallee) {
+                               CallGraphIndex &CG) {
         if (!F || F->isDeclaration()) {
             return false;
         }
@@ -203,7 +203,7 @@ namespace detector {
                         CallSite CS(I);
                         Function *Callee = CS.getCalledFunction();
                         if (Callee && !Callee->isDeclaration()) {
-                            mapCallerCallee[F].insert(std::make_pair(I, Callee));
+                            CG.addCall(I, Callee);
                         }
                     }
                 }
@@ -281,7 +281,7 @@ namespace detector {
     static bool containsCellIM(
             Function *SyncImmuFunc,
             std::set<Function *> &setCellIMFunc,
-            std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallSites,
+            const CallGraphIndex &CG,
             std::vector<Function *> &vecTrack
     ) {
 
@@ -298,13 +298,12 @@ namespace detector {
             if (setCellIMFunc.find(Curr) != setCellIMFunc.end()) {
                 return true;
             }
-            if (mapCallerCallSites.find(Curr) == mapCallerCallSites.end()) {
-                continue;
-            }
-            for (auto &kv : mapCallerCallSites[Curr]) {
-                if (setCellIMFunc.find(kv.second) != setCellIMFunc.end()) {
+            for (unsigned Site : CG.callSitesIn(Curr)) {
+                Instruction *CallInst = CG.getCallInst(Site);
+                Function *Callee = CG.getCallee(Site);
+                if (setCellIMFunc.find(Callee) != setCellIMFunc.end()) {
 //                    // Track
-                    vecTrack.push_back(kv.second);
+                    vecTrack.push_back(Callee);
                     Function *TrackCurr = Curr;
                     while (TrackCurr != SyncImmuFunc) {
                         vecTrack.push_back(TrackCurr);
@@ -313,11 +312,11 @@ namespace detector {
                     vecTrack.push_back(SyncImmuFunc);
                     return true;
                 }
-                if (isSelfToSelfCI(kv.first)) {
-                    if (Visited.find(kv.second) == Visited.end()) {
-                        WorkList.push_back(kv.second);
-                        Visited.insert(kv.second);
-                        CalleeTracker[kv.second] = Curr;
+                if (isSelfToSelfCI(CallInst)) {
+                    if (Visited.find(Callee) == Visited.end()) {
+                        WorkList.push_back(Callee);
+                        Visited.insert(Callee);
+                        CalleeTracker[Callee] = Curr;
                     }
                 }
             }
@@ -379,10 +378,10 @@ namespace detector {
     static bool collectCellIMCallers(
             std::set<Function *> &setSyncImmuFunc,
             std::set<Function *> &setCellIMFunc,
-            std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallSites) {
+            const CallGraphIndex &CG) {
         for (Function *SyncImmuFunc : setSyncImmuFunc) {
             std::vector<Function *> vecTracker;
-            if (containsCellIM(SyncImmuFunc, setCellIMFunc, mapCallerCallSites, vecTracker)) {
+            if (containsCellIM(SyncImmuFunc, setCellIMFunc, CG, vecTracker)) {
                 if (Instruction *FirstInst = SyncImmuFunc->getEntryBlock().getFirstNonPHIOrDbgOrLifetime()) {
                     printDebugInfo(FirstInst);
                 }
@@ -403,8 +402,8 @@ namespace detector {
         return F->getName().startswith("_ZN13servo_remutex17HandOverHandMutex5owner17h");
     }
 
-    static bool isProtected(Instruction *UnprotectedCellCallInst, std::set<BasicBlock *> &setBranchBBs,
-                            ControlDependenceGraphBase &CDG) {
+    static bool isProtected(Instruction *UnprotectedCellCallInst, const SmallPtrSetImpl<BasicBlock *> &setBranchBBs,
+                            FlatControlDependenceGraph &CDG) {
         for (User *U : UnprotectedCellCallInst->users()) {
             if (Instruction *I = dyn_cast<Instruction>(U)) {
                 if (isCallOrInvokeInst(I)) {
@@ -417,14 +416,7 @@ namespace detector {
                 }
             }
         }
-        bool Influenced = false;
-        for (BasicBlock *BranchBB : setBranchBBs) {
-            if (CDG.influences(BranchBB, UnprotectedCellCallInst->getParent())) {
-                Influenced = true;
-                break;
-            }
-        }
-        return Influenced;
+        return CDG.influencesAny(setBranchBBs, UnprotectedCellCallInst->getParent());
     };
 
     static bool isLockFunc(Function *F) {
@@ -482,6 +474,11 @@ namespace detector {
     }
 
     bool NewCellIMDetector::runOnModule(Module &M) {
+        LegacyFuncAnalyses Analyses(*this);
+        return detect(M, Analyses);
+    }
+
+    bool NewCellIMDetector::detect(Module &M, FuncAnalyses &Analyses) {
         std::set<Function *> setCellIMFunc;
         std::set<Function *> setAtomicFunc;
         std::set<Function *> setHandOverHandFunc;
@@ -503,6 +500,7 @@ namespace detector {
         }
 
         std::map<Function *, std::set<Instruction *>> mapCalleeCallSites;
+        IndirectCallIndex Indirect(M);
         for (Function &F : M) {
             if (F.begin() == F.end()) {
                 continue;
@@ -518,6 +516,9 @@ namespace detector {
                     CallSite CS(&I);
                     Function *Callee = CS.getCalledFunction();
                     if (!Callee) {
+                        for (Function *Target : Indirect.getTargets(&I)) {
+                            mapCalleeCallSites[Target].insert(&I);
+                        }
                         continue;
                     }
                     mapCalleeCallSites[Callee].insert(&I);
@@ -555,7 +556,7 @@ namespace detector {
             }
         }
 
-        std::map<Function *, std::set<BasicBlock *>> mapCallerBranchBBs;
+        std::map<Function *, SmallPtrSet<BasicBlock *, 8>> mapCallerBranchBBs;
         for (auto &kv : mapSemaphoreCallerCallSites) {
             for (Instruction *SemaphoreCallInst : kv.second) {
                 for (User *U : SemaphoreCallInst->users()) {
@@ -616,11 +617,9 @@ namespace detector {
             Instruction *CurrInst = WorkList.front();
             WorkList.pop_front();
             Function *CurrFunc = CurrInst->getFunction();
-            PostDominatorTree *PDT = &getAnalysis<PostDominatorTreeWrapperPass>(*CurrFunc).getPostDomTree();
             auto ItCallerBranchBB = mapCallerBranchBBs.find(CurrFunc);
             if (ItCallerBranchBB != mapCallerBranchBBs.end()) {
-                ControlDependenceGraphBase CDG;
-                CDG.graphForFunction(*CurrFunc, *PDT);
+                FlatControlDependenceGraph &CDG = Analyses.getControlDependenceGraph(*CurrFunc);
                 if (isProtected(CurrInst, ItCallerBranchBB->second, CDG)) {
 //                    errs() << CurrFunc->getName() << "\n";
 //                    printDebugInfo(CurrFunc->getEntryBlock().getFirstNonPHIOrDbgOrLifetime());
@@ -667,6 +666,14 @@ namespace detector {
         return false;
     }
 
+    PreservedAnalyses NewCellIMDetectorPass::run(Module &M, ModuleAnalysisManager &MAM) {
+        FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+        NewPMFuncAnalyses Analyses(FAM);
+        NewCellIMDetector Detector;
+        Detector.detect(M, Analyses);
+        return PreservedAnalyses::all();
+    }
+
 }  // namespace detector
 
 
@@ -675,3 +682,9 @@ static RegisterPass<detector::NewCellIMDetector> X(
         "Detect Cell-based Interior Mutability",
         false,
         true);
+
+#ifndef RBD_LINK_INTO_TOOLS
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo llvmGetPassPluginInfo() {
+    return detector::getDetectorPluginInfo<detector::NewCellIMDetectorPass>("NewCellIMDetector");
+}
+#endif
@@ -1,18 +1,38 @@
 #include "NewDoubleLockDetector/NewDoubleLockDetector.h"
 
+#include <algorithm>
 #include <set>
 #include <stack>
 
 #include "llvm/Pass.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/DebugLoc.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Operator.h"
+#include "llvm/Support/Debug.h"
 
+#include "Common/Budget.h"
+#include "Common/CallGraphIndex.h"
 #include "Common/CallerFunc.h"
+#include "Common/FunctionGroups.h"
+#include "Common/GuardLifetime.h"
+#include "Common/IndirectCallIndex.h"
+#include "Common/LockAPI.h"
+#include "Common/LockDataflow.h"
+#include "Common/LockSummary.h"
+#include "Common/Options.h"
+#include "Common/Parallel.h"
+#include "Common/Report.h"
+#include "Common/SummaryCache.h"
+#include "Common/SummaryDB.h"
+#include "Common/UseList.h"
 
 #define DEBUG_TYPE "NewDoubleLockDetector"
 
@@ -22,7 +42,7 @@ namespace detector {
 
     char NewDoubleLockDetector::ID = 0;
 
-    NewDoubleLockDetector::NewDoubleLockDetector() : ModulePass(ID) {
+    NewDoubleLockDetector::NewDoubleLockDetector(ReportCollector *Reports) : ModulePass(ID), pReports(Reports) {
         PassRegistry &Registry = *PassRegistry::getPassRegistry();
         initializeAAResultsWrapperPassPass(Registry);
     }
@@ -32,6 +52,7 @@ namespace detector {
         AU.addRequired<AAResultsWrapperPass>();
     }
 
+    namespace {
     struct LockInfo {
         Value *result;
         Value *mutex;
@@ -39,6 +60,7 @@ namespace detector {
         LockInfo() : result(nullptr), mutex(nullptr) {
         }
     };
+    }  // namespace
 
     static bool isFuncUnwrap(Instruction *I) {
         if (isCallOrInvokeInst(I)) {
@@ -256,11 +278,10 @@ namespace detector {
         for (auto U = result->user_begin(); U != result->user_end(); ++U) {
             Value *V = *U;
             Instruction *I = dyn_cast<Instruction>(V);
-            I->print(errs());
-            errs() << '\n';
+            LLVM_DEBUG(I->print(dbgs()); dbgs() << '\n');
             if (isFuncUnwrap(I)) {
                 for (auto NU = I->user_begin(); NU != I->user_end(); ++NU) {
-                    (*NU)->print(errs());
+                    LLVM_DEBUG((*NU)->print(dbgs()));
                     std::set<Instruction *> setLocalDropInst;
                     if (trackStore(*NU, setLocalDropInst)) {
                         setDropInst.insert(setLocalDropInst.begin(), setLocalDropInst.end());
@@ -290,13 +311,13 @@ namespace detector {
         }
     }
 
-    static bool printDebugInfo(Instruction *I) {
+    static bool printDebugInfo(Instruction *I, raw_ostream &OS = errs()) {
         const llvm::DebugLoc &lockInfo = I->getDebugLoc();
 //        I->print(errs());
 //        errs() << "\n";
         auto di = lockInfo.get();
         if (di) {
-            errs() << " " << lockInfo->getDirectory() << ' '
+            OS << " " << lockInfo->getDirectory() << ' '
                    << lockInfo->getFilename() << ' '
                    << lockInfo.getLine() << "\n";
             return true;
@@ -305,6 +326,7 @@ namespace detector {
         }
     }
 
+    namespace {
     struct MutexSource {
         Value *direct;
         Type *structTy;
@@ -313,8 +335,9 @@ namespace detector {
         MutexSource() : direct(nullptr), structTy(nullptr), index(std::vector<APInt>()) {
         }
     };
+    }  // namespace
 
-    bool operator==(const MutexSource& lhs, const MutexSource& rhs) {
+    static bool operator==(const MutexSource& lhs, const MutexSource& rhs) {
         if (lhs.direct == rhs.direct) {
             return true;
         }
@@ -495,10 +518,12 @@ namespace detector {
         return !setDoubleLockFn.empty();
     }
 
+    namespace {
     struct FnLockMatch {
         Function *F;
         MutexSource MS;
     };
+    }  // namespace
 
     static bool skipInst(Instruction *I) {
         if (!I) {
@@ -513,36 +538,18 @@ namespace detector {
         return false;
     }
 
+    // Shared with the snapshot and summary code, so the three agree on what a lock is.
     static bool isLockFunc(Function *F) {
-        if (!F) {
-            return false;
-        }
-        StringRef Name = F->getName();
-        // Check Mutex
-        if (Name.find("mutex") != StringRef::npos || Name.find("Mutex") != StringRef::npos) {
-            if (Name.find("raw_mutex") != StringRef::npos|| Name.find("RawMutex") != StringRef::npos) {
-                return false;
-            } else if (Name.find("GT$4lock") != StringRef::npos) {
-                return true;
-            }
-        } else if (Name.find("rwlock") != StringRef::npos || Name.find("RwLock") != StringRef::npos) {
-            if (Name.startswith("HandyRwLock$LT$T$GT$$GT$2rl")
-                || Name.startswith("HandyRwLock$LT$T$GT$$GT$2wl")) {
-                return true;
-            } else if (Name.find("raw_rwlock") != StringRef::npos || Name.find("RawRwLock") != StringRef::npos) {
-                return false;
-            } else if (Name.find("$GT$4read") != StringRef::npos || Name.find("$GT$5write") != StringRef::npos) {
-                return true;
-            }
-        }
-        return false;
+        return F && isLockAPIName(F->getName());
     }
 
+    namespace {
     struct stLockInfo {
         Instruction *LockInst;
         Value *ReturnValue;
         Value *LockValue;
     };
+    }  // namespace
 
     static bool parseLockInst(Instruction *LockInst, stLockInfo &LockInfo) {
         if (!LockInst) {
@@ -556,9 +563,7 @@ namespace detector {
                 LockInfo.LockValue = CS.getArgOperand(1);
                 return true;
             } else {
-                errs() << "Void-return Lock\n";
-                LockInst->print(errs());
-                errs() << "\n";
+                LLVM_DEBUG(dbgs() << "Void-return Lock\n"; LockInst->print(dbgs()); dbgs() << "\n");
                 return false;
             }
         } else {  // Non-mutex
@@ -567,92 +572,69 @@ namespace detector {
                 LockInfo.LockValue = CS.getArgOperand(0);
                 return true;
             } else {
-                errs() << "Non-parameter Lock\n";
-                LockInst->print(errs());
-                errs() << "\n";
+                LLVM_DEBUG(dbgs() << "Non-parameter Lock\n"; LockInst->print(dbgs()); dbgs() << "\n");
                 return false;
             }
         }
     }
 
-    static bool trackDownToDropInsts(Instruction *RI, std::set<Instruction *> &setDropInst) {
-        if (!RI) {
-            return false;
-        }
-        errs() << "LockInst:\n";
-        RI->print(errs());
-        errs() << "\n";
-        setDropInst.clear();
-
-        std::list<Instruction *> WorkList;
-        std::set<Instruction *> Visited;
-        WorkList.push_back(RI);
-        bool Stop = false;
-        while (!WorkList.empty() && !Stop) {
-            Instruction *Curr = WorkList.front();
-            WorkList.pop_front();
-            for (User *U: Curr->users()) {
-                if (Instruction *UI = dyn_cast<Instruction>(U)) {
-                    if (Visited.find(UI) == Visited.end()) {
-                        if (isDropInst(UI)) {
-                            errs() << "DropInst\n";
-                           UI->print(errs());
-                           errs() << '\n';
-                            setDropInst.insert(UI);
-                            Value *V = UI->getOperand(0);
-                            assert(V);
-                            for (User *UV: V->users()) {
-                                if (Instruction *UVI = dyn_cast<Instruction>(UV)) {
-                                    if (Visited.find(UVI) == Visited.end()) {
-                                        if (isDropInst(UVI)) {
-                                            setDropInst.insert(UVI);
-                                        }
-                                    }
-                                }
-                            }
-                            return true;
-                        } else if (StoreInst *SI = dyn_cast<StoreInst>(UI)) {
-                            if (Instruction *Dest = dyn_cast<Instruction>(SI->getPointerOperand())) {
-                                WorkList.push_back(Dest);
-                            } else {
-                                errs() << "StoreInst Dest is not a Inst\n";
-                                printDebugInfo(Curr);
-                            }
-                        } else if (LoadInst *LI = dyn_cast<LoadInst>(UI)) {
-                            errs() << "LoadInst:\n";
-                            for (User *UV: LI->users()) {
-                                if (Instruction *UVI = dyn_cast<Instruction>(UV)) {
-                                    if (isDropInst(UVI)) {
-                                        setDropInst.insert(UVI);
-                                    }
-                                }
-                                Value *V = UI->getOperand(0);
-                                assert(V);
-                                for (User *UV2: V->users()) {
-                                    if (Instruction *UVI2 = dyn_cast<Instruction>(UV2)) {
-                                        if (Visited.find(UVI2) == Visited.end()) {
-                                            if (isDropInst(UVI2)) {
-                                                setDropInst.insert(UVI2);
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-                        } else {
-                            WorkList.push_back(UI);
-                        }
-                        Visited.insert(UI);
-                    }
-                }
+    static void parseCallSite(Instruction *I, Function *Callee,
+            CallGraphIndex &CG,
+            std::map<Instruction *, stLockInfo> &mapLockInfo,
+            std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+            const std::map<Instruction *, std::set<Instruction *>> &mapCachedDrop,
+            GuardLifetime &GL) {
+        if (isLockFunc(Callee)) {
+            stLockInfo LockInfo { nullptr, nullptr, nullptr };
+            if (!parseLockInst(I, LockInfo)) {
+                LLVM_DEBUG(dbgs() << "Cannot Parse Lock Inst\n"; printDebugInfo(I, dbgs()));
+                return;
+            }
+            Instruction *RI = dyn_cast<Instruction>(LockInfo.ReturnValue);
+            if (!RI) {
+                LLVM_DEBUG(dbgs() << "Return Value is not Inst\n"; LockInfo.ReturnValue->print(dbgs());
+                           dbgs() << '\n');
+                return;
+            }
+            mapLockInfo[I] = LockInfo;
+            std::set<Instruction *> setDropInst;
+            auto itCached = mapCachedDrop.find(I);
+            if (itCached != mapCachedDrop.end()) {
+                setDropInst = itCached->second;
+            } else {
+                // std::sync locks return the guard wrapped in a LockResult.
+                bool Wrapped = Callee->getName().startswith("_ZN3std4sync");
+                GL.collectDestInsts(RI, Wrapped, GuardLifetime::AutoDrop | GuardLifetime::ManualDrop, setDropInst);
             }
+            if (!setDropInst.empty()) {
+                mapLockDropInfo[I] = std::make_pair(Callee, setDropInst);
+//                // Debug
+//                I->print(errs());
+//                errs() << '\n';
+//                for (Instruction *DropInst: setDropInst) {
+//                    errs() << '\t';
+//                    DropInst->print(errs());
+//                    errs() << '\n';
+//                }
+            } else {
+                LLVM_DEBUG(dbgs() << "Cannot find Drop for Inst:\n";
+                           dbgs() << I->getParent()->getParent()->getName() << '\n';
+                           I->print(dbgs());
+                           printDebugInfo(I, dbgs());
+                           dbgs() << '\n');
+                mapLockDropInfo[I] = std::make_pair(Callee, setDropInst);
+            }
+        } else {
+            CG.addCall(I, Callee);
         }
-        return false;
     }
 
     static bool parseFunc(Function *F,
-            std::map<Instruction *, Function *> &mapCallInstCallee,
+            CallGraphIndex &CG,
             std::map<Instruction *, stLockInfo> &mapLockInfo,
-            std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo) {
+            std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+            const std::map<Instruction *, std::set<Instruction *>> &mapCachedDrop,
+            GuardLifetime &GL) {
         if (!F || F->isDeclaration()) {
             return false;
         }
@@ -668,44 +650,7 @@ namespace detector {
                         CallSite CS(I);
                         Function *Callee = CS.getCalledFunction();
                         if (Callee && !Callee->isDeclaration()) {
-                            if (isLockFunc(Callee)) {
-                                stLockInfo LockInfo { nullptr, nullptr, nullptr };
-                                if (!parseLockInst(I, LockInfo)) {
-                                    errs() << "Cannot Parse Lock Inst\n";
-                                    printDebugInfo(I);
-                                    continue;
-                                }
-                                Instruction *RI = dyn_cast<Instruction>(LockInfo.ReturnValue);
-                                if (!RI) {
-                                    errs() << "Return Value is not Inst\n";
-                                    LockInfo.ReturnValue->print(errs());
-                                    errs() << '\n';
-                                    continue;
-                                }
-                                mapLockInfo[I] = LockInfo;
-                                std::set<Instruction *> setDropInst;
-                                if (trackDownToDropInsts(RI, setDropInst)) {
-                                    mapLockDropInfo[I] = std::make_pair(Callee, setDropInst);
-//                                    // Debug
-//                                    I->print(errs());
-//                                    errs() << '\n';
-//                                    for (Instruction *DropInst: setDropInst) {
-//                                        errs() << '\t';
-//                                        DropInst->print(errs());
-//                                        errs() << '\n';
-//                                    }
-                                } else {
-                                    errs() << "Cannot find Drop for Inst:\n";
-                                    errs() << I->getParent()->getParent()->getName() << '\n';
-                                    I->print(errs());
-                                    printDebugInfo(I);
-                                    errs() << '\n';
-                                    mapLockDropInfo[I] = std::make_pair(Callee, setDropInst);
-                                }
-
-                            } else {
-                                mapCallInstCallee[I] = Callee;
-                            }
+                            parseCallSite(I, Callee, CG, mapLockInfo, mapLockDropInfo, mapCachedDrop, GL);
                         }
                     }
                 }
@@ -715,104 +660,101 @@ namespace detector {
         return true;
     }
 
-
-    static bool trackCallee(Instruction *LockInst,
-            std::pair<Instruction *, Function *> &DirectCalleeSite,
-            std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallees,
-            std::map<Function *, std::set<Instruction *>> &mapAliasFuncLock) {
-
-        bool HasDoubleLock = false;
-
-        Function *DirectCallee = DirectCalleeSite.second;
-
-        if (mapAliasFuncLock.find(DirectCallee) != mapAliasFuncLock.end()) {
-            HasDoubleLock = true;
-            errs() << "Double Lock Happens! First Lock:\n";
-            printDebugInfo(LockInst);
-            errs() << DirectCallee->getName() << '\n';
-            // Debug Require
-            LockInst->print(errs());
-            errs() << '\n';
-            printDebugInfo(DirectCalleeSite.first);
-            errs() << "Second Lock(s):\n";
-            for (Instruction *AliasLock : mapAliasFuncLock[DirectCallee]) {
-                printDebugInfo(AliasLock);
-                AliasLock->print(errs());
-                errs() << '\n';
+    // Same result as parseFunc on every function, but only visits the call sites
+    // of defined functions, found through their use lists.
+    static void parseModuleByUses(Module &M,
+            CallGraphIndex &CG,
+            std::map<Instruction *, stLockInfo> &mapLockInfo,
+            std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+            const std::map<Instruction *, std::set<Instruction *>> &mapCachedDrop,
+            GuardLifetime &GL) {
+        for (Function &F : M) {
+            if (F.isDeclaration()) {
+                continue;
+            }
+            std::vector<Instruction *> CallSites;
+            collectDirectCallSites(&F, CallSites);
+            for (Instruction *I : CallSites) {
+                if (!isLocalCrateInst(I)) {
+                    continue;
+                }
+                parseCallSite(I, &F, CG, mapLockInfo, mapLockDropInfo, mapCachedDrop, GL);
             }
-            errs() << '\n';
         }
+    }
 
-        std::stack<Function *> WorkList;
-        std::set<Function *> Visited;
+    namespace {
+    // Dense ids shared by LockSummary queries and reports.
+    struct SummaryIds {
+        std::map<Function *, unsigned> mapFuncId;
+        std::vector<Function *> vecFunc;
+        std::map<Instruction *, unsigned> mapInstId;
+        std::vector<Instruction *> vecInst;
+    };
+    }  // namespace
 
-        std::map<Function *, Instruction *> mapParentInst;
+    static unsigned getFuncId(SummaryIds &Ids, Function *F) {
+        auto it = Ids.mapFuncId.find(F);
+        if (it != Ids.mapFuncId.end()) {
+            return it->second;
+        }
+        unsigned Id = Ids.vecFunc.size();
+        Ids.mapFuncId[F] = Id;
+        Ids.vecFunc.push_back(F);
+        return Id;
+    }
 
-        WorkList.push(DirectCallee);
-        Visited.insert(DirectCallee);
+    static unsigned getInstId(SummaryIds &Ids, Instruction *I) {
+        auto it = Ids.mapInstId.find(I);
+        if (it != Ids.mapInstId.end()) {
+            return it->second;
+        }
+        unsigned Id = Ids.vecInst.size();
+        Ids.mapInstId[I] = Id;
+        Ids.vecInst.push_back(I);
+        return Id;
+    }
 
-        mapParentInst[DirectCallee] = DirectCalleeSite.first;
+    // Answer a call site with one summary lookup instead of walking the callees.
+    // Only when a double lock is found, a witness call chain is reconstructed for the report.
+    static bool trackCallee(Instruction *LockInst,
+            unsigned Bucket,
+            std::pair<Instruction *, Function *> &DirectCalleeSite,
+            const LockSummary &Summary,
+            const SummaryIds &Ids,
+            std::vector<Finding> &vecFinding) {
 
-        while (!WorkList.empty()) {
-            Function *Curr = WorkList.top();
-            WorkList.pop();
-//            errs() << Curr->getName() << '\n';
-            auto itCallerCallInst = mapCallerCallees.find(Curr);
-            if (itCallerCallInst != mapCallerCallees.end()) {
-//                errs() << "Caller Found\n";
-                std::map<Instruction *, Function *> &mapCallInstCallee = itCallerCallInst->second;
-                for (auto &CallInstCallee : mapCallInstCallee) {
-                    Instruction *CallInst = CallInstCallee.first;
-                    Function *Callee = CallInstCallee.second;
-//                    errs() << "Callee Found " << Callee->getName() << '\n';
-                    if (Visited.find(Callee) == Visited.end()) {
-//                        errs() << "Not Visited\n";
-                        if (mapAliasFuncLock.find(Callee) != mapAliasFuncLock.end()) {
-                            errs() << "Double Lock Happens! First Lock:\n";
-                            errs() << LockInst->getParent()->getParent()->getName() << '\n';
-                            printDebugInfo(LockInst);
-                            LockInst->print(errs());
-                            errs() << '\n';
-                            errs() << Callee->getName() << '\n';
-                            errs() << "Second Lock(s):\n";
-                            for (Instruction *AliasLock : mapAliasFuncLock[Callee]) {
-                                printDebugInfo(AliasLock);
-                                LockInst->print(errs());
-                                errs() << '\n';
-                            }
-                            errs() << '\n';
-                            // backtrace print
-                            mapParentInst[Callee] = CallInst;
-                            std::set<Function *> TraceVisited;
-                            auto it = mapParentInst.find(Callee);
-                            while (it != mapParentInst.end()) {
-                                Instruction *ParentInst = it->second;
-                                printDebugInfo(ParentInst);
-                                errs() << ParentInst->getParent()->getName() << ": ";
-                                ParentInst->print(errs());
-                                errs() << '\n';
-                                Function *ParentFunc = ParentInst->getParent()->getParent();
-                                it = mapParentInst.find(ParentFunc);
-                                if (it != mapParentInst.end()) {
-                                    if (TraceVisited.find(it->first) != TraceVisited.end()) {
-                                        break;
-                                    } else {
-                                        TraceVisited.insert(it->first);
-                                    }
-                                }
-                            }
-                            // end of backtrack
-                            HasDoubleLock = true;
-                        }
-                        WorkList.push(Callee);
-                        mapParentInst[Callee] = CallInst;
-                        Visited.insert(Callee);
-                    }
-                }
-            }
+        auto itCallee = Ids.mapFuncId.find(DirectCalleeSite.second);
+        auto itLock = Ids.mapInstId.find(LockInst);
+        if (itCallee == Ids.mapFuncId.end() || itLock == Ids.mapInstId.end()) {
+            return false;
+        }
+        unsigned CalleeId = itCallee->second;
+        unsigned LockId = itLock->second;
+        if (!Summary.mayAcquire(CalleeId, Bucket, LockId)) {
+            return false;
+        }
+
+        std::vector<unsigned> CallChain;
+        unsigned WitnessFunc = 0;
+        std::vector<unsigned> SecondLocks;
+        if (!Summary.findWitness(CalleeId, Bucket, LockId, CallChain, WitnessFunc, SecondLocks)) {
+            return false;
         }
 
-        return HasDoubleLock;
+        LLVM_DEBUG(dbgs() << "Witness: " << Ids.vecFunc[WitnessFunc]->getName() << '\n');
+        std::vector<Instruction *> vecSecondLock;
+        for (unsigned SiteId : SecondLocks) {
+            vecSecondLock.push_back(Ids.vecInst[SiteId]);
+        }
+        // call chain from the direct call site down to the second lock(s)
+        std::vector<Instruction *> vecCallChain(1, DirectCalleeSite.first);
+        for (unsigned SiteId : CallChain) {
+            vecCallChain.push_back(Ids.vecInst[SiteId]);
+        }
+        vecFinding.push_back(makeDoubleLockFinding(LockInst, vecSecondLock, vecCallChain));
+
+        return true;
     }
 
     static bool trackCalleeDepracated(Instruction *LockInst,
@@ -860,118 +802,356 @@ namespace detector {
         return StopPropagation;
     }
 
-    static bool trackLockInst(Instruction *LockInst,
-            std::set<Instruction *> setMayAliasLock,
-            std::set<Instruction *> setDrop,
-            std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallees) {
+    namespace {
+    // Locks of one function, with the facts the dataflow needs, in instruction order.
+    struct FuncLocks {
+        Function *F;
+        std::vector<Instruction *> vecLock;
+        std::vector<unsigned> vecBucket;
+    };
 
-//        std::set<Function *> setMayAliasFunc;
-//        for (Instruction *I : setMayAliasLock) {
-//            if (I != LockInst) {
-//                setMayAliasFunc.insert(I->getParent()->getParent());
-//            }
-//        }
-        std::map<Function *, std::set<Instruction *>> mapMayAliasFuncLock;
-        for (Instruction *I : setMayAliasLock) {
-            if (I != LockInst) {
-                Function *AliasFunc = I->getParent()->getParent();
-                mapMayAliasFuncLock[AliasFunc].insert(I);
+    // The solved dataflow of one function: its event sites and their conflicts.
+    struct SolvedLocks {
+        std::vector<Instruction *> vecSite;
+        std::vector<Function *> vecSiteCallee;  // per site, the callee whose summary it checks
+        std::vector<LockDataflow::Conflict> vecConflict;
+    };
+    }  // namespace
+
+    // Drop instruction -> local ids of the locks of FL whose guard it releases.
+    static void collectDropLocks(const FuncLocks &FL,
+            const std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+            std::map<Instruction *, BitVector> &mapDropLocks) {
+        unsigned NumLocks = FL.vecLock.size();
+        for (unsigned L = 0; L < NumLocks; ++L) {
+            auto itDrop = mapLockDropInfo.find(FL.vecLock[L]);
+            if (itDrop == mapLockDropInfo.end()) {
+                continue;
+            }
+            for (Instruction *DropInst : itDrop->second.second) {
+                BitVector &Drops = mapDropLocks[DropInst];
+                Drops.resize(NumLocks);
+                Drops.set(L);
             }
         }
-//        // Debug
-//        printDebugInfo(LockInst);
-//        for (Function *F : setMayAliasFunc) {
-//            errs() << F->getName() << '\n';
-//        }
-        std::stack<BasicBlock *> WorkList;
-        std::set<BasicBlock *> Visited;
+    }
 
-        Function *Caller = LockInst->getParent()->getParent();
-        auto &mapCallInstCallee = mapCallerCallees[Caller];
+    // Locks of FL that a call of Callee may acquire again; none for a null or unknown Callee.
+    static void collectCalleeChecks(const FuncLocks &FL, Function *Callee,
+            const LockSummary &Summary,
+            const SummaryIds &Ids,
+            BitVector &Check) {
+        if (!Callee) {
+            return;
+        }
+        auto itCallee = Ids.mapFuncId.find(Callee);
+        if (itCallee == Ids.mapFuncId.end()) {
+            return;
+        }
+        for (unsigned L = 0; L < FL.vecLock.size(); ++L) {
+            if (Summary.mayAcquire(itCallee->second, FL.vecBucket[L],
+                                   Ids.mapInstId.find(FL.vecLock[L])->second)) {
+                Check.set(L);
+            }
+        }
+    }
 
-//        // Debug
-//        for (auto &kv : mapCallInstCallee) {
-//            kv.first->print(errs());
-//            errs() << '\n';
-//        }
+    // Every lock of F is tracked at once: one forward dataflow over the CFG computes
+    // the locks held at each instruction, and double locks are the held locks that
+    // a same-bucket lock site or a call site may acquire again.
+    static void solveFunction(const FuncLocks &FL,
+            const std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+            const CallGraphIndex &CG,
+            const LockSummary &Summary,
+            const SummaryIds &Ids,
+            ExplorationBudget &Budget,
+            SolvedLocks &Solved) {
+
+        Function *F = FL.F;
+        unsigned NumLocks = FL.vecLock.size();
+        std::map<Instruction *, unsigned> mapLockLocal;
+        for (unsigned L = 0; L < NumLocks; ++L) {
+            mapLockLocal[FL.vecLock[L]] = L;
+        }
+        std::map<Instruction *, BitVector> mapDropLocks;
+        collectDropLocks(FL, mapLockDropInfo, mapDropLocks);
+
+        std::vector<BasicBlock *> vecBlock;
+        std::map<BasicBlock *, unsigned> mapBlockId;
+        ReversePostOrderTraversal<Function *> RPOT(F);
+        for (BasicBlock *BB : RPOT) {
+            mapBlockId[BB] = vecBlock.size();
+            vecBlock.push_back(BB);
+        }
 
-        WorkList.push(LockInst->getParent());
-        Visited.insert(LockInst->getParent());
-        while (!WorkList.empty()) {
-            BasicBlock *Curr = WorkList.top();
-            WorkList.pop();
-            bool StopPropagation = false;
-            for (Instruction &II: *Curr) {
+        // Sites are instruction indices into vecSite. A candidate of an indirect
+        // call is a site of its own after the direct one, as in the snapshot.
+        std::vector<Instruction *> &vecSite = Solved.vecSite;
+        std::vector<Function *> &vecSiteCallee = Solved.vecSiteCallee;
+        LockDataflow Dataflow(NumLocks, vecBlock.size());
+        for (unsigned B = 0; B < vecBlock.size(); ++B) {
+            BasicBlock *BB = vecBlock[B];
+            for (BasicBlock *Succ : successors(BB)) {
+                Dataflow.addEdge(B, mapBlockId[Succ]);
+            }
+            for (Instruction &II : *BB) {
                 Instruction *I = &II;
-                // contains same Lock
-                if (setMayAliasLock.find(I) != setMayAliasLock.end()) {
-                    errs() << "Double Lock Happens! First Lock:\n";
-                    printDebugInfo(LockInst);
-                    errs() << "Second Lock(s):\n";
-                    printDebugInfo(I);
-                    // Debug Require
-                    // LockInst->print(errs());
-                    errs() << '\n';
-                    StopPropagation = true;
-                    // break;
-                } else if (setDrop.find(I) != setDrop.end()) {
-                    // contains same Drop
-                    StopPropagation = true;
-                    break;
-                } else {
-                    // is a CallInst
-                    auto it = mapCallInstCallee.find(I);
-                    if (it == mapCallInstCallee.end()) {
-                        continue;
-                    } else {
-                        Instruction *CI = it->first;
-                        Function *Callee = it->second;
-//                        errs() << Callee->getName() << "\n";
-                        auto CalleeSite = std::make_pair(CI, Callee);
-//                        if (trackCallee(LockInst, CalleeSite, mapCallerCallees, setMayAliasFunc)) {
-//                            StopPropagation = true;
-//                            break;
-//                        }
-                        if (trackCallee(LockInst, CalleeSite, mapCallerCallees, mapMayAliasFuncLock)) {
-                            StopPropagation = true;
-                            break;
+                auto itLock = mapLockLocal.find(I);
+                if (itLock != mapLockLocal.end()) {
+                    unsigned Lock = itLock->second;
+                    BitVector Check(NumLocks);
+                    for (unsigned L = 0; L < NumLocks; ++L) {
+                        if (L != Lock && FL.vecBucket[L] == FL.vecBucket[Lock]) {
+                            Check.set(L);
                         }
                     }
+                    Dataflow.addLock(B, vecSite.size(), Lock, Check);
+                    vecSite.push_back(I);
+                    vecSiteCallee.push_back(nullptr);
+                    continue;
                 }
-            }
-
-            if (!StopPropagation) {
-                Instruction *pTerm = Curr->getTerminator();
-                for (unsigned i = 0; i < pTerm->getNumSuccessors(); ++i) {
-                    BasicBlock *Succ = pTerm->getSuccessor(i);
-                    if (Visited.find(Succ) == Visited.end()) {
-                        WorkList.push(Succ);
-                        Visited.insert(Succ);
+                BitVector Kill(NumLocks);
+                auto itDrop = mapDropLocks.find(I);
+                if (itDrop != mapDropLocks.end()) {
+                    Kill = itDrop->second;
+                }
+                Function *Callee = CG.getCalleeOf(I);
+                BitVector Check(NumLocks);
+                collectCalleeChecks(FL, Callee, Summary, Ids, Check);
+                if (Kill.any() || Check.any()) {
+                    Dataflow.addKill(B, vecSite.size(), Kill, Check);
+                    vecSite.push_back(I);
+                    vecSiteCallee.push_back(Callee);
+                }
+                for (unsigned Site : CG.indirectSitesOf(I)) {
+                    BitVector TargetCheck(NumLocks);
+                    collectCalleeChecks(FL, CG.getCallee(Site), Summary, Ids, TargetCheck);
+                    if (TargetCheck.any()) {
+                        Dataflow.addKill(B, vecSite.size(), BitVector(NumLocks), TargetCheck);
+                        vecSite.push_back(I);
+                        vecSiteCallee.push_back(CG.getCallee(Site));
                     }
                 }
             }
         }
 
+        Dataflow.solve(Budget);
+        Dataflow.collectConflicts(Solved.vecConflict);
+    }
+
+    static void reportConflicts(const FuncLocks &FL,
+            const SolvedLocks &Solved,
+            const CallGraphIndex &CG,
+            const LockSummary &Summary,
+            const SummaryIds &Ids,
+            ExplorationBudget &Budget,
+            std::vector<Finding> &vecFinding) {
+        for (const LockDataflow::Conflict &C : Solved.vecConflict) {
+            Instruction *LockInst = FL.vecLock[C.Lock];
+            Instruction *I = Solved.vecSite[C.Site];
+            if (C.GenLock != LockDataflow::NoLock) {
+                vecFinding.push_back(makeDoubleLockFinding(LockInst, std::vector<Instruction *>(1, I),
+                                                           std::vector<Instruction *>()));
+                continue;
+            }
+            if (!Budget.takeCallee()) {
+                break;
+            }
+            auto CalleeSite = std::make_pair(I, Solved.vecSiteCallee[C.Site]);
+            trackCallee(LockInst, FL.vecBucket[C.Lock], CalleeSite, Summary, Ids, vecFinding);
+        }
+    }
+
+    static void checkFunction(const FuncLocks &FL,
+            const std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+            const CallGraphIndex &CG,
+            const LockSummary &Summary,
+            const SummaryIds &Ids,
+            ExplorationBudget &Budget,
+            std::vector<Finding> &vecFinding) {
+        SolvedLocks Solved;
+        solveFunction(FL, mapLockDropInfo, CG, Summary, Ids, Budget, Solved);
+        reportConflicts(FL, Solved, CG, Summary, Ids, Budget, vecFinding);
+    }
+
+    // A and B have the same direct callee and indirect call candidates.
+    static bool sameCallees(const CallGraphIndex &CG, const Instruction *A, const Instruction *B) {
+        if (CG.getCalleeOf(A) != CG.getCalleeOf(B)) {
+            return false;
+        }
+        ArrayRef<unsigned> SitesA = CG.indirectSitesOf(A);
+        ArrayRef<unsigned> SitesB = CG.indirectSitesOf(B);
+        if (SitesA.size() != SitesB.size()) {
+            return false;
+        }
+        for (unsigned Index = 0; Index < SitesA.size(); ++Index) {
+            if (CG.getCallee(SitesA[Index]) != CG.getCallee(SitesB[Index])) {
+                return false;
+            }
+        }
         return true;
     }
 
+    static bool isRecursiveFunc(Function *F, const LockSummary &Summary, const SummaryIds &Ids) {
+        auto itFunc = Ids.mapFuncId.find(F);
+        return itFunc != Ids.mapFuncId.end() && Summary.isRecursive(itFunc->second);
+    }
+
+    // Member poses the same dataflow problem as Rep through the paired instructions
+    // of mapInst: the same locks and buckets, drops and call graph callees.
+    // Neither may be recursive, since a lock is excluded from the summaries of the
+    // callees and only Rep's or only Member's lock could be reached again.
+    static bool sameLockProblem(const FuncLocks &Rep, const FuncLocks &Member,
+            const std::map<Instruction *, Instruction *> &mapInst,
+            const std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+            const CallGraphIndex &CG,
+            const LockSummary &Summary,
+            const SummaryIds &Ids) {
+        if (Rep.vecBucket != Member.vecBucket) {
+            return false;
+        }
+        for (unsigned L = 0; L < Rep.vecLock.size(); ++L) {
+            auto itInst = mapInst.find(Rep.vecLock[L]);
+            if (itInst == mapInst.end() || itInst->second != Member.vecLock[L]) {
+                return false;
+            }
+        }
+        if (isRecursiveFunc(Rep.F, Summary, Ids) || isRecursiveFunc(Member.F, Summary, Ids)) {
+            return false;
+        }
+        std::map<Instruction *, BitVector> mapRepDrops;
+        std::map<Instruction *, BitVector> mapMemberDrops;
+        collectDropLocks(Rep, mapLockDropInfo, mapRepDrops);
+        collectDropLocks(Member, mapLockDropInfo, mapMemberDrops);
+        for (const std::pair<Instruction *const, Instruction *> &Pair : mapInst) {
+            if (!sameCallees(CG, Pair.first, Pair.second)) {
+                return false;
+            }
+            auto itRep = mapRepDrops.find(Pair.first);
+            auto itMember = mapMemberDrops.find(Pair.second);
+            if ((itRep == mapRepDrops.end()) != (itMember == mapMemberDrops.end())) {
+                return false;
+            }
+            if (itRep != mapRepDrops.end() && itRep->second != itMember->second) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The drop sites stored for the lock sites of F, whose body is unchanged since they were stored.
+    static void loadCachedDrops(Function &F, const FuncSummary &Cached,
+                                std::map<Instruction *, std::set<Instruction *>> &mapCachedDrop) {
+        std::vector<Instruction *> vecInst;
+        numberInstructions(F, vecInst);
+        for (const std::pair<unsigned, std::vector<unsigned>> &LockDrop : Cached.vecLockDrop) {
+            if (LockDrop.first >= vecInst.size()) {
+                continue;
+            }
+            std::set<Instruction *> setDropInst;
+            for (unsigned Drop : LockDrop.second) {
+                if (Drop < vecInst.size()) {
+                    setDropInst.insert(vecInst[Drop]);
+                }
+            }
+            mapCachedDrop[vecInst[LockDrop.first]] = setDropInst;
+        }
+    }
+
+    // The findings of F depend on the bodies it reaches through CG and on nothing else.
+    static uint64_t hashReachableFuncs(Function *F, const CallGraphIndex &CG,
+                                       const std::map<Function *, uint64_t> &mapFuncHash) {
+        std::vector<uint64_t> vecHash;
+        std::stack<Function *> WorkList;
+        std::set<Function *> Visited;
+        WorkList.push(F);
+        Visited.insert(F);
+        while (!WorkList.empty()) {
+            Function *Curr = WorkList.top();
+            WorkList.pop();
+            auto itHash = mapFuncHash.find(Curr);
+            vecHash.push_back(itHash != mapFuncHash.end() ? itHash->second : 0);
+            for (unsigned Site : CG.callSitesIn(Curr)) {
+                if (Visited.insert(CG.getCallee(Site)).second) {
+                    WorkList.push(CG.getCallee(Site));
+                }
+            }
+        }
+        return combineHashes(vecHash);
+    }
+
+    static FuncSummary makeFuncSummary(const FuncLocks &FL, uint64_t Hash, uint64_t DeepHash,
+            const std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+            bool Complete, const std::vector<Finding> &vecFinding) {
+        FuncSummary Summary;
+        Summary.Hash = Hash;
+        Summary.DeepHash = DeepHash;
+        Summary.Complete = Complete;
+        Summary.vecFinding = vecFinding;
+        std::vector<Instruction *> vecInst;
+        numberInstructions(*FL.F, vecInst);
+        std::map<Instruction *, unsigned> mapInstIndex;
+        for (unsigned Index = 0; Index < vecInst.size(); ++Index) {
+            mapInstIndex[vecInst[Index]] = Index;
+        }
+        for (Instruction *LockInst : FL.vecLock) {
+            auto itDrop = mapLockDropInfo.find(LockInst);
+            if (itDrop == mapLockDropInfo.end()) {
+                continue;
+            }
+            std::vector<unsigned> vecDrop;
+            for (Instruction *DropInst : itDrop->second.second) {
+                auto itIndex = mapInstIndex.find(DropInst);
+                if (itIndex != mapInstIndex.end()) {
+                    vecDrop.push_back(itIndex->second);
+                }
+            }
+            std::sort(vecDrop.begin(), vecDrop.end());
+            Summary.vecLockDrop.push_back(std::make_pair(mapInstIndex[LockInst], vecDrop));
+        }
+        return Summary;
+    }
+
     bool NewDoubleLockDetector::runOnModule(Module &M) {
         this->pModule = &M;
 
-        std::map<Instruction *, Function *> mapCallInstCallee;
+        CallGraphIndex CG(M);
         std::map<Instruction *, stLockInfo> mapLockInfo;
         std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> mapLockDropInfo;
+        GuardLifetime GL(M.getDataLayout());
+
+        // With -rbd-cache, the drop sites of unchanged functions are loaded instead of tracked again.
+        std::string CachePath = getSummaryCacheFile(M);
+        SummaryCache Cache(getSummaryDB().hash());
+        std::map<Function *, uint64_t> mapFuncHash;
+        std::map<Instruction *, std::set<Instruction *>> mapCachedDrop;
+        if (!CachePath.empty()) {
+            Cache.load(CachePath, errs());
+            for (Function &F : M) {
+                if (F.isDeclaration()) {
+                    continue;
+                }
+                uint64_t Hash = hashFunction(F);
+                mapFuncHash[&F] = Hash;
+                if (const FuncSummary *Cached = Cache.lookup(Hash)) {
+                    loadCachedDrops(F, *Cached, mapCachedDrop);
+                }
+            }
+        }
 
-        for (Function &F: M) {
-            parseFunc(&F, mapCallInstCallee, mapLockInfo, mapLockDropInfo);
+        if (UseListDiscovery) {
+            parseModuleByUses(M, CG, mapLockInfo, mapLockDropInfo, mapCachedDrop, GL);
+        } else {
+            for (Function &F: M) {
+                parseFunc(&F, CG, mapLockInfo, mapLockDropInfo, mapCachedDrop, GL);
+            }
         }
 
         std::map<Type *, std::map<Instruction *, stLockInfo>> mapMayAliasLock;
         for (auto &InstLI: mapLockInfo) {
             Type *Ty = InstLI.second.LockValue->getType();
             if (!Ty) {
-                errs() << "Cannot get Type of LockValue of Inst\n";
-                printDebugInfo(InstLI.first);
+                LLVM_DEBUG(dbgs() << "Cannot get Type of LockValue of Inst\n"; printDebugInfo(InstLI.first, dbgs()));
                 continue;
             }
             mapMayAliasLock[Ty][InstLI.first] = InstLI.second;
@@ -1006,34 +1186,161 @@ namespace detector {
 //            }
 //        }
 
-        std::map<Function *, std::map<Instruction *, Function *>> mapCallerCallee;
-        for (auto &CallInstCallee : mapCallInstCallee) {
-            Instruction *CI = CallInstCallee.first;
-            Function *F = CallInstCallee.second;
-            Function *Caller = CI->getParent()->getParent();
-            mapCallerCallee[Caller][CI] = F;
+        // Candidates of the indirect calls of the local crate, after every direct call site.
+        IndirectCallIndex Indirect(M);
+        for (Instruction *I : Indirect.indirectCalls()) {
+            if (skipInst(I) || !isLocalCrateInst(I)) {
+                continue;
+            }
+            for (Function *Target : Indirect.getTargets(I)) {
+                if (!Target->isDeclaration()) {
+                    CG.addIndirectCall(I, Target);
+                }
+            }
         }
-
+        CG.build();
+
+        // Bottom-up lock summaries over the same call graph the per-lock search uses.
+        SummaryIds Ids;
+        LockSummary Summary;
+        for (unsigned Site = 0; Site < CG.getNumCallSites(); ++Site) {
+            Summary.addCall(getFuncId(Ids, CG.getCaller(Site)), getFuncId(Ids, CG.getCallee(Site)),
+                            getInstId(Ids, CG.getCallInst(Site)));
+        }
+        std::map<Type *, unsigned> mapTypeBucket;
         for (auto &TyResult: mapMayAliasLock) {
+            unsigned Bucket = mapTypeBucket.size();
+            mapTypeBucket[TyResult.first] = Bucket;
             for (auto &InstLI : TyResult.second) {
                 Instruction *LockInst = InstLI.first;
-                std::set<Instruction *> setMayAliasLock;
-                for (auto &OtherInstLI : TyResult.second) {
-                    if (OtherInstLI.first != LockInst) {
-                        setMayAliasLock.insert(OtherInstLI.first);
-                    }
+                Summary.addLock(getFuncId(Ids, LockInst->getParent()->getParent()), Bucket,
+                                getInstId(Ids, LockInst));
+            }
+        }
+        Summary.build();
+
+        // Functions are independent; each one may be checked on a worker thread.
+        std::map<Function *, unsigned> mapFuncLocks;
+        std::vector<FuncLocks> vecFuncLocks;
+        for (Function &F : M) {
+            for (Instruction &I : instructions(F)) {
+                auto itLock = mapLockInfo.find(&I);
+                if (itLock == mapLockInfo.end()) {
+                    continue;
+                }
+                auto itBucket = mapTypeBucket.find(itLock->second.LockValue->getType());
+                if (itBucket == mapTypeBucket.end()) {
+                    continue;
                 }
+                auto itFunc = mapFuncLocks.find(&F);
+                if (itFunc == mapFuncLocks.end()) {
+                    itFunc = mapFuncLocks.insert(std::make_pair(&F, vecFuncLocks.size())).first;
+                    FuncLocks FL;
+                    FL.F = &F;
+                    vecFuncLocks.push_back(FL);
+                }
+                vecFuncLocks[itFunc->second].vecLock.push_back(&I);
+                vecFuncLocks[itFunc->second].vecBucket.push_back(itBucket->second);
+            }
+        }
+        // A function is not checked again when neither it nor anything it reaches has changed.
+        std::vector<uint64_t> vecDeepHash(vecFuncLocks.size(), 0);
+        std::vector<const FuncSummary *> vecCached(vecFuncLocks.size(), nullptr);
+        if (!CachePath.empty()) {
+            for (unsigned Func = 0; Func < vecFuncLocks.size(); ++Func) {
+                Function *F = vecFuncLocks[Func].F;
+                vecDeepHash[Func] = hashReachableFuncs(F, CG, mapFuncHash);
+                const FuncSummary *Cached = Cache.lookup(mapFuncHash[F]);
+                if (Cached && Cached->Complete && Cached->DeepHash == vecDeepHash[Func]) {
+                    vecCached[Func] = Cached;
+                }
+            }
+        }
 
-                std::set<Instruction *> setLockDrop;
-                if (mapLockDropInfo.find(LockInst) != mapLockDropInfo.end()) {
-                    for (Instruction *DropInst : mapLockDropInfo[LockInst].second) {
-                        setLockDrop.insert(DropInst);
+        Deadline RunDeadline;
+        std::vector<std::vector<TruncatedSearch>> vecFuncTruncated(vecFuncLocks.size());
+        std::vector<std::vector<Finding>> vecFuncFinding(vecFuncLocks.size());
+        std::vector<Function *> vecCheckFunc;
+        for (unsigned Func = 0; Func < vecFuncLocks.size(); ++Func) {
+            if (vecCached[Func]) {
+                vecFuncFinding[Func] = vecCached[Func]->vecFinding;
+            } else {
+                vecCheckFunc.push_back(vecFuncLocks[Func].F);
+            }
+        }
+
+        // Equivalent monomorphizations are solved once, on the first function of their class.
+        std::vector<std::vector<Function *>> vecClass;
+        if (GroupEquivalentFuncs) {
+            vecClass = FunctionGroups(vecCheckFunc).classes();
+        } else {
+            for (Function *F : vecCheckFunc) {
+                vecClass.push_back(std::vector<Function *>(1, F));
+            }
+        }
+        LLVM_DEBUG(dbgs() << "Solving " << vecClass.size() << " of " << vecCheckFunc.size() << " functions\n");
+
+        runOrderedTasks(vecClass.size(), NumThreads, [&](unsigned Class, raw_ostream &) {
+            const std::vector<Function *> &vecMember = vecClass[Class];
+            unsigned RepFunc = mapFuncLocks.find(vecMember.front())->second;
+            const FuncLocks &Rep = vecFuncLocks[RepFunc];
+            ExplorationBudget Budget(RunDeadline);
+            SolvedLocks RepSolved;
+            solveFunction(Rep, mapLockDropInfo, CG, Summary, Ids, Budget, RepSolved);
+            bool Complete = !Budget.isTruncated();
+            reportConflicts(Rep, RepSolved, CG, Summary, Ids, Budget, vecFuncFinding[RepFunc]);
+            recordTruncation(Rep.vecLock.front(), Budget, vecFuncTruncated[RepFunc]);
+
+            for (unsigned M = 1; M < vecMember.size(); ++M) {
+                unsigned Func = mapFuncLocks.find(vecMember[M])->second;
+                const FuncLocks &FL = vecFuncLocks[Func];
+                ExplorationBudget MemberBudget(RunDeadline);
+                std::map<Instruction *, Instruction *> mapInst;
+                if (!Complete || !FunctionGroups::mapInstructions(*Rep.F, *FL.F, mapInst)
+                    || !sameLockProblem(Rep, FL, mapInst, mapLockDropInfo, CG, Summary, Ids)) {
+                    checkFunction(FL, mapLockDropInfo, CG, Summary, Ids, MemberBudget, vecFuncFinding[Func]);
+                } else {
+                    // The conflicts of Rep, at the paired sites of FL. Call chains start from FL's own calls.
+                    SolvedLocks Solved;
+                    Solved.vecConflict = RepSolved.vecConflict;
+                    for (Instruction *I : RepSolved.vecSite) {
+                        Solved.vecSite.push_back(mapInst.find(I)->second);
                     }
+                    // sameLockProblem checked that the paired sites have the same callees.
+                    Solved.vecSiteCallee = RepSolved.vecSiteCallee;
+                    assert(Solved.vecSite.size() == Solved.vecSiteCallee.size() && "Site without its callee");
+                    reportConflicts(FL, Solved, CG, Summary, Ids, MemberBudget, vecFuncFinding[Func]);
                 }
-
-                trackLockInst(LockInst, setMayAliasLock, setLockDrop, mapCallerCallee);
+                recordTruncation(FL.vecLock.front(), MemberBudget, vecFuncTruncated[Func]);
             }
+        }, errs());
+
+        if (!CachePath.empty()) {
+            // Only the functions of this run are kept, so the file does not grow with stale bodies.
+            SummaryCache NewCache(getSummaryDB().hash());
+            for (unsigned Func = 0; Func < vecFuncLocks.size(); ++Func) {
+                const FuncLocks &FL = vecFuncLocks[Func];
+                NewCache.insert(makeFuncSummary(FL, mapFuncHash[FL.F], vecDeepHash[Func], mapLockDropInfo,
+                                                vecFuncTruncated[Func].empty(), vecFuncFinding[Func]));
+            }
+            NewCache.save(CachePath, errs());
+        }
+
+        // Merged in function order, so the report does not depend on -rbd-threads.
+        ReportCollector LocalReports;
+        ReportCollector &Reports = pReports ? *pReports : LocalReports;
+        for (std::vector<Finding> &vecFinding : vecFuncFinding) {
+            Reports.add(vecFinding);
+        }
+        if (!pReports) {
+            Reports.write("NewDoubleLockDetector");
+        }
+
+        std::vector<TruncatedSearch> vecTruncated;
+        for (std::vector<TruncatedSearch> &vecFunc : vecFuncTruncated) {
+            vecTruncated.insert(vecTruncated.end(), vecFunc.begin(), vecFunc.end());
         }
+        printTruncationSummary(vecTruncated, errs());
 
         return false;
     }
@@ -0,0 +1,229 @@
+#include "NewDoubleLockDetector/SnapshotDoubleLock.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/BitVector.h"
+
+#include "Common/Budget.h"
+#include "Common/LockDataflow.h"
+#include "Common/LockSummary.h"
+#include "Common/Options.h"
+#include "Common/Parallel.h"
+
+using namespace llvm;
+
+namespace detector {
+
+    namespace {
+    // Locks of one function, in site order. Buckets are snapshot type ids.
+    struct FuncLocks {
+        uint32_t Func;
+        std::vector<uint32_t> vecLock;
+        std::vector<unsigned> vecBucket;
+    };
+
+    // The lock sites and the call graph NewDoubleLockDetector keeps from parseCallSite.
+    // Sites, functions and buckets keep their snapshot ids.
+    struct LockFacts {
+        std::vector<uint32_t> vecCallee;  // per site, NoSnapshotId when it is not a call edge
+        LockSummary Summary;
+        std::vector<FuncLocks> vecFuncLocks;
+    };
+    }  // namespace
+
+    // Same test as isLocalCrateInst: library code has no directory.
+    static bool isLocalCrateSite(const Snapshot &S, const SnapshotSite &Site) {
+        return Site.Loc != NoSnapshotId && !S.getString(S.locs()[Site.Loc].Directory).empty();
+    }
+
+    static void collectLockFacts(const Snapshot &S, LockFacts &Facts) {
+        ArrayRef<SnapshotSite> Sites = S.sites();
+        Facts.vecCallee.assign(Sites.size(), NoSnapshotId);
+        std::vector<uint32_t> vecCallSite;
+        std::vector<uint32_t> vecIndirectSite;
+        std::vector<std::pair<uint32_t, uint32_t>> vecBucketLock;
+        std::map<uint32_t, unsigned> mapFuncLocks;
+        for (uint32_t Site = 0; Site < Sites.size(); ++Site) {
+            const SnapshotSite &SS = Sites[Site];
+            if ((SS.Flags & SiteIndirect) && (S.funcs()[SS.Callee].Flags & FuncDefined)
+                && isLocalCrateSite(S, SS)) {
+                Facts.vecCallee[Site] = SS.Callee;
+                vecIndirectSite.push_back(Site);
+                continue;
+            }
+            if (!(SS.Flags & SiteCall) || !(S.funcs()[SS.Callee].Flags & FuncDefined)
+                || !isLocalCrateSite(S, SS)) {
+                continue;
+            }
+            if (!(SS.Flags & SiteLock)) {
+                Facts.vecCallee[Site] = SS.Callee;
+                vecCallSite.push_back(Site);
+                continue;
+            }
+            if (SS.LockType == NoSnapshotId) {
+                continue;
+            }
+            vecBucketLock.push_back(std::make_pair(SS.LockType, Site));
+            auto itFunc = mapFuncLocks.find(SS.Func);
+            if (itFunc == mapFuncLocks.end()) {
+                itFunc = mapFuncLocks.insert(std::make_pair(SS.Func, Facts.vecFuncLocks.size())).first;
+                FuncLocks FL;
+                FL.Func = SS.Func;
+                Facts.vecFuncLocks.push_back(FL);
+            }
+            Facts.vecFuncLocks[itFunc->second].vecLock.push_back(Site);
+            Facts.vecFuncLocks[itFunc->second].vecBucket.push_back(SS.LockType);
+        }
+
+        // Call edges by callee, as the use-list discovery of the detector adds them.
+        std::stable_sort(vecCallSite.begin(), vecCallSite.end(), [&](uint32_t A, uint32_t B) {
+            return Sites[A].Callee < Sites[B].Callee;
+        });
+        // Indirect call candidates after them, in site order.
+        vecCallSite.insert(vecCallSite.end(), vecIndirectSite.begin(), vecIndirectSite.end());
+        for (uint32_t Site : vecCallSite) {
+            Facts.Summary.addCall(Sites[Site].Func, Sites[Site].Callee, Site);
+        }
+        std::sort(vecBucketLock.begin(), vecBucketLock.end());
+        for (const std::pair<uint32_t, uint32_t> &BucketLock : vecBucketLock) {
+            Facts.Summary.addLock(Sites[BucketLock.second].Func, BucketLock.first, BucketLock.second);
+        }
+        Facts.Summary.build();
+    }
+
+    static Finding makeFinding(const Snapshot &S, uint32_t FirstLock,
+                               const std::vector<uint32_t> &vecSecondLock,
+                               const std::vector<uint32_t> &vecCallChain) {
+        Finding F;
+        F.Kind = FindingKind::DoubleLock;
+        F.FirstLock = S.makeReportSite(FirstLock);
+        for (uint32_t Site : vecSecondLock) {
+            F.SecondLocks.push_back(S.makeReportSite(Site));
+        }
+        for (uint32_t Site : vecCallChain) {
+            F.CallChain.push_back(S.makeReportSite(Site));
+        }
+        return F;
+    }
+
+    // checkFunction of NewDoubleLockDetector over the stored CFG of FL.Func.
+    static void checkFunction(const Snapshot &S, const FuncLocks &FL, const LockFacts &Facts,
+                              ExplorationBudget &Budget, std::vector<Finding> &vecFinding) {
+        const SnapshotFunc &F = S.funcs()[FL.Func];
+        unsigned NumLocks = FL.vecLock.size();
+        std::map<uint32_t, unsigned> mapLockLocal;
+        std::map<uint32_t, BitVector> mapDropLocks;
+        for (unsigned L = 0; L < NumLocks; ++L) {
+            mapLockLocal[FL.vecLock[L]] = L;
+            for (uint32_t DropSite : S.edgesOf(S.sites()[FL.vecLock[L]])) {
+                BitVector &Drops = mapDropLocks[DropSite];
+                Drops.resize(NumLocks);
+                Drops.set(L);
+            }
+        }
+
+        ArrayRef<SnapshotBlock> Blocks = S.blocksOf(F);
+        ArrayRef<uint32_t> RPO = S.rpoOf(F);
+        std::vector<unsigned> vecRPOIndex(Blocks.size(), 0);
+        for (unsigned B = 0; B < RPO.size(); ++B) {
+            vecRPOIndex[RPO[B]] = B;
+        }
+
+        // Event sites are indices into vecSite.
+        std::vector<uint32_t> vecSite;
+        LockDataflow Dataflow(NumLocks, RPO.size());
+        for (unsigned B = 0; B < RPO.size(); ++B) {
+            const SnapshotBlock &SB = Blocks[RPO[B]];
+            for (uint32_t Succ : S.succsOf(SB)) {
+                Dataflow.addEdge(B, vecRPOIndex[Succ]);
+            }
+            for (uint32_t Site = SB.FirstSite; Site < SB.FirstSite + SB.NumSites; ++Site) {
+                auto itLock = mapLockLocal.find(Site);
+                if (itLock != mapLockLocal.end()) {
+                    unsigned Lock = itLock->second;
+                    BitVector Check(NumLocks);
+                    for (unsigned L = 0; L < NumLocks; ++L) {
+                        if (L != Lock && FL.vecBucket[L] == FL.vecBucket[Lock]) {
+                            Check.set(L);
+                        }
+                    }
+                    Dataflow.addLock(B, vecSite.size(), Lock, Check);
+                    vecSite.push_back(Site);
+                    continue;
+                }
+                BitVector Kill(NumLocks);
+                auto itDrop = mapDropLocks.find(Site);
+                if (itDrop != mapDropLocks.end()) {
+                    Kill = itDrop->second;
+                }
+                BitVector Check(NumLocks);
+                uint32_t Callee = Facts.vecCallee[Site];
+                if (Callee != NoSnapshotId) {
+                    for (unsigned L = 0; L < NumLocks; ++L) {
+                        if (Facts.Summary.mayAcquire(Callee, FL.vecBucket[L], FL.vecLock[L])) {
+                            Check.set(L);
+                        }
+                    }
+                }
+                if (Kill.any() || Check.any()) {
+                    Dataflow.addKill(B, vecSite.size(), Kill, Check);
+                    vecSite.push_back(Site);
+                }
+            }
+        }
+
+        Dataflow.solve(Budget);
+
+        std::vector<LockDataflow::Conflict> vecConflict;
+        Dataflow.collectConflicts(vecConflict);
+        for (LockDataflow::Conflict &C : vecConflict) {
+            uint32_t LockSite = FL.vecLock[C.Lock];
+            uint32_t Site = vecSite[C.Site];
+            if (C.GenLock != LockDataflow::NoLock) {
+                vecFinding.push_back(makeFinding(S, LockSite, std::vector<uint32_t>(1, Site),
+                                                 std::vector<uint32_t>()));
+                continue;
+            }
+            if (!Budget.takeCallee()) {
+                break;
+            }
+            std::vector<uint32_t> CallChain;
+            unsigned WitnessFunc = 0;
+            std::vector<uint32_t> SecondLocks;
+            if (!Facts.Summary.findWitness(Facts.vecCallee[Site], FL.vecBucket[C.Lock], LockSite,
+                                           CallChain, WitnessFunc, SecondLocks)) {
+                continue;
+            }
+            CallChain.insert(CallChain.begin(), Site);
+            vecFinding.push_back(makeFinding(S, LockSite, SecondLocks, CallChain));
+        }
+    }
+
+    void detectDoubleLocks(const Snapshot &S, ReportCollector &Reports) {
+        LockFacts Facts;
+        collectLockFacts(S, Facts);
+
+        Deadline RunDeadline;
+        std::vector<std::vector<TruncatedSearch>> vecFuncTruncated(Facts.vecFuncLocks.size());
+        std::vector<std::vector<Finding>> vecFuncFinding(Facts.vecFuncLocks.size());
+        runOrderedTasks(Facts.vecFuncLocks.size(), NumThreads, [&](unsigned Func, raw_ostream &) {
+            const FuncLocks &FL = Facts.vecFuncLocks[Func];
+            ExplorationBudget Budget(RunDeadline);
+            checkFunction(S, FL, Facts, Budget, vecFuncFinding[Func]);
+            if (Budget.isTruncated()) {
+                recordTruncation(S.makeReportSite(FL.vecLock.front()), Budget, vecFuncTruncated[Func]);
+            }
+        }, errs());
+
+        for (std::vector<Finding> &vecFinding : vecFuncFinding) {
+            Reports.add(vecFinding);
+        }
+        std::vector<TruncatedSearch> vecTruncated;
+        for (std::vector<TruncatedSearch> &vecFunc : vecFuncTruncated) {
+            vecTruncated.insert(vecTruncated.end(), vecFunc.begin(), vecFunc.end());
+        }
+        printTruncationSummary(vecTruncated, errs());
+    }
+}
@@ -14,10 +14,12 @@
 #include "llvm/Analysis/CaptureTracking.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Operator.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/TypeName.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Argument.h"
 
+#include "Common/CallGraphIndex.h"
 #include "Common/CallerFunc.h"
 
 #define DEBUG_TYPE "UseAfterFreeDetector"
@@ -45,51 +47,6 @@ namespace detector {
         AU.addRequired<LoopInfoWrapperPass>();
     }
 
-    std::set<Loop *> LoopSet; /*Set storing loop and subloop */
-
-    void getSubLoopSet(Loop *lp) {
-
-        std::vector<Loop *> workList;
-        if (lp != NULL) {
-            workList.push_back(lp);
-        }
-
-        while (workList.size() != 0) {
-
-            Loop *loop = workList.back();
-            LoopSet.insert(loop);
-            workList.pop_back();
-
-            if (loop != nullptr && !loop->empty()) {
-
-                std::vector<Loop *> &subloopVect = lp->getSubLoopsVector();
-                if (subloopVect.size() != 0) {
-                    for (std::vector<Loop *>::const_iterator SI = subloopVect.begin(); SI != subloopVect.end(); SI++) {
-                        if (*SI != NULL) {
-                            if (LoopSet.find(*SI) == LoopSet.end()) {
-                                workList.push_back(*SI);
-                            }
-                        }
-                    }
-
-                }
-            }
-        }
-    }
-
-    void getLoopSet(Loop *lp) {
-        if (lp != NULL && lp->getHeader() != NULL && !lp->empty()) {
-            LoopSet.insert(lp);
-            const std::vector<Loop *> &subloopVect = lp->getSubLoops();
-            if (!subloopVect.empty()) {
-                for (std::vector<Loop *>::const_iterator subli = subloopVect.begin(); subli != subloopVect.end(); subli++) {
-                    Loop *subloop = *subli;
-                    getLoopSet(subloop);
-                }
-            }
-        }
-    }
-
     static bool isStoreToGlobal(Instruction *UseInst) {
         if (StoreInst *SI = dyn_cast<StoreInst>(UseInst)) {
             if (GEPOperator *GEP = dyn_cast<GEPOperator>(SI->getPointerOperand())) {
@@ -243,12 +200,10 @@ namespace detector {
         errs() << "In Function: " << DropFunc->getName() << "\n";
         printDebugInfo(DropInst);
         errs() << "DropBB: " << DropBB->getName() << "\n";
-        DropInst->print(errs());
-        errs() << "\n";
+        LLVM_DEBUG(DropInst->print(dbgs()); dbgs() << "\n");
         printDebugInfo(UseAfterDrop);
         errs() << "UseBB: " << UseBB->getName() << "\n";
-        UseAfterDrop->print(errs());
-        errs() << "\n";
+        LLVM_DEBUG(UseAfterDrop->print(dbgs()); dbgs() << "\n");
         return true;
     }
 
@@ -351,14 +306,13 @@ namespace detector {
         Function *F = B->getParent();
         errs() << "In Function: " << F->getName() << "\n";
         errs() << "In BB: " << B->getName() << "\n";
-        I->print(errs());
-        errs() << "\n";
+        LLVM_DEBUG(I->print(dbgs()); dbgs() << "\n");
         return printDebugInfo(I);
     }
 
     bool NewUseAfterFreeDetector::runOnModule(llvm::Module &M) {
 
-        std::map<Function *, std::map<Instruction *, Function *>> mapCallerCallee;
+        CallGraphIndex CG(M);
 
         for (Function &F : M) {
             if (F.begin() == F.end()) {
@@ -371,7 +325,7 @@ namespace detector {
                         CallSite CS(&I);
                         if (Value *CV = CS.getCalledValue()) {
                             if (Function *Callee = dyn_cast<Function>(CV->stripPointerCasts())) {
-                                mapCallerCallee[&F][&I] = Callee;
+                                CG.addCall(&I, Callee);
                             } else {
                                 printErrMsg(&I, "Callee Not Found:");
                             }
@@ -383,18 +337,23 @@ namespace detector {
             }
         }
 
-        for (auto &kv : mapCallerCallee) {
+        CG.build();
+
+        for (Function &F : M) {
+            ArrayRef<unsigned> CallSites = CG.callSitesIn(&F);
+            if (CallSites.empty()) {
+                continue;
+            }
             bool ContainsNonEmptyFunc = false;
-            for (auto &kv2 : kv.second) {
-                if (kv2.second->begin() != kv2.second->end()) {
+            for (unsigned Site : CallSites) {
+                if (!CG.getCallee(Site)->empty()) {
                     ContainsNonEmptyFunc = true;
                     break;
                 }
             }
             if (!ContainsNonEmptyFunc) {
-                if (isPtrInPtrOutFunc(kv.first)) {
-                    kv.first->getType()->getContainedType(0)->print(errs());
-                    errs() << "\n";
+                if (isPtrInPtrOutFunc(&F)) {
+                    LLVM_DEBUG(F.getType()->getContainedType(0)->print(dbgs()); dbgs() << "\n");
                 }
             }
         }
@@ -402,52 +361,6 @@ namespace detector {
         return false;
     }
 
-//    bool NewUseAfterFreeDetector::runOnModule(llvm::Module &M) {
-//        for (Function &F : M) {
-//            if (F.begin() == F.end()) {
-//                continue;
-//            }
-//
-//            std::set<Instruction *> setDropInst;
-//            collectDropInsts(&F, setDropInst);
-////            errs() << F.getName() << "\n";
-////            for (Instruction *I : setDropInst) {
-////                I->print(errs());
-////                errs() << "\n";
-////            }
-//            LoopSet.clear();
-//            LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
-//            if (!LI.empty()) {
-//                for (Loop *L : LI) {
-//                    getSubLoopSet(L);
-//                }
-//            }
-//
-//            std::set<BasicBlock *> setBackEdge;
-//            for (Loop *L : LoopSet) {
-//                BasicBlock *IncomingEdge = nullptr;
-//                BasicBlock *BackEdge = nullptr;
-//                L->getIncomingAndBackEdge(IncomingEdge, BackEdge);
-//                if (BackEdge) {
-//                    setBackEdge.insert(BackEdge);
-//                }
-//            }
-//
-////            if (!setBackEdge.empty()) {
-////                errs() << "Function:\n";
-////                errs() << (*setBackEdge.begin())->getParent()->getName() << "\n";
-////                errs() << "BackEdge:\n";
-////                for (BasicBlock *B : setBackEdge) {
-////                    errs() << B->getName() << "\n";
-////                }
-////                errs() << "End of BackEdge:\n";
-////            }
-//
-//            trackDropDataDep(setDropInst, setBackEdge);
-//        }
-//        return false;
-//    }
-
 }  // namespace detector
 
 static RegisterPass<detector::NewUseAfterFreeDetector> X(
@@ -10,8 +10,10 @@
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/Debug.h"
 
 #include "Common/CallerFunc.h"
+#include "Common/GuardLifetime.h"
 
 #define DEBUG_TYPE "PrintManualDrop"
 
@@ -80,11 +82,13 @@ namespace detector {
         return false;
     }
 
+    namespace {
     struct stLockInfo {
         Instruction *LockInst;
         Value *ReturnValue;
         Value *LockValue;
     };
+    }  // namespace
 
     static bool parseLockInst(Instruction *LockInst, stLockInfo &LockInfo) {
         if (!LockInst) {
@@ -98,9 +102,7 @@ namespace detector {
                 LockInfo.LockValue = CS.getArgOperand(1);
                 return true;
             } else {
-                errs() << "Void-return Lock\n";
-                LockInst->print(errs());
-                errs() << "\n";
+                LLVM_DEBUG(dbgs() << "Void-return Lock\n"; LockInst->print(dbgs()); dbgs() << "\n");
                 return false;
             }
         } else {  // Non-mutex
@@ -109,80 +111,17 @@ namespace detector {
                 LockInfo.LockValue = CS.getArgOperand(0);
                 return true;
             } else {
-                errs() << "Non-parameter Lock\n";
-                LockInst->print(errs());
-                errs() << "\n";
+                LLVM_DEBUG(dbgs() << "Non-parameter Lock\n"; LockInst->print(dbgs()); dbgs() << "\n");
                 return false;
             }
         }
     }
 
-    static bool isDropInst(Instruction *NI) {
-        if (isCallOrInvokeInst(NI)) {
-            CallSite CS;
-            if (Function *F = getCalledFunc(NI, CS)) {
-                if (F->getName().startswith("_ZN4core3mem4drop")) {
-                    return true;
-                }
-            }
-        }
-        return false;
-    }
-
-    static bool trackDownToDropInsts(Instruction *RI, std::set<Instruction *> &setDropInst) {
-        if (!RI) {
-            return false;
-        }
-        setDropInst.clear();
-
-        std::list<Instruction *> WorkList;
-        std::set<Instruction *> Visited;
-        WorkList.push_back(RI);
-        bool Stop = false;
-        while (!WorkList.empty() && !Stop) {
-            Instruction *Curr = WorkList.front();
-            WorkList.pop_front();
-            for (User *U: Curr->users()) {
-                if (Instruction *UI = dyn_cast<Instruction>(U)) {
-                    if (Visited.find(UI) == Visited.end()) {
-                        if (isDropInst(UI)) {
-//                            UI->print(errs());
-//                            errs() << '\n';
-                            setDropInst.insert(UI);
-                            Value *V = UI->getOperand(0);
-                            assert(V);
-                            for (User *UV: V->users()) {
-                                if (Instruction *UVI = dyn_cast<Instruction>(UV)) {
-                                    if (Visited.find(UVI) == Visited.end()) {
-                                        if (isDropInst(UVI)) {
-                                            setDropInst.insert(UVI);
-                                        }
-                                    }
-                                }
-                            }
-                            return true;
-                        } else if (StoreInst *SI = dyn_cast<StoreInst>(UI)) {
-                            if (Instruction *Dest = dyn_cast<Instruction>(SI->getPointerOperand())) {
-                                WorkList.push_back(Dest);
-                            } else {
-                                errs() << "StoreInst Dest is not a Inst\n";
-                                printDebugInfo(Curr);
-                            }
-                        } else {
-                            WorkList.push_back(UI);
-                        }
-                        Visited.insert(UI);
-                    }
-                }
-            }
-        }
-        return false;
-    }
-
     static bool parseFunc(Function *F,
                           std::map<Instruction *, Function *> &mapCallInstCallee,
                           std::map<Instruction *, stLockInfo> &mapLockInfo,
-                          std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo) {
+                          std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo,
+                          GuardLifetime &GL) {
         if (!F || F->isDeclaration()) {
             return false;
         }
@@ -204,14 +143,15 @@ namespace detector {
                                 }
                                 Instruction *RI = dyn_cast<Instruction>(LockInfo.ReturnValue);
                                 if (!RI) {
-                                    errs() << "Return Value is not Inst\n";
-                                    LockInfo.ReturnValue->print(errs());
-                                    errs() << '\n';
+                                    LLVM_DEBUG(dbgs() << "Return Value is not Inst\n"; LockInfo.ReturnValue->print(dbgs());
+                                               dbgs() << '\n');
                                     continue;
                                 }
                                 mapLockInfo[I] = LockInfo;
+                                bool Wrapped = Callee->getName().startswith("_ZN3std4sync");
                                 std::set<Instruction *> setDropInst;
-                                if (trackDownToDropInsts(RI, setDropInst)) {
+                                GL.collectDestInsts(RI, Wrapped, GuardLifetime::ManualDrop, setDropInst);
+                                if (!setDropInst.empty()) {
                                     mapLockDropInfo[I] = std::make_pair(Callee, setDropInst);
                                     // Debug
                                     errs() << "Manual Drop Info:\n";
@@ -248,12 +188,13 @@ namespace detector {
     bool PrintManualDrop::runOnModule(Module &M) {
         this->pModule = &M;
 
+        GuardLifetime GL(M.getDataLayout());
         for (Function &F: M) {
             if (F.begin() != F.end()) {
                 std::map<Instruction *, Function *> mapCallInstCallee;
                 std::map<Instruction *, stLockInfo> mapLockInfo;
                 std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> mapLockDropInfo;
-                parseFunc(&F, mapCallInstCallee, mapLockInfo, mapLockDropInfo);
+                parseFunc(&F, mapCallInstCallee, mapLockInfo, mapLockDropInfo, GL);
             }
         }
         return false;
@@ -1,5 +1,6 @@
 #include "RustDoubleLockDetector/RustDoubleLockDetector.h"
 
+#include <algorithm>
 #include <set>
 #include <stack>
 #include <unordered_map>
@@ -13,8 +14,16 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Operator.h"
+#include "llvm/Support/Debug.h"
 
+#include "Common/Budget.h"
+#include "Common/CallGraphIndex.h"
 #include "Common/CallerFunc.h"
+#include "Common/GuardLifetime.h"
+#include "Common/IndirectCallIndex.h"
+#include "Common/LockBucketIndex.h"
+#include "Common/Report.h"
+#include "Common/SummaryDB.h"
 
 #define DEBUG_TYPE "RustDoubleLockDetector"
 
@@ -24,7 +33,7 @@ namespace detector {
 
     char RustDoubleLockDetector::ID = 0;
 
-    RustDoubleLockDetector::RustDoubleLockDetector() : ModulePass(ID) {
+    RustDoubleLockDetector::RustDoubleLockDetector(ReportCollector *Reports) : ModulePass(ID), pReports(Reports) {
         PassRegistry &Registry = *PassRegistry::getPassRegistry();
         initializeAAResultsWrapperPassPass(Registry);
     }
@@ -65,7 +74,7 @@ namespace detector {
 
     static bool collectGlobalCallSite(
             Function *F,  // Input
-            std::map<Instruction *, Function *> &mapCallSite  // Output
+            CallGraphIndex &CG  // Output
     ) {
         if (!F || F->isDeclaration()) {
             return false;
@@ -79,7 +88,7 @@ namespace detector {
                 if (isCallOrInvokeInst(I)) {
                     CallSite CS;
                     if (Function *Callee = getCalledFunc(I, CS)) {
-                        mapCallSite[I] = Callee;
+                        CG.addCall(I, Callee);
                     }
                 }
             }
@@ -130,22 +139,7 @@ namespace detector {
         return FuncName.startswith("_ZN3std4sync6rwlock15RwLock$LT$T$GT$5write17h");
     }
 
-    static bool isAutoDropAPI(StringRef FuncName) {
-        return FuncName.startswith("_ZN4core3ptr18real_drop_in_place17h");
-    }
-
-    static bool isManualDropAPI(StringRef FuncName) {
-        return FuncName.startswith("_ZN4core3mem4drop17h");
-    }
-
-    static bool isResultToInnerAPI(StringRef FuncName) {
-        return FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6unwrap17h")
-               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$9unwrap_or17h")
-               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$14unwrap_or_else17h")
-               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$17unwrap_or_default17h")
-               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6expect17h");
-    }
-
+    namespace {
     struct LockInfo {
         Instruction *LockInst;
         Value *LockValue;
@@ -197,6 +191,7 @@ namespace detector {
             return hash;
         }
     };
+    }  // namespace
 
     static bool traceMutexSource(Value *mutex, MutexSource &MS) {
         assert(mutex);
@@ -209,7 +204,7 @@ namespace detector {
                 // structTy->print(errs());
                 // errs() << "\n";
                 if (!isa<StructType>(structTy)) {
-                    errs() << "Self not Struct" << "\n";
+                    LLVM_DEBUG(dbgs() << "Self not Struct" << "\n");
                     continue;
                 }
                 MS.structTy = structTy;
@@ -230,7 +225,7 @@ namespace detector {
                 // structTy->print(errs());
                 // errs() << "\n";
                 if (!isa<StructType>(structTy)) {
-                    errs() << "Self not Struct" << "\n";
+                    LLVM_DEBUG(dbgs() << "Self not Struct" << "\n");
                     continue;
                 }
                 MS.structTy = structTy;
@@ -240,209 +235,31 @@ namespace detector {
         return false;
     }
 
-    static void traceDropInstForInstruction(Instruction *Inst, std::set<Instruction *> &setDropInst) {
-        for (User *UL : Inst->users()) {
-            Instruction *I = dyn_cast<Instruction>(UL);
-            if (!I) {
-                continue;
-            }
-            if (skipInst(I)) {
-                continue;
-            }
-            if (isCallOrInvokeInst(I)) {
-                CallSite CS(I);
-                Function *F = CS.getCalledFunction();
-                if (!F) {
-                    continue;
-                }
-                if (isAutoDropAPI(F->getName())
-                    || isManualDropAPI(F->getName())) {
-                    setDropInst.insert(I);
-                }
-            }
-        }
-    }
-
-    static void traceDropInst(LockInfo &MLI, std::set<Instruction *> &setDropInst) {
-        Value *LockGuardValue = MLI.ResultValue;
-        for (User *U : LockGuardValue->users()) {
-            Instruction *I = dyn_cast<Instruction>(U);
-            if (I == MLI.LockInst) {
-                continue;
-            }
-            if (!I) {
-                continue;
-            }
-            if (skipInst(I)) {
-                continue;
-            }
-            
-            if (isCallOrInvokeInst(I)) {
-                CallSite CS(I);
-                Function *F = CS.getCalledFunction();
-                if (!F) {
-                    continue;
-                }
-                if (isAutoDropAPI(F->getName())
-                    || isManualDropAPI(F->getName())) {
-                    setDropInst.insert(I);
-                }
-            } else if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
-                for (User *UL : LI->users()) {
-                    Instruction *I = dyn_cast<Instruction>(UL);
-                    if (!I) {
-                        continue;
-                    }
-                    if (skipInst(I)) {
-                        continue;
-                    }
-                    if (isCallOrInvokeInst(I)) {
-                        CallSite CS(I);
-                        Function *F = CS.getCalledFunction();
-                        if (!F) {
-                            continue;
-                        }
-                        if (isAutoDropAPI(F->getName())
-                        || isManualDropAPI(F->getName())) {
-                            setDropInst.insert(I);
-                        }
-                    }
-                }
-            } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
-                Value *Target = SI->getPointerOperand();
-                for (User *UL : Target->users()) {
-                    Instruction *I = dyn_cast<Instruction>(UL);
-                    if (!I) {
-                        continue;
-                    }
-                    if (skipInst(I)) {
-                        continue;
-                    }
-                    if (isCallOrInvokeInst(I)) {
-                        CallSite CS(I);
-                        Function *F = CS.getCalledFunction();
-                        if (!F) {
-                            continue;
-                        }
-                        if (isAutoDropAPI(F->getName())
-                        || isManualDropAPI(F->getName())) {
-                            setDropInst.insert(I);
-                        }
-                    } else if (LoadInst *LI = dyn_cast<LoadInst>(UL)) {
-                        traceDropInstForInstruction(LI, setDropInst);
-                    }
-                }
-            }
-        }
-    }
-
-    static void traceResult(LockInfo &MLI, std::set<Instruction *> &setDropInst, const DataLayout &DL) {
-        Value *ResultValue = MLI.ResultValue;
-        for (User *U : ResultValue->users()) {
-            Instruction *I = dyn_cast<Instruction>(U);
-            if (I == MLI.LockInst) {
-                continue;
-            }
-            if (!I) {
-                continue;
-            }
-            if (skipInst(I)) {
-                continue;
-            }
-            
-            if (isCallOrInvokeInst(I)) {
-                CallSite CS(I);
-                Function *F = CS.getCalledFunction();
-                if (!F) {
-                    continue;
-                }
-                if (isAutoDropAPI(F->getName())
-                    || isManualDropAPI(F->getName())) {
-                    setDropInst.insert(I);
-                } else if (isResultToInnerAPI(F->getName())) {
-                    Value *LockGuardValue;
-                    if (F->getReturnType()->isVoidTy()) {
-                        LockGuardValue = GetUnderlyingObject(I->getOperand(0), DL);
-                    } else {
-                        LockGuardValue = I;
-                    }
-                    traceDropInst(MLI, setDropInst);
-                }
-            } else if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
-                for (User *UL : LI->users()) {
-                    Instruction *I = dyn_cast<Instruction>(UL);
-                    if (!I) {
-                        continue;
-                    }
-                    if (skipInst(I)) {
-                        continue;
-                    }
-                    if (isCallOrInvokeInst(I)) {
-                        CallSite CS(I);
-                        Function *F = CS.getCalledFunction();
-                        if (!F) {
-                            continue;
-                        }
-                        if (isAutoDropAPI(F->getName())
-                        || isManualDropAPI(F->getName())) {
-                            setDropInst.insert(I);
-                        }
-                    }
-                }
-            } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
-                Value *Target = SI->getPointerOperand();
-                for (User *UL : Target->users()) {
-                    Instruction *I = dyn_cast<Instruction>(UL);
-                    if (!I) {
-                        continue;
-                    }
-                    if (skipInst(I)) {
-                        continue;
-                    }
-                    if (isCallOrInvokeInst(I)) {
-                        CallSite CS(I);
-                        Function *F = CS.getCalledFunction();
-                        if (!F) {
-                            continue;
-                        }
-                        if (isAutoDropAPI(F->getName())
-                        || isManualDropAPI(F->getName())) {
-                            setDropInst.insert(I);
-                        }
-                    } else if (LoadInst *LI = dyn_cast<LoadInst>(UL)) {
-                        traceDropInstForInstruction(LI, setDropInst);
-                    }
-                }
-            }
-        }
-    }
-
         static bool trackCallee(Instruction *LockInst,
                             std::pair<Instruction *, Function *> &DirectCalleeSite,
-                            std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallees,
-                            std::map<Function *, std::set<Instruction *>> &mapAliasFuncLock) {
+                            const CallGraphIndex &CG,
+                            const MayAliasLocks &Alias,
+                            ExplorationBudget &Budget,
+                            std::vector<Finding> &vecFinding) {
 
         bool HasDoubleLock = false;
 
         Function *DirectCallee = DirectCalleeSite.second;
 
-        if (mapAliasFuncLock.find(DirectCallee) != mapAliasFuncLock.end()) {
+        if (Alias.hasLockIn(DirectCallee)) {
             // Restore
            HasDoubleLock = true;
-           errs() << "Double Lock Happens! First Lock:\n";
-           printDebugInfo(LockInst);
-           errs() << DirectCallee->getName() << '\n';
-           // Debug Require
-           LockInst->print(errs());
-           errs() << '\n';
-           printDebugInfo(DirectCalleeSite.first);
-           errs() << "Second Lock(s):\n";
-           for (Instruction *AliasLock : mapAliasFuncLock[DirectCallee]) {
-               printDebugInfo(AliasLock);
-               AliasLock->print(errs());
-               errs() << '\n';
-           }
-           errs() << '\n';
+           LLVM_DEBUG(LockInst->print(dbgs()); dbgs() << '\n');
+           std::vector<Instruction *> vecAliasLock;
+           Alias.getLocksIn(DirectCallee, vecAliasLock);
+           vecFinding.push_back(makeDoubleLockFinding(LockInst, vecAliasLock,
+                                                      std::vector<Instruction *>(1, DirectCalleeSite.first)));
+        }
+
+        // Summarized external code that never locks is not searched.
+        const SummaryDB &DB = getSummaryDB();
+        if (DB.stopsAt(*DirectCallee)) {
+            return HasDoubleLock;
         }
 
         std::stack<Function *> WorkList;
@@ -455,62 +272,54 @@ namespace detector {
 
         mapParentInst[DirectCallee] = DirectCalleeSite.first;
 
-        while (!WorkList.empty()) {
+        while (!WorkList.empty() && !Budget.isTruncated()) {
             Function *Curr = WorkList.top();
             WorkList.pop();
 //            errs() << Curr->getName() << '\n';
-            auto itCallerCallInst = mapCallerCallees.find(Curr);
-            if (itCallerCallInst != mapCallerCallees.end()) {
-//                errs() << "Caller Found\n";
-                std::map<Instruction *, Function *> &mapCallInstCallee = itCallerCallInst->second;
-                for (auto &CallInstCallee : mapCallInstCallee) {
-                    Instruction *CallInst = CallInstCallee.first;
-                    Function *Callee = CallInstCallee.second;
+            for (unsigned Site : CG.callSitesIn(Curr)) {
+                Instruction *CallInst = CG.getCallInst(Site);
+                Function *Callee = CG.getCallee(Site);
 //                    errs() << "Callee Found " << Callee->getName() << '\n';
-                    if (Visited.find(Callee) == Visited.end()) {
+                if (Visited.find(Callee) == Visited.end()) {
+                    if (DB.stopsAt(*Callee)) {
+                        Visited.insert(Callee);
+                        continue;
+                    }
+                    if (!Budget.takeCallee()) {
+                        break;
+                    }
 //                        errs() << "Not Visited\n";
-                        if (mapAliasFuncLock.find(Callee) != mapAliasFuncLock.end()) {
-                            // Restore
-                           errs() << "Double Lock Happens! First Lock:\n";
-                           errs() << LockInst->getParent()->getParent()->getName() << '\n';
-                           printDebugInfo(LockInst);
-                           LockInst->print(errs());
-                           errs() << '\n';
-                           errs() << Callee->getName() << '\n';
-                           errs() << "Second Lock(s):\n";
-                           for (Instruction *AliasLock : mapAliasFuncLock[Callee]) {
-                               printDebugInfo(AliasLock);
-                               LockInst->print(errs());
-                               errs() << '\n';
-                           }
-                           errs() << '\n';
-                            // backtrace print
-                            mapParentInst[Callee] = CallInst;
-                            std::set<Function *> TraceVisited;
-                            auto it = mapParentInst.find(Callee);
-                            while (it != mapParentInst.end()) {
-                                Instruction *ParentInst = it->second;
-                                printDebugInfo(ParentInst);
-                                errs() << ParentInst->getParent()->getName() << ": ";
-                                ParentInst->print(errs());
-                                errs() << '\n';
-                                Function *ParentFunc = ParentInst->getParent()->getParent();
-                                it = mapParentInst.find(ParentFunc);
-                                if (it != mapParentInst.end()) {
-                                    if (TraceVisited.find(it->first) != TraceVisited.end()) {
-                                        break;
-                                    } else {
-                                        TraceVisited.insert(it->first);
-                                    }
+                    if (Alias.hasLockIn(Callee)) {
+                        // Restore
+                       LLVM_DEBUG(LockInst->print(dbgs()); dbgs() << '\n');
+                       std::vector<Instruction *> vecAliasLock;
+                       Alias.getLocksIn(Callee, vecAliasLock);
+                        // backtrace
+                        std::vector<Instruction *> vecCallChain;
+                        mapParentInst[Callee] = CallInst;
+                        std::set<Function *> TraceVisited;
+                        auto it = mapParentInst.find(Callee);
+                        while (it != mapParentInst.end()) {
+                            Instruction *ParentInst = it->second;
+                            vecCallChain.push_back(ParentInst);
+                            Function *ParentFunc = ParentInst->getParent()->getParent();
+                            it = mapParentInst.find(ParentFunc);
+                            if (it != mapParentInst.end()) {
+                                if (TraceVisited.find(it->first) != TraceVisited.end()) {
+                                    break;
+                                } else {
+                                    TraceVisited.insert(it->first);
                                 }
                             }
-                            // end of backtrack
-                            HasDoubleLock = true;
                         }
-                        WorkList.push(Callee);
-                        mapParentInst[Callee] = CallInst;
-                        Visited.insert(Callee);
+                        // end of backtrack
+                        std::reverse(vecCallChain.begin(), vecCallChain.end());
+                        vecFinding.push_back(makeDoubleLockFinding(LockInst, vecAliasLock, vecCallChain));
+                        HasDoubleLock = true;
                     }
+                    WorkList.push(Callee);
+                    mapParentInst[Callee] = CallInst;
+                    Visited.insert(Callee);
                 }
             }
         }
@@ -519,9 +328,11 @@ namespace detector {
     }
 
     static bool trackLockInst(Instruction *LockInst,
-                              std::set<Instruction *> setMayAliasLock,
-                              std::set<Instruction *> setDrop,
-                              std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallees) {
+                              const MayAliasLocks &Alias,
+                              const std::set<Instruction *> &setDrop,
+                              const CallGraphIndex &CG,
+                              ExplorationBudget &Budget,
+                              std::vector<Finding> &vecFinding) {
 
 //        std::set<Function *> setMayAliasFunc;
 //        for (Instruction *I : setMayAliasLock) {
@@ -529,13 +340,6 @@ namespace detector {
 //                setMayAliasFunc.insert(I->getParent()->getParent());
 //            }
 //        }
-        std::map<Function *, std::set<Instruction *>> mapMayAliasFuncLock;
-        for (Instruction *I : setMayAliasLock) {
-            if (I != LockInst) {
-                Function *AliasFunc = I->getParent()->getParent();
-                mapMayAliasFuncLock[AliasFunc].insert(I);
-            }
-        }
 //        // Debug
 //        printDebugInfo(LockInst);
 //        for (Function *F : setMayAliasFunc) {
@@ -544,18 +348,12 @@ namespace detector {
         std::stack<BasicBlock *> WorkList;
         std::set<BasicBlock *> Visited;
 
-        Function *Caller = LockInst->getParent()->getParent();
-        auto &mapCallInstCallee = mapCallerCallees[Caller];
-
 //        // Debug
 //        for (auto &kv : mapCallInstCallee) {
 //            kv.first->print(errs());
 //            errs() << '\n';
 //        }
 
-        if (Caller->getName().startswith("_ZN12ethcore_sync10light_sync18LightSync$LT$L$GT$13maintain_sync17h")) {
-            return false;
-        }
         // errs() << "Begin:\n";
         // errs() << LockInst->getFunction()->getName() << "\n";
         BasicBlock *LockInstBB = LockInst->getParent();
@@ -570,6 +368,9 @@ namespace detector {
             BasicBlock *Curr = WorkList.top();
             // errs() << Curr->getName() << "\n";
             WorkList.pop();
+            if (!Budget.takeBlock()) {
+                break;
+            }
             bool StopPropagation = false;
             for (Instruction &II: *Curr) {
                 Instruction *I = &II;
@@ -577,15 +378,10 @@ namespace detector {
                     continue;
                 }
                 // contains same Lock
-                if (setMayAliasLock.find(I) != setMayAliasLock.end()) {
+                if (Alias.contains(I)) {
                     // Restore
-                   errs() << "Double Lock Happens! First Lock:\n";
-                   printDebugInfo(LockInst);
-                   errs() << "Second Lock(s):\n";
-                   printDebugInfo(I);
-                   // Debug Require
-                   // LockInst->print(errs());
-                   errs() << '\n';
+                   vecFinding.push_back(makeDoubleLockFinding(LockInst, std::vector<Instruction *>(1, I),
+                                                              std::vector<Instruction *>()));
                     StopPropagation = true;
                     // break;
                 } else if (setDrop.find(I) != setDrop.end()) {
@@ -594,19 +390,31 @@ namespace detector {
                     break;
                 } else {
                     // is a CallInst
-                    auto it = mapCallInstCallee.find(I);
-                    if (it == mapCallInstCallee.end()) {
+                    Function *Callee = CG.getCalleeOf(I);
+                    if (!Callee) {
+                        // an indirect call: track each candidate callee
+                        bool Tracked = false;
+                        for (unsigned Site : CG.indirectSitesOf(I)) {
+                            auto CalleeSite = std::make_pair(I, CG.getCallee(Site));
+                            if (trackCallee(LockInst, CalleeSite, CG, Alias, Budget, vecFinding)) {
+                                Tracked = true;
+                                break;
+                            }
+                        }
+                        if (Tracked) {
+                            StopPropagation = true;
+                            break;
+                        }
                         continue;
                     } else {
-                        Instruction *CI = it->first;
-                        Function *Callee = it->second;
+                        Instruction *CI = I;
 //                        errs() << Callee->getName() << "\n";
                         auto CalleeSite = std::make_pair(CI, Callee);
 //                        if (trackCallee(LockInst, CalleeSite, mapCallerCallees, setMayAliasFunc)) {
 //                            StopPropagation = true;
 //                            break;
 //                        }
-                        if (trackCallee(LockInst, CalleeSite, mapCallerCallees, mapMayAliasFuncLock)) {
+                        if (trackCallee(LockInst, CalleeSite, CG, Alias, Budget, vecFinding)) {
                             StopPropagation = true;
                             break;
                         }
@@ -636,8 +444,10 @@ namespace detector {
     }
 
     static bool trackLockInstLocal(Instruction *LockInst,
-                              std::set<Instruction *> setMayAliasLock,
-                              std::set<Instruction *> setDrop) {
+                              const MayAliasLocks &Alias,
+                              const std::set<Instruction *> &setDrop,
+                              ExplorationBudget &Budget,
+                              std::vector<Finding> &vecFinding) {
 
 //        std::set<Function *> setMayAliasFunc;
 //        for (Instruction *I : setMayAliasLock) {
@@ -645,13 +455,6 @@ namespace detector {
 //                setMayAliasFunc.insert(I->getParent()->getParent());
 //            }
 //        }
-        std::map<Function *, std::set<Instruction *>> mapMayAliasFuncLock;
-        for (Instruction *I : setMayAliasLock) {
-            if (I != LockInst) {
-                Function *AliasFunc = I->getParent()->getParent();
-                mapMayAliasFuncLock[AliasFunc].insert(I);
-            }
-        }
 //        // Debug
 //        printDebugInfo(LockInst);
 //        for (Function *F : setMayAliasFunc) {
@@ -668,9 +471,6 @@ namespace detector {
 //            errs() << '\n';
 //        }
 
-        if (Caller->getName().startswith("_ZN12ethcore_sync10light_sync18LightSync$LT$L$GT$13maintain_sync17h")) {
-            return false;
-        }
         // errs() << "Begin:\n";
         // errs() << LockInst->getFunction()->getName() << "\n";
         BasicBlock *LockInstBB = LockInst->getParent();
@@ -694,6 +494,9 @@ namespace detector {
             BasicBlock *Curr = WorkList.top();
             // errs() << Curr->getName() << "\n";
             WorkList.pop();
+            if (!Budget.takeBlock()) {
+                break;
+            }
             bool StopPropagation = false;
             for (Instruction &II: *Curr) {
                 Instruction *I = &II;
@@ -701,7 +504,7 @@ namespace detector {
                     continue;
                 }
                 // contains same Lock
-                if (setMayAliasLock.find(I) != setMayAliasLock.end()) {
+                if (Alias.contains(I)) {
                     if (FirstRead) {
                         CallSite CS(I);
                         Function *SecondLockFunc = CS.getCalledFunction();
@@ -713,13 +516,8 @@ namespace detector {
                         }
                     }
                     // Restore
-                   errs() << "Double Lock Happens! First Lock:\n";
-                   printDebugInfo(LockInst);
-                   errs() << "Second Lock(s):\n";
-                   printDebugInfo(I);
-                   // Debug Require
-                   // LockInst->print(errs());
-                   errs() << '\n';
+                   vecFinding.push_back(makeDoubleLockFinding(LockInst, std::vector<Instruction *>(1, I),
+                                                              std::vector<Instruction *>()));
                     StopPropagation = true;
                     // break;
                 } else if (setDrop.find(I) != setDrop.end()) {
@@ -790,46 +588,36 @@ namespace detector {
     bool RustDoubleLockDetector::runOnModule(Module &M) {
         this->pModule = &M;
 
-        std::map<Function *, std::map<Instruction *, Function *>> mapGlobalCallSite;
-        for (Function &F : M) {
-            collectGlobalCallSite(&F, mapGlobalCallSite[&F]);
-        }
+        Deadline RunDeadline;
+        GuardLifetime GL(M.getDataLayout());
+        std::vector<TruncatedSearch> vecTruncated;
+        std::vector<Finding> vecFinding;
 
-        std::map<Function *, std::set<Instruction *>> mapCalleeToCallSites;
-        for (auto &CallerCallSites : mapGlobalCallSite) {
-            for (auto &CallInstCallee : CallerCallSites.second) {
-                mapCalleeToCallSites[CallInstCallee.second].insert(CallInstCallee.first);
-            }
+        CallGraphIndex CG(M);
+        for (Function &F : M) {
+            collectGlobalCallSite(&F, CG);
         }
+        IndirectCallIndex Indirect(M);
+        addIndirectCalls(Indirect, CG);
+        CG.build();
 
         std::map<Function *, std::map<Instruction *, Function *>> mapLockAPIRwLockRead;
         std::map<Function *, std::map<Instruction *, Function *>> mapStdRead;
         std::map<Function *, std::map<Instruction *, Function *>> mapStdWrite;
         std::map<Function *, std::map<Instruction *, Function *>> mapStdLock;
-        for (auto &CallerCallSites : mapGlobalCallSite) {
-            for (auto &CallInstCallee : CallerCallSites.second) {
-                auto FuncName = CallInstCallee.second->getName();
-                if (isLockAPIRwLockRead(FuncName)) {
-                    if (mapLockAPIRwLockRead.find(CallerCallSites.first) == mapLockAPIRwLockRead.end()) {
-                        mapLockAPIRwLockRead[CallerCallSites.first] = std::map<Instruction *, Function *>();
-                    }
-                    mapLockAPIRwLockRead[CallerCallSites.first][CallInstCallee.first] = CallInstCallee.second;
-                } else if (isStdLock(FuncName)) {
-                    if (mapStdLock.find(CallerCallSites.first) == mapStdLock.end()) {
-                        mapStdLock[CallerCallSites.first] = std::map<Instruction *, Function *>();
-                    }
-                    mapStdLock[CallerCallSites.first][CallInstCallee.first] = CallInstCallee.second;
-                } else if (isStdRead(FuncName)) {
-                    if (mapStdRead.find(CallerCallSites.first) == mapStdRead.end()) {
-                        mapStdRead[CallerCallSites.first] = std::map<Instruction *, Function *>();
-                    }
-                    mapStdRead[CallerCallSites.first][CallInstCallee.first] = CallInstCallee.second;
-                } else if (isStdWrite(FuncName)) {
-                    if (mapStdWrite.find(CallerCallSites.first) == mapStdWrite.end()) {
-                        mapStdWrite[CallerCallSites.first] = std::map<Instruction *, Function *>();
-                    }
-                    mapStdWrite[CallerCallSites.first][CallInstCallee.first] = CallInstCallee.second;
-                }
+        for (unsigned Site = 0; Site < CG.getNumCallSites(); ++Site) {
+            Function *Caller = CG.getCaller(Site);
+            Instruction *CallInst = CG.getCallInst(Site);
+            Function *Callee = CG.getCallee(Site);
+            auto FuncName = Callee->getName();
+            if (isLockAPIRwLockRead(FuncName)) {
+                mapLockAPIRwLockRead[Caller][CallInst] = Callee;
+            } else if (isStdLock(FuncName)) {
+                mapStdLock[Caller][CallInst] = Callee;
+            } else if (isStdRead(FuncName)) {
+                mapStdRead[Caller][CallInst] = Callee;
+            } else if (isStdWrite(FuncName)) {
+                mapStdWrite[Caller][CallInst] = Callee;
             }
         }
 // #ifdef INTER
@@ -862,7 +650,8 @@ namespace detector {
                     mapInterProcLockInfo[MS][LI.LockInst] = LI;
                 }
                 std::set<Instruction *> setDropInst;
-                traceDropInst(LI, setDropInst);
+                GL.collectDestInsts(LI.ResultValue, false, GuardLifetime::AutoDrop | GuardLifetime::ManualDrop,
+                                    setDropInst);
                 mapLockDropInst[LI.LockInst] = setDropInst;
             }
         }
@@ -913,12 +702,15 @@ namespace detector {
                 if (TLIS.second.size() <= 1) {
                     continue;
                 }
-                std::set<Instruction *> setMayAliasLock;
+                LockBucketIndex Index;
                 for (auto &LI : TLIS.second) {
-                    setMayAliasLock.insert(LI.first);
+                    Index.addLock(LI.first);
                 }
                 for (auto &LI : TLIS.second) {
-                   trackLockInstLocal(LI.first, setMayAliasLock, mapLockDropInst[LI.first]);
+                   ExplorationBudget Budget(RunDeadline);
+                   trackLockInstLocal(LI.first, MayAliasLocks(Index, LI.first), mapLockDropInst[LI.first], Budget,
+                                      vecFinding);
+                   recordTruncation(LI.first, Budget, vecTruncated);
                 }
             }
         }
@@ -932,9 +724,9 @@ namespace detector {
             // for (auto &LI : MSLIS.second) {
             //     printDebugInfo(LI.second.LockInst);
             // }
-            std::set<Instruction *> setMayAliasLock;
+            LockBucketIndex Index;
             for (auto &LI : MSLIS.second) {
-                setMayAliasLock.insert(LI.first);
+                Index.addLock(LI.first);
             }
             for (auto &LI : MSLIS.second) {
                 // if (LI.first->getFunction()->getName() != "_ZN12ethcore_sync10light_sync18LightSync$LT$L$GT$13maintain_sync17h404bd375d3a82a04E") {
@@ -948,7 +740,10 @@ namespace detector {
                 //     DI->print(errs());
                 //     errs() << "\n";
                 // }
-                trackLockInst(LI.first, setMayAliasLock, mapLockDropInst[LI.first], mapGlobalCallSite);
+                ExplorationBudget Budget(RunDeadline);
+                trackLockInst(LI.first, MayAliasLocks(Index, LI.first), mapLockDropInst[LI.first], CG,
+                              Budget, vecFinding);
+                recordTruncation(LI.first, Budget, vecTruncated);
                 // break;
                 // }
             }
@@ -985,7 +780,8 @@ namespace detector {
                     mapInterProcLockInfo[MS][LI.LockInst] = LI;
                 }
                 std::set<Instruction *> setDropInst;
-                traceResult(LI, setDropInst, M.getDataLayout());
+                GL.collectDestInsts(LI.ResultValue, true, GuardLifetime::AutoDrop | GuardLifetime::ManualDrop,
+                                    setDropInst);
                 mapLockDropInst[LI.LockInst] = setDropInst;
             }
         }
@@ -1036,12 +832,15 @@ namespace detector {
                 if (TLIS.second.size() <= 1) {
                     continue;
                 }
-                std::set<Instruction *> setMayAliasLock;
+                LockBucketIndex Index;
                 for (auto &LI : TLIS.second) {
-                    setMayAliasLock.insert(LI.first);
+                    Index.addLock(LI.first);
                 }
                 for (auto &LI : TLIS.second) {
-                   trackLockInstLocal(LI.first, setMayAliasLock, mapLockDropInst[LI.first]);
+                   ExplorationBudget Budget(RunDeadline);
+                   trackLockInstLocal(LI.first, MayAliasLocks(Index, LI.first), mapLockDropInst[LI.first], Budget,
+                                      vecFinding);
+                   recordTruncation(LI.first, Budget, vecTruncated);
                 }
             }
         }
@@ -1055,9 +854,9 @@ namespace detector {
             // for (auto &LI : MSLIS.second) {
             //     printDebugInfo(LI.second.LockInst);
             // }
-            std::set<Instruction *> setMayAliasLock;
+            LockBucketIndex Index;
             for (auto &LI : MSLIS.second) {
-                setMayAliasLock.insert(LI.first);
+                Index.addLock(LI.first);
             }
             for (auto &LI : MSLIS.second) {
                 // if (LI.first->getFunction()->getName() != "_ZN12ethcore_sync10light_sync18LightSync$LT$L$GT$13maintain_sync17h404bd375d3a82a04E") {
@@ -1071,7 +870,10 @@ namespace detector {
                 //     DI->print(errs());
                 //     errs() << "\n";
                 // }
-                trackLockInst(LI.first, setMayAliasLock, mapLockDropInst[LI.first], mapGlobalCallSite);
+                ExplorationBudget Budget(RunDeadline);
+                trackLockInst(LI.first, MayAliasLocks(Index, LI.first), mapLockDropInst[LI.first], CG,
+                              Budget, vecFinding);
+                recordTruncation(LI.first, Budget, vecTruncated);
                 // break;
                 // }
             }
@@ -1109,7 +911,8 @@ namespace detector {
                     mapInterProcLockInfo[MS][LI.LockInst] = LI;
                 }
                 std::set<Instruction *> setDropInst;
-                traceResult(LI, setDropInst, M.getDataLayout());
+                GL.collectDestInsts(LI.ResultValue, true, GuardLifetime::AutoDrop | GuardLifetime::ManualDrop,
+                                    setDropInst);
                 mapLockDropInst[LI.LockInst] = setDropInst;
             }
         }
@@ -1139,7 +942,8 @@ namespace detector {
                     mapInterProcLockInfo[MS][LI.LockInst] = LI;
                 }
                 std::set<Instruction *> setDropInst;
-                traceResult(LI, setDropInst, M.getDataLayout());
+                GL.collectDestInsts(LI.ResultValue, true, GuardLifetime::AutoDrop | GuardLifetime::ManualDrop,
+                                    setDropInst);
                 mapLockDropInst[LI.LockInst] = setDropInst;
             }
         }
@@ -1190,12 +994,15 @@ namespace detector {
                 if (TLIS.second.size() <= 1) {
                     continue;
                 }
-                std::set<Instruction *> setMayAliasLock;
+                LockBucketIndex Index;
                 for (auto &LI : TLIS.second) {
-                    setMayAliasLock.insert(LI.first);
+                    Index.addLock(LI.first);
                 }
                 for (auto &LI : TLIS.second) {
-                   trackLockInstLocal(LI.first, setMayAliasLock, mapLockDropInst[LI.first]);
+                   ExplorationBudget Budget(RunDeadline);
+                   trackLockInstLocal(LI.first, MayAliasLocks(Index, LI.first), mapLockDropInst[LI.first], Budget,
+                                      vecFinding);
+                   recordTruncation(LI.first, Budget, vecTruncated);
                 }
             }
         }
@@ -1209,9 +1016,9 @@ namespace detector {
             // for (auto &LI : MSLIS.second) {
             //     printDebugInfo(LI.second.LockInst);
             // }
-            std::set<Instruction *> setMayAliasLock;
+            LockBucketIndex Index;
             for (auto &LI : MSLIS.second) {
-                setMayAliasLock.insert(LI.first);
+                Index.addLock(LI.first);
             }
             for (auto &LI : MSLIS.second) {
                 // if (LI.first->getFunction()->getName() != "_ZN12ethcore_sync10light_sync18LightSync$LT$L$GT$13maintain_sync17h404bd375d3a82a04E") {
@@ -1225,7 +1032,10 @@ namespace detector {
                 //     DI->print(errs());
                 //     errs() << "\n";
                 // }
-                trackLockInst(LI.first, setMayAliasLock, mapLockDropInst[LI.first], mapGlobalCallSite);
+                ExplorationBudget Budget(RunDeadline);
+                trackLockInst(LI.first, MayAliasLocks(Index, LI.first), mapLockDropInst[LI.first], CG,
+                              Budget, vecFinding);
+                recordTruncation(LI.first, Budget, vecTruncated);
                 // break;
                 // }
             }
@@ -1233,6 +1043,14 @@ namespace detector {
 
 }
 // #endif
+        if (pReports) {
+            pReports->add(vecFinding);
+        } else {
+            ReportCollector Reports;
+            Reports.add(vecFinding);
+            Reports.write("RustDoubleLockDetector");
+        }
+        printTruncationSummary(vecTruncated, errs());
         return false;
     }
 
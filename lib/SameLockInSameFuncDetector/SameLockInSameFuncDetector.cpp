@@ -1,5 +1,6 @@
 #include "SameLockInSameFuncDetector/SameLockInSameFuncDetector.h"
 
+#include <algorithm>
 #include <set>
 #include <stack>
 
@@ -11,8 +12,18 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Support/Debug.h"
 
+#include "Common/Budget.h"
+#include "Common/CallGraphIndex.h"
 #include "Common/CallerFunc.h"
+#include "Common/DetectorPlugin.h"
+#include "Common/FuncAnalyses.h"
+#include "Common/GuardLifetime.h"
+#include "Common/IndirectCallIndex.h"
+#include "Common/LockBucketIndex.h"
+#include "Common/Report.h"
+#include "Common/SummaryDB.h"
 
 #define DEBUG_TYPE "SameLockInSameFuncDetector"
 
@@ -22,7 +33,7 @@ namespace detector {
 
     char SameLockInSameFuncDetector::ID = 0;
 
-    SameLockInSameFuncDetector::SameLockInSameFuncDetector() : ModulePass(ID) {
+    SameLockInSameFuncDetector::SameLockInSameFuncDetector(ReportCollector *Reports) : ModulePass(ID), pReports(Reports) {
         PassRegistry &Registry = *PassRegistry::getPassRegistry();
         initializeAAResultsWrapperPassPass(Registry);
     }
@@ -32,13 +43,13 @@ namespace detector {
         AU.addRequired<AAResultsWrapperPass>();
     }
 
-    static bool printDebugInfo(Instruction *I) {
+    static bool printDebugInfo(Instruction *I, raw_ostream &OS = errs()) {
         const llvm::DebugLoc &lockInfo = I->getDebugLoc();
 //        I->print(errs());
 //        errs() << "\n";
         auto di = lockInfo.get();
         if (di) {
-            errs() << " " << lockInfo->getDirectory() << '/'
+            OS << " " << lockInfo->getDirectory() << '/'
                    << lockInfo->getFilename() << ' '
                    << lockInfo.getLine() << "\n";
             return true;
@@ -121,168 +132,7 @@ namespace detector {
 //        return false;
 //    }
 
-    static bool isDropInst(Instruction *NI) {
-        if (isCallOrInvokeInst(NI)) {
-            CallSite CS;
-            if (Function *F = getCalledFunc(NI, CS)) {
-                if (F->getName().startswith("_ZN4core3ptr18real_drop_in_place")) {
-                    return true;
-                }
-            }
-        }
-        return false;
-    }
-
-    struct stLockInfo {
-        Instruction *LockInst;
-        Value *ReturnValue;
-        Value *LockValue;
-    };
-
-    static bool parseLockInst(Instruction *LockInst, stLockInfo &LockInfo) {
-        if (!LockInst) {
-            return false;
-        }
-        CallSite CS(LockInst);
-        // Mutex
-        if (CS.getCalledFunction()->getReturnType()->isVoidTy()) {
-            if (CS.getNumArgOperands() > 1) {
-                LockInfo.ReturnValue = CS.getArgOperand(0);
-                LockInfo.LockValue = CS.getArgOperand(1);
-                return true;
-            } else {
-                errs() << "Void-return Lock\n";
-                LockInst->print(errs());
-                errs() << "\n";
-                return false;
-            }
-        } else {  // Non-mutex
-            LockInfo.ReturnValue = LockInst;
-            if (CS.getNumArgOperands() > 0) {
-                LockInfo.LockValue = CS.getArgOperand(0);
-                return true;
-            } else {
-                errs() << "Non-parameter Lock\n";
-                LockInst->print(errs());
-                errs() << "\n";
-                return false;
-            }
-        }
-    }
-
-    static bool trackDownToDropInsts(Instruction *RI, std::set<Instruction *> &setDropInst) {
-        if (!RI) {
-            return false;
-        }
-        setDropInst.clear();
-
-        std::list<Instruction *> WorkList;
-        std::set<Instruction *> Visited;
-        WorkList.push_back(RI);
-        bool Stop = false;
-        while (!WorkList.empty() && !Stop) {
-            Instruction *Curr = WorkList.front();
-            WorkList.pop_front();
-            for (User *U: Curr->users()) {
-                if (Instruction *UI = dyn_cast<Instruction>(U)) {
-                    if (Visited.find(UI) == Visited.end()) {
-                        if (isDropInst(UI)) {
-//                            UI->print(errs());
-//                            errs() << '\n';
-                            setDropInst.insert(UI);
-                            Value *V = UI->getOperand(0);
-                            assert(V);
-                            for (User *UV: V->users()) {
-                                if (Instruction *UVI = dyn_cast<Instruction>(UV)) {
-                                    if (Visited.find(UVI) == Visited.end()) {
-                                        if (isDropInst(UVI)) {
-                                            setDropInst.insert(UVI);
-                                        }
-                                    }
-                                }
-                            }
-                            return true;
-                        } else if (StoreInst *SI = dyn_cast<StoreInst>(UI)) {
-                            if (Instruction *Dest = dyn_cast<Instruction>(SI->getPointerOperand())) {
-                                WorkList.push_back(Dest);
-                            } else {
-                                errs() << "StoreInst Dest is not a Inst\n";
-                                printDebugInfo(Curr);
-                            }
-                        } else {
-                            WorkList.push_back(UI);
-                        }
-                        Visited.insert(UI);
-                    }
-                }
-            }
-        }
-        return false;
-    }
-
-    static bool parseFunc(Function *F,
-                          std::map<Instruction *, Function *> &mapCallInstCallee,
-                          std::map<Instruction *, stLockInfo> &mapLockInfo,
-                          std::map<Instruction *, std::pair<Function *, std::set<Instruction *>>> &mapLockDropInfo) {
-        if (!F || F->isDeclaration()) {
-            return false;
-        }
-
-        for (BasicBlock &BB : *F) {
-            for (Instruction &II : BB) {
-                Instruction *I = &II;
-                if (!skipInst(I)) {
-                    if (isa<CallInst>(I) || isa<InvokeInst>(I)) {
-                        CallSite CS(I);
-                        Function *Callee = CS.getCalledFunction();
-                        if (Callee && !Callee->isDeclaration()) {
-                            if (isLockFunc(Callee)) {
-                                stLockInfo LockInfo{nullptr, nullptr, nullptr};
-                                if (!parseLockInst(I, LockInfo)) {
-                                    errs() << "Cannot Parse Lock Inst\n";
-                                    printDebugInfo(I);
-                                    continue;
-                                }
-                                Instruction *RI = dyn_cast<Instruction>(LockInfo.ReturnValue);
-                                if (!RI) {
-                                    errs() << "Return Value is not Inst\n";
-                                    LockInfo.ReturnValue->print(errs());
-                                    errs() << '\n';
-                                    continue;
-                                }
-                                mapLockInfo[I] = LockInfo;
-                                std::set<Instruction *> setDropInst;
-                                if (trackDownToDropInsts(RI, setDropInst)) {
-                                    mapLockDropInfo[I] = std::make_pair(Callee, setDropInst);
-//                                    // Debug
-//                                    I->print(errs());
-//                                    errs() << '\n';
-//                                    for (Instruction *DropInst: setDropInst) {
-//                                        errs() << '\t';
-//                                        DropInst->print(errs());
-//                                        errs() << '\n';
-//                                    }
-                                } else {
-                                    errs() << "Cannot find Drop for Inst:\n";
-                                    errs() << I->getParent()->getParent()->getName() << '\n';
-                                    I->print(errs());
-                                    printDebugInfo(I);
-                                    errs() << '\n';
-                                    mapLockDropInfo[I] = std::make_pair(Callee, setDropInst);
-                                }
-
-                            } else {
-                                mapCallInstCallee[I] = Callee;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-
-        return true;
-    }
-
+    namespace {
     enum class LockShareType {
         SharedLock = 0,
         ExclusiveLock = 1,
@@ -294,6 +144,7 @@ namespace detector {
         LockShareType LockType;
         bool Wrapped;
     };
+    }  // namespace
 
     // std::sync::Mutex::lock()
     // _ZN3std4sync5mutex14Mutex$LT$T$GT$4lock17h(Result<MutexGuard, PoisonError>, Mutex) -> void
@@ -437,415 +288,9 @@ namespace detector {
         return false;
     }
 
-    enum class GuardDest {
-        Unknown = 0,
-        AutoDrop = 1,
-        ManualDrop = 2,
-        Return = 3,
-        Move = 4,
-    };
-
-    static bool isResultToInnerAPI(StringRef FuncName) {
-        return FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6unwrap17h")
-               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$9unwrap_or17h")
-               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$14unwrap_or_else17h")
-               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$17unwrap_or_default17h")
-               || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6expect17h");
-    }
-
-    static bool isResultToResultAPI(StringRef FuncName) {
-        return FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$7map_err17h")
-               || FuncName.startswith(
-                "_ZN73_$LT$core..result..Result$LT$T$C$E$GT$$u20$as$u20$core..ops..try..Try$GT$11into_result17h");
-//        FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$3map17h") -> T->U
-//        || FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$2ok17h") -> Option
-    }
-
-    static bool isAutoDropAPI(StringRef FuncName) {
-        return FuncName.startswith("_ZN4core3ptr18real_drop_in_place17h");
-    }
-
-    static bool isManualDropAPI(StringRef FuncName) {
-        return FuncName.startswith("_ZN4core3mem4drop17h");
-    }
-
-    static bool isDerefAPI(StringRef FuncName) {
-        return FuncName.startswith(
-                "_ZN81_$LT$std..sync..mutex..MutexGuard$LT$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
-               || FuncName.startswith(
-                "_ZN84_$LT$std..sync..mutex..MutexGuard$LT$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
-               || FuncName.startswith(
-                "_ZN84_$LT$lock_api..mutex..MutexGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
-               || FuncName.startswith(
-                "_ZN87_$LT$lock_api..mutex..MutexGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
-               || FuncName.startswith(
-                "_ZN88_$LT$std..sync..rwlock..RwLockWriteGuard$LT$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
-               || FuncName.startswith(
-                "_ZN91_$LT$std..sync..rwlock..RwLockWriteGuard$LT$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
-               || FuncName.startswith(
-                "_ZN87_$LT$std..sync..rwlock..RwLockReadGuard$LT$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
-               || FuncName.startswith(
-                "_ZN90_$LT$std..sync..rwlock..RwLockReadGuard$LT$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
-               || FuncName.startswith(
-                "_ZN90_$LT$lock_api..rwlock..RwLockReadGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
-               || FuncName.startswith(
-                "_ZN93_$LT$lock_api..rwlock..RwLockReadGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h")
-               || FuncName.startswith(
-                "_ZN91_$LT$lock_api..rwlock..RwLockWriteGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..Deref$GT$5deref17h")
-               || FuncName.startswith(
-                "_ZN94_$LT$lock_api..rwlock..RwLockWriteGuard$LT$R$C$T$GT$$u20$as$u20$core..ops..deref..DerefMut$GT$9deref_mut17h");
-    }
-
-    enum class ResultState {
-        WrappedInResult = 0,  // Init
-        MovedToOtherInst = 1,
-        Unwrapped = 2,  // Term
-        AutoDropped = 3,  // Term
-        ManualDropped = 4,  // Term
-        MovedToOtherFunc = 5, // Term  // consider as unlock
-        Returned = 6,  // Term
-        Overwritten = 7,  // Term
-        Unknown = 8  // Term
-    };
-
-    static bool getNextValueForResult(Use *InputUse, Value *&Output, ResultState &RS, const DataLayout &DL) {
-        User *InputUser = InputUse->getUser();
-        if (Instruction *I = dyn_cast<Instruction>(InputUser)) {
-            if (isCallOrInvokeInst(I)) {
-                CallSite CS;
-                if (Function *F = getCalledFunc(I, CS)) {
-                    StringRef FuncName = F->getName();
-                    if (isResultToInnerAPI(FuncName)) {
-                        if (F->getReturnType()->isVoidTy()) {
-                            Output = GetUnderlyingObject(I->getOperand(0), DL);
-                        } else {
-                            Output = I;
-                        }
-                        RS = ResultState::Unwrapped;
-                        return false;
-                    } else if (isResultToResultAPI(FuncName)) {
-//                        // Debug
-//                        errs() << "Is Result To Result API\n";
-//                        I->print(errs());
-//                        errs() << "\n";
-//                        printDebugInfo(I);
-//                        errs().write_escaped(I->getFunction()->getName()) << "\n\n";
-                        if (F->getReturnType()->isVoidTy()) {
-                            Output = GetUnderlyingObject(I->getOperand(0), DL);
-                        } else {
-                            Output = I;
-                        }
-                        RS = ResultState::MovedToOtherInst;
-                        return true;
-                    } else if (isAutoDropAPI(FuncName)) {
-                        Output = I;
-                        RS = ResultState::AutoDropped;
-                        return false;
-                    } else if (isManualDropAPI(FuncName)) {
-                        Output = I;
-                        RS = ResultState::ManualDropped;
-                        return false;
-                    } else if (MemTransferInst *MI = dyn_cast<MemTransferInst>(I)) {
-                        if (MI->getOperandUse(0) == *InputUse) {
-                            Output = I;
-                            RS = ResultState::Overwritten;
-                            return false;
-                        } else {
-                            Output = GetUnderlyingObject(MI->getOperand(0), DL);
-                            RS = ResultState::MovedToOtherInst;
-                            return true;
-                        }
-                    } else if (isa<MemSetInst>(I)) {
-                        Output = I;
-                        RS = ResultState::Overwritten;
-                        return false;
-                    } else {
-                        Output = I;
-                        RS = ResultState::MovedToOtherFunc;
-                        return false;
-                    }
-                } else {
-                    Output = I;
-                    RS = ResultState::MovedToOtherFunc;
-                    return false;
-                }
-            } else if (isa<LoadInst>(I)) {
-                Output = I;
-                RS = ResultState::MovedToOtherInst;
-                return true;
-            } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
-                if (SI->getOperandUse(1) == *InputUse) {
-                    Output = I;
-                    RS = ResultState::Overwritten;
-                    return false;
-                } else {
-                    Output = GetUnderlyingObject(SI->getOperand(1), DL);
-                    RS = ResultState::MovedToOtherInst;
-                    return true;
-                }
-            } else if (isa<InsertValueInst>(I)) {
-                Output = I;
-                RS = ResultState::MovedToOtherInst;
-                return true;
-            } else if (isa<CastInst>(I)) {
-                Output = I;
-                RS = ResultState::MovedToOtherInst;
-                return true;
-            } else if (isa<GetElementPtrInst>(I)) {
-                Output = I;
-                RS = ResultState::MovedToOtherInst;
-                return true;
-            } else if (isa<ExtractValueInst>(I)) {
-                Output = I;
-                RS = ResultState::MovedToOtherInst;
-                return true;
-            } else if (isa<ReturnInst>(I)) {
-                Output = I;
-                RS = ResultState::Returned;
-                return false;
-            } else {
-                Output = I;
-                RS = ResultState::Unknown;
-                return false;
-            }
-        } else {
-            Output = InputUser;
-            RS = ResultState::Unknown;
-            return false;
-        }
-    }
-
-    static bool runFSMForResult(Value *ResultValue,
-                                std::set<Value *> &setLockGuard,
-                                std::set<Value *> &setAutoDrop,
-                                std::set<Value *> &setManualDrop,
-                                std::set<Value *> &setMovedToOtherFunc,
-                                std::set<Value *> &setReturned,
-                                std::set<Value *> &setOverwritten,
-                                std::set<Value *> &setUnknown,
-                                const DataLayout &DL) {
-
-        Value *NextValue = ResultValue;
-        std::list<Value *> WorkList;
-        std::set<Value *> Visited;
-        WorkList.push_back(NextValue);
-        Visited.insert(NextValue);
-        ResultState RS = ResultState::WrappedInResult;
-//        errs() << "NextValue:\n";
-//        NextValue->print(errs());
-//        errs() << "\n";
-        while (!WorkList.empty()) {
-            NextValue = WorkList.front();
-            WorkList.pop_front();
-            if (User *NI = dyn_cast<User>(NextValue)) {
-                for (Use &U : NI->uses()) {
-                    Value *CurrNextValue = nullptr;
-                    if (getNextValueForResult(&U, CurrNextValue, RS, DL)) {
-                        if (Visited.find(CurrNextValue) == Visited.end()) {
-                            WorkList.push_back(CurrNextValue);
-                            Visited.insert(CurrNextValue);
-                        }
-                    } else {
-                        if (RS == ResultState::Unwrapped) {
-                            setLockGuard.insert(CurrNextValue);
-                        } else if (RS == ResultState::AutoDropped) {
-                            setAutoDrop.insert(CurrNextValue);
-                        } else if (RS == ResultState::ManualDropped) {
-                            setManualDrop.insert(CurrNextValue);
-                        } else if (RS == ResultState::MovedToOtherFunc) {
-                            setMovedToOtherFunc.insert(CurrNextValue);
-                        } else if (RS == ResultState::Returned) {
-                            setReturned.insert(CurrNextValue);
-                        } else if (RS == ResultState::Overwritten) {
-                            setOverwritten.insert(CurrNextValue);
-                        } else if (RS == ResultState::Unknown) {
-                            setUnknown.insert(CurrNextValue);
-                        } else {
-                            assert(false && "Cannot Reach to Result Parsing!");
-                        }
-                    }
-                }
-            }
-        }
-        return true;
-    }
-
-    enum class LockGuardState {
-        Unwrapped = 0,  // Init
-        MovedToOtherInst = 1,
-        Dereferenced = 2,  // Term  // further drop not related
-        AutoDropped = 3,  // Term
-        ManualDropped = 4,  // Term
-        MovedToOtherFunc = 5, // Term  // consider as unlock
-        Returned = 6,  // Term
-        Overwritten = 7,  // Term
-        Unknown = 8  // Term
-    };
-
-    static bool getNextValueForLockGuard(Use *InputUse, Value *&Output, LockGuardState &LGS, const DataLayout &DL) {
-        User *InputUser = InputUse->getUser();
-        if (Instruction *I = dyn_cast<Instruction>(InputUser)) {
-            if (isCallOrInvokeInst(I)) {
-                CallSite CS;
-                if (Function *F = getCalledFunc(I, CS)) {
-                    StringRef FuncName = F->getName();
-                    if (isAutoDropAPI(FuncName)) {
-                        Output = I;
-                        LGS = LockGuardState::AutoDropped;
-                        return false;
-                    } else if (isManualDropAPI(FuncName)) {
-                        Output = I;
-                        LGS = LockGuardState::ManualDropped;
-                        return false;
-                    } else if (isDerefAPI(FuncName)) {
-                        if (F->getReturnType()->isVoidTy()) {
-                            Output = GetUnderlyingObject(I->getOperand(0), DL);
-                        } else {
-                            Output = I;
-                        }
-                        LGS = LockGuardState::Dereferenced;
-                        return false;
-                    } else if (MemTransferInst *MI = dyn_cast<MemTransferInst>(I)) {
-                        if (MI->getOperandUse(0) == *InputUse) {
-                            Output = I;
-                            LGS = LockGuardState::Overwritten;
-                            return false;
-                        } else {
-                            Output = GetUnderlyingObject(MI->getOperand(0), DL);
-                            LGS = LockGuardState::MovedToOtherInst;
-                            return true;
-                        }
-                    } else if (isa<MemSetInst>(I)) {
-                        Output = I;
-                        LGS = LockGuardState::Overwritten;
-                        return false;
-                    } else {
-                        Output = I;
-                        errs() << "Moved to other func\n";
-                        I->print(errs());
-                        errs() << "\n";
-                        printDebugInfo(I);
-                        errs().write_escaped(I->getFunction()->getName()) << "\n\n";
-                        LGS = LockGuardState::MovedToOtherFunc;
-                        return false;
-                    }
-                } else {
-                    Output = I;
-                    LGS = LockGuardState::MovedToOtherFunc;
-                    return false;
-                }
-            } else if (isa<LoadInst>(I)) {
-                Output = I;
-                LGS = LockGuardState::MovedToOtherInst;
-                return true;
-            } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
-                if (SI->getOperandUse(1) == *InputUse) {
-                    Output = I;
-                    LGS = LockGuardState::Overwritten;
-                    return false;
-                } else {
-//                    SI->print(errs());
-//                    errs() << "\n";
-                    Output = GetUnderlyingObject(SI->getOperand(1), DL);
-//                    errs() << "Stored Value\n";
-//                    Output->print(errs());
-//                    errs() << "\n";
-                    LGS = LockGuardState::MovedToOtherInst;
-                    return true;
-                }
-            } else if (isa<InsertValueInst>(I)) {
-                Output = I;
-                LGS = LockGuardState::MovedToOtherInst;
-                return true;
-            } else if (isa<CastInst>(I)) {
-                Output = I;
-                LGS = LockGuardState::MovedToOtherInst;
-                return true;
-            } else if (isa<GetElementPtrInst>(I)) {
-                Output = I;
-                LGS = LockGuardState::MovedToOtherInst;
-                return true;
-            } else if (isa<ExtractValueInst>(I)) {
-                Output = I;
-                LGS = LockGuardState::MovedToOtherInst;
-                return true;
-            } else if (isa<ReturnInst>(I)) {
-                Output = I;
-                LGS = LockGuardState::Returned;
-                return false;
-            } else {
-                Output = I;
-                LGS = LockGuardState::Unknown;
-                return false;
-            }
-        } else {
-            Output = InputUser;
-            LGS = LockGuardState::Unknown;
-            return false;
-        }
-    }
-
-    static bool runFSMForLockGuard(Value *LockGuardValue,
-                                   std::set<Value *> &setDeref,
-                                   std::set<Value *> &setAutoDrop,
-                                   std::set<Value *> &setManualDrop,
-                                   std::set<Value *> &setMovedToOtherFunc,
-                                   std::set<Value *> &setReturned,
-                                   std::set<Value *> &setOverwritten,
-                                   std::set<Value *> &setUnknown,
-                                   const DataLayout &DL) {
-
-        Value *NextValue = LockGuardValue;
-        std::list<Value *> WorkList;
-        std::set<Value *> Visited;
-        WorkList.push_back(NextValue);
-        Visited.insert(NextValue);
-        LockGuardState LGS = LockGuardState::Unwrapped;
-//        errs() << "NextValue:\n";
-//        NextValue->print(errs());
-//        errs() << "\n";
-        while (!WorkList.empty()) {
-            NextValue = WorkList.front();
-            WorkList.pop_front();
-            if (User *NI = dyn_cast<User>(NextValue)) {
-                for (Use &U : NI->uses()) {
-                    Value *CurrNextValue = nullptr;
-                    if (getNextValueForLockGuard(&U, CurrNextValue, LGS, DL)) {
-                        if (Visited.find(CurrNextValue) == Visited.end()) {
-                            WorkList.push_back(CurrNextValue);
-                            Visited.insert(CurrNextValue);
-                        }
-                    } else {
-                        if (LGS == LockGuardState::Dereferenced) {
-                            setDeref.insert(CurrNextValue);
-                        } else if (LGS == LockGuardState::AutoDropped) {
-                            setAutoDrop.insert(CurrNextValue);
-                        } else if (LGS == LockGuardState::ManualDropped) {
-                            setManualDrop.insert(CurrNextValue);
-                        } else if (LGS == LockGuardState::MovedToOtherFunc) {
-//                            errs() << "!!!Moved to Other Func\n";
-//                            CurrNextValue->print(errs());
-//                            errs() << "\n";
-                            setMovedToOtherFunc.insert(CurrNextValue);
-                        } else if (LGS == LockGuardState::Returned) {
-                            setReturned.insert(CurrNextValue);
-                        } else if (LGS == LockGuardState::Overwritten) {
-                            setOverwritten.insert(CurrNextValue);
-                        } else if (LGS == LockGuardState::Unknown) {
-                            setUnknown.insert(CurrNextValue);
-                        } else {
-                            assert(false && "Cannot Reach to LockGuard Parsing!");
-                        }
-                    }
-                }
-            }
-        }
-        return true;
-    }
-
     static bool collectGlobalCallSite(
             Function *F,  // Input
-            std::map<Instruction *, Function *> &mapCallSite  // Output
+            CallGraphIndex &CG  // Output
         ) {
         if (!F || F->isDeclaration()) {
             return false;
@@ -859,7 +304,7 @@ namespace detector {
                 if (isCallOrInvokeInst(I)) {
                     CallSite CS;
                     if (Function *Callee = getCalledFunc(I, CS)) {
-                        mapCallSite[I] = Callee;
+                        CG.addCall(I, Callee);
                     }
                 }
             }
@@ -867,6 +312,7 @@ namespace detector {
         return true;
     }
 
+    namespace {
     struct stLockGenKillSet {
         ResultLockInfo RLI;  // Gen
         std::set<Value *> setLockGuard;  // Intermediate Info
@@ -884,354 +330,70 @@ namespace detector {
         std::set<Value *> setLockGuardOverwritten;  // Cannot handle
         std::set<Value *> setLockGuardUnknown;  // Cannot handle
     };
+    }  // namespace
 
     using LockGenKillInfoMapTy = std::map<Instruction *, stLockGenKillSet>;
 
+    static void insertValues(std::set<Value *> &Dst, const std::set<Value *> &Src) {
+        Dst.insert(Src.begin(), Src.end());
+    }
+
     static void collectLockGenKillInfoForLock(Instruction *LockInst,  // Input
             ResultLockInfo &LI,  // Input
             stLockGenKillSet &GKS,  // Output
-            const DataLayout &DL
+            GuardLifetime &GL
             ) {
         GKS.RLI = LI;
+        std::set<Value *> setLockGuard;
         if (LI.Wrapped) {
-            runFSMForResult(LI.ResultValue, GKS.setLockGuard, GKS.setResultAutoDrop,
-                            GKS.setResultManualDrop,
-                            GKS.setResultMovedToOtherFunc, GKS.setResultReturned,
-                            GKS.setResultOverwritten, GKS.setResultUnknown, DL);
-            for (Value *LockGuardValue : GKS.setLockGuard) {
-                runFSMForLockGuard(LockGuardValue, GKS.setLockGuardDeref, GKS.setLockGuardAutoDrop,
-                                   GKS.setLockGuardManualDrop, GKS.setLockGuardMovedToOtherFunc,
-                                   GKS.setLockGuardReturned, GKS.setLockGuardOverwritten,
-                                   GKS.setLockGuardUnknown, DL);
-            }
+            const GuardDestSet &ResultDest = GL.traceResult(LI.ResultValue);
+            GKS.setLockGuard = ResultDest.setLockGuard;
+            GKS.setResultAutoDrop = ResultDest.setAutoDrop;
+            GKS.setResultManualDrop = ResultDest.setManualDrop;
+            GKS.setResultMovedToOtherFunc = ResultDest.setMovedToOtherFunc;
+            GKS.setResultReturned = ResultDest.setReturned;
+            GKS.setResultOverwritten = ResultDest.setOverwritten;
+            GKS.setResultUnknown = ResultDest.setUnknown;
+            setLockGuard = ResultDest.setLockGuard;
         } else {  // Result is Unwrapped LockGuard
-            runFSMForLockGuard(LI.ResultValue, GKS.setLockGuardDeref, GKS.setLockGuardAutoDrop,
-                               GKS.setLockGuardManualDrop, GKS.setLockGuardMovedToOtherFunc,
-                               GKS.setLockGuardReturned, GKS.setLockGuardOverwritten,
-                               GKS.setLockGuardUnknown, DL);
+            setLockGuard.insert(LI.ResultValue);
+        }
+        for (Value *LockGuardValue : setLockGuard) {
+            const GuardDestSet &LockGuardDest = GL.traceLockGuard(LockGuardValue);
+            insertValues(GKS.setLockGuardDeref, LockGuardDest.setDeref);
+            insertValues(GKS.setLockGuardAutoDrop, LockGuardDest.setAutoDrop);
+            insertValues(GKS.setLockGuardManualDrop, LockGuardDest.setManualDrop);
+            insertValues(GKS.setLockGuardMovedToOtherFunc, LockGuardDest.setMovedToOtherFunc);
+            insertValues(GKS.setLockGuardReturned, LockGuardDest.setReturned);
+            insertValues(GKS.setLockGuardOverwritten, LockGuardDest.setOverwritten);
+            insertValues(GKS.setLockGuardUnknown, LockGuardDest.setUnknown);
         }
     }
 
-    static void collectLockGenKillInfo(std::map<Instruction *, Function *> &mapLocalCallSite,  // Input
+    static void collectLockGenKillInfo(const CallGraphIndex &CG,  // Input
                                       LockGenKillInfoMapTy &mapGenKillInfo,  // Output
-                                      const DataLayout &DL) {  // Input
-        for (auto &kv : mapLocalCallSite) {
-            Instruction *I = kv.first;
+                                      GuardLifetime &GL) {  // Input
+        for (unsigned Site = 0; Site < CG.getNumCallSites(); ++Site) {
+            Instruction *I = CG.getCallInst(Site);
             ResultLockInfo LI = {nullptr, nullptr, LockShareType::SharedLock, true};
             if (dispatchLockInst(I, LI)) {
-                stLockGenKillSet &GKS = mapGenKillInfo[I];
-                GKS.RLI = LI;
-                if (LI.Wrapped) {
-                    runFSMForResult(LI.ResultValue, GKS.setLockGuard, GKS.setResultAutoDrop,
-                                    GKS.setResultManualDrop,
-                                    GKS.setResultMovedToOtherFunc, GKS.setResultReturned,
-                                    GKS.setResultOverwritten, GKS.setResultUnknown, DL);
-                    for (Value *LockGuardValue : GKS.setLockGuard) {
-                        runFSMForLockGuard(LockGuardValue, GKS.setLockGuardDeref, GKS.setLockGuardAutoDrop,
-                                           GKS.setLockGuardManualDrop, GKS.setLockGuardMovedToOtherFunc,
-                                           GKS.setLockGuardReturned, GKS.setLockGuardOverwritten,
-                                           GKS.setLockGuardUnknown, DL);
-                    }
-                } else {  // Result is Unwrapped LockGuard
-                    runFSMForLockGuard(LI.ResultValue, GKS.setLockGuardDeref, GKS.setLockGuardAutoDrop,
-                                       GKS.setLockGuardManualDrop, GKS.setLockGuardMovedToOtherFunc,
-                                       GKS.setLockGuardReturned, GKS.setLockGuardOverwritten,
-                                       GKS.setLockGuardUnknown, DL);
-                }
-            }
-        }
-    }
-
-    static bool getNextValue(Use *InputUse, Value *&Output, GuardDest &GD, const DataLayout &DL) {
-        User *InputUser = InputUse->getUser();
-        InputUser->print(errs());
-        errs() << "\n";
-        if (Instruction *I = dyn_cast<Instruction>(InputUser)) {
-            if (isCallOrInvokeInst(I)) {
-                CallSite CS;
-                if (Function *F = getCalledFunc(I, CS)) {
-                    StringRef FuncName = F->getName();
-                    if (FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6unwrap17h")) {
-                        Output = I;
-                        return true;
-                    } else if (FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$6expect17h")) {
-//                        if (I->getOperandUse(1) == *InputUse) {
-                        if (F->getReturnType()->isVoidTy()) {
-                            Value *Dest = GetUnderlyingObject(I->getOperand(0), DL);
-                            errs() << "Result::expect Dest\n";
-                            Dest->print(errs());
-                            errs() << "\n";
-                            Output = Dest;
-                        } else {
-                            Output = I;
-                        }
-                        return true;
-//                        }
-                    } else if (FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$7map_err17h")) {
-                        if (F->getReturnType()->isVoidTy()) {
-                            Value *Dest = GetUnderlyingObject(I->getOperand(0), DL);
-                            errs() << "Result::map_err Dest\n";
-                            Dest->print(errs());
-                            errs() << "\n";
-                            Output = Dest;
-                        } else {
-                            errs() << "Result::map_err Dest\n";
-                            Output = I;
-                        }
-                        return true;
-                    } else if (FuncName.startswith("_ZN4core6result19Result$LT$T$C$E$GT$3map17h")) {
-                        if (F->getReturnType()->isVoidTy()) {
-                            Value *Dest = GetUnderlyingObject(I->getOperand(0), DL);
-                            errs() << "Result::map Dest\n";
-                            Dest->print(errs());
-                            errs() << "\n";
-                            Output = Dest;
-                        } else {
-                            errs() << "Result::map Dest\n";
-                            Output = I;
-                        }
-                        return true;
-                    } else if (FuncName.startswith("_ZN73_$LT$core..result..Result$LT$T$C$E$GT$$u20$as$u20$core..ops..try..Try$GT$11into_result")) {
-                        if (F->getReturnType()->isVoidTy()) {
-                            Value *Dest = GetUnderlyingObject(I->getOperand(0), DL);
-                            errs() << "Result::into_result Dest\n";
-                            Dest->print(errs());
-                            errs() << "\n";
-                            Output = Dest;
-                        } else {
-                            errs() << "Result::into_result Dest\n";
-                            Output = I;
-                        }
-                        return true;
-                    } else if (FuncName.startswith("_ZN4core3ptr18real_drop_in_place17h")) {
-//                        errs() << "Auto Drop Guard\n";
-                        GD = GuardDest::AutoDrop;
-                        Output = nullptr;
-                        return false;
-                    } else if (FuncName.startswith("_ZN4core3mem4drop17h")) {
-//                        errs() << "Manual Drop Guard\n";
-                        GD = GuardDest::ManualDrop;
-                        Output = nullptr;
-                        return false;
-                    } else if (MemTransferInst *MI = dyn_cast<MemTransferInst>(I)) {
-                        if (MI->getOperandUse(0) == *InputUse) {
-                            Output = nullptr;
-                            return false;
-                        } else {
-                            Value *Dest = GetUnderlyingObject(MI->getOperand(0), DL);
-//                            errs() << "MemTransferInst Dest\n";
-//                            Dest->print(errs());
-//                            errs() << "\n";
-                            Output = Dest;
-                            return true;
-                        }
-                    } else if (isa<MemSetInst>(I)) {
-                        Output = nullptr;
-                        return false;
-                    }
-                }
-            } else if (isa<LoadInst>(I)) {
-                Output = I;
-                return true;
-            } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
-                if (SI->getOperandUse(1) == *InputUse) {
-                    Output = nullptr;
-                    return false;
-                } else {
-                    Value *Dest = GetUnderlyingObject(SI->getOperand(1), DL);
-//                    errs() << "Store Dest\n";
-//                    Dest->print(errs());
-//                    errs() << "\n";
-                    Output = Dest;
-                    return true;
-                }
-            } else if (isa<InsertValueInst>(I)) {
-                Output = I;
-                return true;
-            } else if (isa<CastInst>(I)) {
-                Output = I;
-                return true;
-            } else if (isa<GetElementPtrInst>(I)) {
-                Output = I;
-                return true;
-            } else if (isa<ExtractValueInst>(I)) {
-                Output = I;
-                return true;
-            } else if (isa<ReturnInst>(I)) {
-//                errs() << "Return Guard\n";
-                GD = GuardDest::Return;
-                Output = nullptr;
-                return false;
-            } else {
-                Output = nullptr;
-                return false;
+                collectLockGenKillInfoForLock(I, LI, mapGenKillInfo[I], GL);
             }
         }
-        Output = nullptr;
-        return false;
-    }
-
-    bool isNewControlFlowDependentOn(Instruction *I1, Instruction *I2) {
-        // I1->icmp
-        // to I2
-        return true;
-    }
-
-    static bool collectDropInfo(Value *ResultValue,
-                                std::set<Instruction *> &setAutoDropGuard,
-                                std::set<Instruction *> &setManualDropGuard,
-                                std::set<Instruction *> &setReturnGuard,
-                                const DataLayout &DL) {
-
-        Value *NextValue = ResultValue;
-        std::list<Value *> WorkList;
-        std::set<Value *> Visited;
-        WorkList.push_back(NextValue);
-        Visited.insert(NextValue);
-//        errs() << "NextValue:\n";
-//        NextValue->print(errs());
-//        errs() << "\n";
-        while (!WorkList.empty()) {
-            NextValue = WorkList.front();
-            WorkList.pop_front();
-            if (User *NI = dyn_cast<User>(NextValue)) {
-                for (Use &U : NI->uses()) {
-                    Value *CurrNextValue = nullptr;
-                    GuardDest GD = GuardDest::Unknown;
-                    if (getNextValue(&U, CurrNextValue, GD, DL)) {
-                        if (Visited.find(CurrNextValue) == Visited.end()) {
-                            WorkList.push_back(CurrNextValue);
-                            Visited.insert(CurrNextValue);
-//                            errs() << "Succ\n";
-//                            errs() << "Visited contains\n";
-//                            for (Value *V : Visited) {
-//                                V->print(errs());
-//                                errs() << "\n";
-//                            }
-//                            errs() << "End of Visited contains\n";
-                        }
-//                        else {
-//                            errs() << "Visited, Stop\n";
-//                        }
-                    } else {
-                        switch (GD) {
-                            case GuardDest::AutoDrop: {
-                                Instruction *AD = dyn_cast<Instruction>(U.getUser());
-                                setAutoDropGuard.insert(AD);
-                                break;
-                            }
-                            case GuardDest::ManualDrop: {
-                                Instruction *MD = dyn_cast<Instruction>(U.getUser());
-                                setManualDropGuard.insert(MD);
-                                break;
-                            }
-                            case GuardDest::Return: {
-                                Instruction *RT = dyn_cast<Instruction>(U.getUser());
-                                setReturnGuard.insert(RT);
-                                break;
-                            }
-                            default: {
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-
-        // Debug
-        if (!setAutoDropGuard.empty()) {
-            errs() << "Auto Drop Guard:\n";
-        }
-        for (Instruction *I : setAutoDropGuard) {
-            I->print(errs());
-            errs() << "\n";
-        }
-
-        if (!setManualDropGuard.empty()) {
-            errs() << "Manual Drop Guard:\n";
-        }
-        for (Instruction *I : setManualDropGuard) {
-            I->print(errs());
-            errs() << "\n";
-        }
-
-        if (!setReturnGuard.empty()) {
-            errs() << "Return Guard:\n";
-        }
-        for (Instruction *I : setReturnGuard) {
-            I->print(errs());
-            errs() << "\n";
-        }
-
-        return !setAutoDropGuard.empty() || !setManualDropGuard.empty() || !setReturnGuard.empty();
-    }
-
-    struct LockDropInfo {
-        Instruction *LockInst;
-        ResultLockInfo LI;
-        std::set<Instruction *> setAutoDropGuard;
-        std::set<Instruction *> setManualDropGuard;
-        std::set<Instruction *> setReturnGuard;
-    };
-
-    static bool collectLockInfo(Function *F,
-            std::map<Instruction *, Function *> &mapCallSite,
-            std::map<Instruction *, LockDropInfo> &mapLockDropInfo,
-            const DataLayout &DL
-            ) {
-        if (!F || F->isDeclaration()) {
-            return false;
-        }
-        for (BasicBlock &B : *F) {
-            for (Instruction &II : B) {
-                Instruction *I = &II;
-                if (skipInst(I)) {
-                    continue;
-                }
-                if (isCallOrInvokeInst(I)) {
-                    CallSite CS;
-                    if (Function *Callee = getCalledFunc(I, CS)) {
-                        mapCallSite[I] = Callee;
-                        ResultLockInfo LI = {nullptr, nullptr, LockShareType::SharedLock};
-                        if (dispatchLockInst(I, LI)) {
-                            // Found LockInst
-                            LockDropInfo LDI;
-                            LDI.LockInst = I;
-                            LDI.LI = LI;
-                            LDI.LockInst->print(errs());
-                            errs() << "\n";
-                            assert(LI.ResultValue);
-                            LI.ResultValue->print(errs());
-                            errs() << "\n";
-                            // Find drop/return
-                            if (!collectDropInfo(LI.ResultValue, LDI.setAutoDropGuard, LDI.setManualDropGuard,
-                                                 LDI.setReturnGuard, DL)) {
-                                errs() << "Cannot find the Dest of Lock Guard!\n";
-                                I->print(errs());
-                                errs() << "\n";
-                                printDebugInfo(I);
-                                errs().write_escaped(I->getFunction()->getName()) << "\n";
-                            }
-                            mapLockDropInfo[I] = LDI;
-                        }
-                    }
-                }
-            }
-        }
-        return !mapLockDropInfo.empty();
     }
 
     static bool trackCallee(Instruction *LockInst,
                             std::pair<Instruction *, Function *> &DirectCalleeSite,
-                            std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallees,
-                            std::map<Function *, std::set<Instruction *>> &mapAliasFuncLock) {
+                            const CallGraphIndex &CG,
+                            const MayAliasLocks &Alias,
+                            ExplorationBudget &Budget,
+                            std::vector<Finding> &vecFinding) {
 
         bool HasDoubleLock = false;
 
         Function *DirectCallee = DirectCalleeSite.second;
 
-        if (mapAliasFuncLock.find(DirectCallee) != mapAliasFuncLock.end()) {
+        if (Alias.hasLockIn(DirectCallee)) {
             // Restore
 //            HasDoubleLock = true;
 //            errs() << "Double Lock Happens! First Lock:\n";
@@ -1250,6 +412,12 @@ namespace detector {
 //            errs() << '\n';
         }
 
+        // Summarized external code that never locks is not searched.
+        const SummaryDB &DB = getSummaryDB();
+        if (DB.stopsAt(*DirectCallee)) {
+            return HasDoubleLock;
+        }
+
         std::stack<Function *> WorkList;
         std::set<Function *> Visited;
 
@@ -1260,22 +428,25 @@ namespace detector {
 
         mapParentInst[DirectCallee] = DirectCalleeSite.first;
 
-        while (!WorkList.empty()) {
+        while (!WorkList.empty() && !Budget.isTruncated()) {
             Function *Curr = WorkList.top();
             WorkList.pop();
 //            errs() << Curr->getName() << '\n';
-            auto itCallerCallInst = mapCallerCallees.find(Curr);
-            if (itCallerCallInst != mapCallerCallees.end()) {
-//                errs() << "Caller Found\n";
-                std::map<Instruction *, Function *> &mapCallInstCallee = itCallerCallInst->second;
-                for (auto &CallInstCallee : mapCallInstCallee) {
-                    Instruction *CallInst = CallInstCallee.first;
-                    Function *Callee = CallInstCallee.second;
+            for (unsigned Site : CG.callSitesIn(Curr)) {
+                Instruction *CallInst = CG.getCallInst(Site);
+                Function *Callee = CG.getCallee(Site);
 //                    errs() << "Callee Found " << Callee->getName() << '\n';
-                    if (Visited.find(Callee) == Visited.end()) {
+                if (Visited.find(Callee) == Visited.end()) {
+                    if (DB.stopsAt(*Callee)) {
+                        Visited.insert(Callee);
+                        continue;
+                    }
+                    if (!Budget.takeCallee()) {
+                        break;
+                    }
 //                        errs() << "Not Visited\n";
-                        if (mapAliasFuncLock.find(Callee) != mapAliasFuncLock.end()) {
-                            // Restore
+                    if (Alias.hasLockIn(Callee)) {
+                        // Restore
 //                            errs() << "Double Lock Happens! First Lock:\n";
 //                            errs() << LockInst->getParent()->getParent()->getName() << '\n';
 //                            printDebugInfo(LockInst);
@@ -1289,33 +460,34 @@ namespace detector {
 //                                errs() << '\n';
 //                            }
 //                            errs() << '\n';
-                            // backtrace print
-                            mapParentInst[Callee] = CallInst;
-                            std::set<Function *> TraceVisited;
-                            auto it = mapParentInst.find(Callee);
-                            while (it != mapParentInst.end()) {
-                                Instruction *ParentInst = it->second;
-                                printDebugInfo(ParentInst);
-                                errs() << ParentInst->getParent()->getName() << ": ";
-                                ParentInst->print(errs());
-                                errs() << '\n';
-                                Function *ParentFunc = ParentInst->getParent()->getParent();
-                                it = mapParentInst.find(ParentFunc);
-                                if (it != mapParentInst.end()) {
-                                    if (TraceVisited.find(it->first) != TraceVisited.end()) {
-                                        break;
-                                    } else {
-                                        TraceVisited.insert(it->first);
-                                    }
+                        // backtrace
+                        std::vector<Instruction *> vecCallChain;
+                        mapParentInst[Callee] = CallInst;
+                        std::set<Function *> TraceVisited;
+                        auto it = mapParentInst.find(Callee);
+                        while (it != mapParentInst.end()) {
+                            Instruction *ParentInst = it->second;
+                            vecCallChain.push_back(ParentInst);
+                            Function *ParentFunc = ParentInst->getParent()->getParent();
+                            it = mapParentInst.find(ParentFunc);
+                            if (it != mapParentInst.end()) {
+                                if (TraceVisited.find(it->first) != TraceVisited.end()) {
+                                    break;
+                                } else {
+                                    TraceVisited.insert(it->first);
                                 }
                             }
-                            // end of backtrack
-                            HasDoubleLock = true;
                         }
-                        WorkList.push(Callee);
-                        mapParentInst[Callee] = CallInst;
-                        Visited.insert(Callee);
+                        // end of backtrack
+                        std::reverse(vecCallChain.begin(), vecCallChain.end());
+                        std::vector<Instruction *> vecAliasLock;
+                        Alias.getLocksIn(Callee, vecAliasLock);
+                        vecFinding.push_back(makeDoubleLockFinding(LockInst, vecAliasLock, vecCallChain));
+                        HasDoubleLock = true;
                     }
+                    WorkList.push(Callee);
+                    mapParentInst[Callee] = CallInst;
+                    Visited.insert(Callee);
                 }
             }
         }
@@ -1324,9 +496,11 @@ namespace detector {
     }
 
     static bool trackLockInst(Instruction *LockInst,
-                              std::set<Instruction *> setMayAliasLock,
-                              std::set<Instruction *> setDrop,
-                              std::map<Function *, std::map<Instruction *, Function *>> &mapCallerCallees) {
+                              const MayAliasLocks &Alias,
+                              const std::set<Instruction *> &setDrop,
+                              const CallGraphIndex &CG,
+                              ExplorationBudget &Budget,
+                              std::vector<Finding> &vecFinding) {
 
 //        std::set<Function *> setMayAliasFunc;
 //        for (Instruction *I : setMayAliasLock) {
@@ -1334,13 +508,6 @@ namespace detector {
 //                setMayAliasFunc.insert(I->getParent()->getParent());
 //            }
 //        }
-        std::map<Function *, std::set<Instruction *>> mapMayAliasFuncLock;
-        for (Instruction *I : setMayAliasLock) {
-            if (I != LockInst) {
-                Function *AliasFunc = I->getParent()->getParent();
-                mapMayAliasFuncLock[AliasFunc].insert(I);
-            }
-        }
 //        // Debug
 //        printDebugInfo(LockInst);
 //        for (Function *F : setMayAliasFunc) {
@@ -1349,9 +516,6 @@ namespace detector {
         std::stack<BasicBlock *> WorkList;
         std::set<BasicBlock *> Visited;
 
-        Function *Caller = LockInst->getParent()->getParent();
-        auto &mapCallInstCallee = mapCallerCallees[Caller];
-
 //        // Debug
 //        for (auto &kv : mapCallInstCallee) {
 //            kv.first->print(errs());
@@ -1363,11 +527,14 @@ namespace detector {
         while (!WorkList.empty()) {
             BasicBlock *Curr = WorkList.top();
             WorkList.pop();
+            if (!Budget.takeBlock()) {
+                break;
+            }
             bool StopPropagation = false;
             for (Instruction &II: *Curr) {
                 Instruction *I = &II;
                 // contains same Lock
-                if (setMayAliasLock.find(I) != setMayAliasLock.end()) {
+                if (Alias.contains(I)) {
                     // Restore
 //                    errs() << "Double Lock Happens! First Lock:\n";
 //                    printDebugInfo(LockInst);
@@ -1384,19 +551,31 @@ namespace detector {
                     break;
                 } else {
                     // is a CallInst
-                    auto it = mapCallInstCallee.find(I);
-                    if (it == mapCallInstCallee.end()) {
+                    Function *Callee = CG.getCalleeOf(I);
+                    if (!Callee) {
+                        // an indirect call: track each candidate callee
+                        bool Tracked = false;
+                        for (unsigned Site : CG.indirectSitesOf(I)) {
+                            auto CalleeSite = std::make_pair(I, CG.getCallee(Site));
+                            if (trackCallee(LockInst, CalleeSite, CG, Alias, Budget, vecFinding)) {
+                                Tracked = true;
+                                break;
+                            }
+                        }
+                        if (Tracked) {
+                            StopPropagation = true;
+                            break;
+                        }
                         continue;
                     } else {
-                        Instruction *CI = it->first;
-                        Function *Callee = it->second;
+                        Instruction *CI = I;
 //                        errs() << Callee->getName() << "\n";
                         auto CalleeSite = std::make_pair(CI, Callee);
 //                        if (trackCallee(LockInst, CalleeSite, mapCallerCallees, setMayAliasFunc)) {
 //                            StopPropagation = true;
 //                            break;
 //                        }
-                        if (trackCallee(LockInst, CalleeSite, mapCallerCallees, mapMayAliasFuncLock)) {
+                        if (trackCallee(LockInst, CalleeSite, CG, Alias, Budget, vecFinding)) {
                             StopPropagation = true;
                             break;
                         }
@@ -1420,31 +599,34 @@ namespace detector {
     }
 
     bool SameLockInSameFuncDetector::runOnModule(Module &M) {
+        LegacyFuncAnalyses Analyses(*this);
+        return detect(M, Analyses);
+    }
+
+    bool SameLockInSameFuncDetector::detect(Module &M, FuncAnalyses &Analyses) {
         this->pModule = &M;
 
-        std::map<Function *, std::map<Instruction *, Function *>> mapGlobalCallSite;
-        for (Function &F : M) {
-            collectGlobalCallSite(&F, mapGlobalCallSite[&F]);
-        }
+        Deadline RunDeadline;
+        std::vector<TruncatedSearch> vecTruncated;
+        std::vector<Finding> vecFinding;
 
-        std::map<Function *, std::set<Instruction *>> mapCalleeToCallSites;
-        for (auto &CallerCallSites : mapGlobalCallSite) {
-            for (auto &CallInstCallee : CallerCallSites.second) {
-                mapCalleeToCallSites[CallInstCallee.second].insert(CallInstCallee.first);
-            }
+        CallGraphIndex CG(M);
+        for (Function &F : M) {
+            collectGlobalCallSite(&F, CG);
         }
+        IndirectCallIndex Indirect(M);
+        addIndirectCalls(Indirect, CG);
+        CG.build();
 
+        GuardLifetime GL(M.getDataLayout());
         LockGenKillInfoMapTy mapLockGenKillInfo;
-        for (auto &kv : mapGlobalCallSite) {
-            collectLockGenKillInfo(kv.second, mapLockGenKillInfo, M.getDataLayout());
-        }
+        collectLockGenKillInfo(CG, mapLockGenKillInfo, GL);
 
         std::map<Type *, std::map<Instruction *, stLockGenKillSet>> mapSameTypeLock;
         for (auto &InstInfo: mapLockGenKillInfo) {
             Type *Ty = InstInfo.second.RLI.LockValue->getType();
             if (!Ty) {
-                errs() << "Cannot get Type of LockValue of Inst\n";
-                printDebugInfo(InstInfo.first);
+                LLVM_DEBUG(dbgs() << "Cannot get Type of LockValue of Inst\n"; printDebugInfo(InstInfo.first, dbgs()));
                 continue;
             }
             mapSameTypeLock[Ty][InstInfo.first] = InstInfo.second;
@@ -1456,54 +638,45 @@ namespace detector {
                 Instruction *CurrInst = kv.first;
                 ResultLockInfo InnerRLI = kv.second.RLI;
                 Function *LockWrapper = CurrInst->getFunction();
-                if (mapCalleeToCallSites.find(LockWrapper) == mapCalleeToCallSites.end()) {
-                    continue;
-                }
-
-                for (Instruction *WrapperLockInst : mapCalleeToCallSites[LockWrapper]) {
+                for (unsigned Site : CG.callSitesOf(LockWrapper)) {
+                    Instruction *WrapperLockInst = CG.getCallInst(Site);
                     ResultLockInfo RLI;
                     RLI.ResultValue = WrapperLockInst;
                     RLI.LockType = InnerRLI.LockType;
                     RLI.Wrapped = true;
                     RLI.LockValue = InnerRLI.LockValue;
                     stLockGenKillSet &GKS = mapWrapperLockGenKillInfo[WrapperLockInst];
-                    collectLockGenKillInfoForLock(WrapperLockInst, RLI, GKS, M.getDataLayout());
+                    collectLockGenKillInfoForLock(WrapperLockInst, RLI, GKS, GL);
                 }
             }
             if (!kv.second.setLockGuardReturned.empty()) {
                 Instruction *CurrInst = kv.first;
                 ResultLockInfo InnerRLI = kv.second.RLI;
                 Function *LockWrapper = CurrInst->getFunction();
-                if (mapCalleeToCallSites.find(LockWrapper) == mapCalleeToCallSites.end()) {
-                    continue;
-                }
-
-                for (Instruction *WrapperLockInst : mapCalleeToCallSites[LockWrapper]) {
+                for (unsigned Site : CG.callSitesOf(LockWrapper)) {
+                    Instruction *WrapperLockInst = CG.getCallInst(Site);
                     ResultLockInfo RLI;
                     RLI.ResultValue = WrapperLockInst;
                     RLI.LockType = InnerRLI.LockType;
                     RLI.Wrapped = false;
                     RLI.LockValue = InnerRLI.LockValue;
                     stLockGenKillSet &GKS = mapWrapperLockGenKillInfo[WrapperLockInst];
-                    collectLockGenKillInfoForLock(WrapperLockInst, RLI, GKS, M.getDataLayout());
+                    collectLockGenKillInfoForLock(WrapperLockInst, RLI, GKS, GL);
                 }
             }
         }
 
         for (auto &kv : mapWrapperLockGenKillInfo) {
-            errs() << "Wrapper LockInst:\n";
-            kv.first->print(errs());
-            errs() << "\n";
-            errs() << "Result Returned:" << kv.second.setResultReturned.size() << "\n";
-            errs() << "LockGuard Returned:" << kv.second.setLockGuardReturned.size() << "\n";
+            LLVM_DEBUG(dbgs() << "Wrapper LockInst:\n"; kv.first->print(dbgs()); dbgs() << "\n";
+                       dbgs() << "Result Returned:" << kv.second.setResultReturned.size() << "\n";
+                       dbgs() << "LockGuard Returned:" << kv.second.setLockGuardReturned.size() << "\n");
         }
 
         std::map<Type *, std::map<Instruction *, stLockGenKillSet>> mapWrapperSameTypeLock;
         for (auto &InstInfo: mapWrapperLockGenKillInfo) {
             Type *Ty = InstInfo.second.RLI.LockValue->getType();
             if (!Ty) {
-                errs() << "Cannot get Type of LockValue of Inst\n";
-                printDebugInfo(InstInfo.first);
+                LLVM_DEBUG(dbgs() << "Cannot get Type of LockValue of Inst\n"; printDebugInfo(InstInfo.first, dbgs()));
                 continue;
             }
             mapWrapperSameTypeLock[Ty][InstInfo.first] = InstInfo.second;
@@ -1577,27 +750,30 @@ namespace detector {
 //        }
 
         for (auto &TyResult: mapSameTypeLock) {
+            LockBucketIndex Index;
+            for (auto &InstLI : TyResult.second) {
+                Index.addLock(InstLI.first);
+            }
             for (auto &InstLI : TyResult.second) {
                 Instruction *CurrLockInst = InstLI.first;
                 Value *CurrLockValue = InstLI.second.RLI.LockValue;
                 LockShareType CurrLockShareType = InstLI.second.RLI.LockType;
                 Function *CurrFunc = CurrLockInst->getFunction();
-                std::set<Instruction *> setMayAliasLock;
-                for (auto &OtherInstLI : TyResult.second) {
-                    if (OtherInstLI.first != CurrLockInst) {
-                        if (CurrFunc == OtherInstLI.first->getFunction()) {  // In same function, use Alias
-                            errs() << "In the Same Function\n";
-                            AliasAnalysis &AA = getAnalysis<AAResultsWrapperPass>(*CurrFunc).getAAResults();
-                            if (AA.alias(CurrLockValue, OtherInstLI.second.RLI.LockValue) == MustAlias) {
-                                if (CurrLockShareType == LockShareType::SharedLock
-                                && OtherInstLI.second.RLI.LockType == LockShareType::SharedLock) {  // both shared lock
-                                    continue;
-                                } else {
-                                    setMayAliasLock.insert(OtherInstLI.first);
-                                }
-                            }
-                        } else {  // In different function, track self same field, but
-                            setMayAliasLock.insert(OtherInstLI.first);
+                // In different functions every lock of the type may alias; in the same function, use Alias
+                std::set<Instruction *> setSameFuncAliasLock;
+                for (Instruction *OtherLockInst : Index.getLocks(CurrFunc)) {
+                    if (OtherLockInst == CurrLockInst) {
+                        continue;
+                    }
+                    LLVM_DEBUG(dbgs() << "In the Same Function\n");
+                    ResultLockInfo &OtherRLI = TyResult.second[OtherLockInst].RLI;
+                    AliasAnalysis &AA = Analyses.getAA(*CurrFunc);
+                    if (AA.alias(CurrLockValue, OtherRLI.LockValue) == MustAlias) {
+                        if (CurrLockShareType == LockShareType::SharedLock
+                        && OtherRLI.LockType == LockShareType::SharedLock) {  // both shared lock
+                            continue;
+                        } else {
+                            setSameFuncAliasLock.insert(OtherLockInst);
                         }
                     }
                 }
@@ -1634,9 +810,20 @@ namespace detector {
                     }
                 }
 
-                trackLockInst(CurrLockInst, setMayAliasLock, setLockDrop, mapGlobalCallSite);
+                ExplorationBudget Budget(RunDeadline);
+                trackLockInst(CurrLockInst, MayAliasLocks(Index, CurrLockInst, &setSameFuncAliasLock), setLockDrop,
+                              CG, Budget, vecFinding);
+                recordTruncation(CurrLockInst, Budget, vecTruncated);
             }
         }
+        if (pReports) {
+            pReports->add(vecFinding);
+        } else {
+            ReportCollector Reports;
+            Reports.add(vecFinding);
+            Reports.write("SameLockInSameFuncDetector");
+        }
+        printTruncationSummary(vecTruncated, errs());
 
 
 
@@ -1821,10 +1008,24 @@ namespace detector {
         return false;
     }
 
+    PreservedAnalyses SameLockInSameFuncDetectorPass::run(Module &M, ModuleAnalysisManager &MAM) {
+        FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+        NewPMFuncAnalyses Analyses(FAM);
+        SameLockInSameFuncDetector Detector;
+        Detector.detect(M, Analyses);
+        return PreservedAnalyses::all();
+    }
+
 }  // namespace detector
 
 static RegisterPass<detector::SameLockInSameFuncDetector> X(
         "detect",
         "Detect Same Lock/Atomic",
         false,
-        true);
\ No newline at end of file
+        true);
+
+#ifndef RBD_LINK_INTO_TOOLS
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo llvmGetPassPluginInfo() {
+    return detector::getDetectorPluginInfo<detector::SameLockInSameFuncDetectorPass>("SameLockInSameFuncDetector");
+}
+#endif
@@ -23,10 +23,13 @@
 #include "llvm/Analysis/CaptureTracking.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Operator.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/TypeName.h"
 #include "llvm/Analysis/LoopInfo.h"
 
 #include "Common/CallerFunc.h"
+#include "Common/DetectorPlugin.h"
+#include "Common/FuncAnalyses.h"
 
 #define DEBUG_TYPE "UseAfterFreeDetector"
 
@@ -38,18 +41,12 @@ namespace detector {
 
     UseAfterFreeDetector::UseAfterFreeDetector() : ModulePass(ID) {
         PassRegistry &Registry = *PassRegistry::getPassRegistry();
-        initializeDominatorTreeWrapperPassPass(Registry);
-        initializePostDominatorTreeWrapperPassPass(Registry);
         initializeAAResultsWrapperPassPass(Registry);
-        initializeLoopInfoWrapperPassPass(Registry);
     }
 
     void UseAfterFreeDetector::getAnalysisUsage(AnalysisUsage &AU) const {
         AU.setPreservesAll();
-        AU.addRequired<DominatorTreeWrapperPass>();
-        AU.addRequired<PostDominatorTreeWrapperPass>();
         AU.addRequired<AAResultsWrapperPass>();
-        AU.addRequired<LoopInfoWrapperPass>();
     }
 
     static bool isDropInst(Instruction *I) {
@@ -91,18 +88,16 @@ namespace detector {
     }
 
     static void addUses(const Value *V, std::stack<const Use *> &WorkList, std::set<const Use *> &Visited) {
-        errs() << "Start\n";
+        LLVM_DEBUG(dbgs() << "Start\n");
         for (const Use &U : V->uses()) {
-            U.getUser()->print(errs());
-            errs() << '\n';
+            LLVM_DEBUG(U.getUser()->print(dbgs()); dbgs() << '\n');
             if (Visited.find(&U) == Visited.end()) {
-                U.getUser()->print(errs());
-                errs() << '\n';
+                LLVM_DEBUG(U.getUser()->print(dbgs()); dbgs() << '\n');
                 Visited.insert(&U);
                 WorkList.push(&U);
             }
         }
-        errs() << "End\n";
+        LLVM_DEBUG(dbgs() << "End\n");
     }
 
     static void trackDependence(const Value *V, std::set<const Use *> &Visited, std::set<const Instruction *> &setDropInst) {
@@ -119,8 +114,7 @@ namespace detector {
             Instruction *I = cast<Instruction>(U->getUser());
             V = U->get();
 
-            I->print(errs());
-            errs() << '\n';
+            LLVM_DEBUG(I->print(dbgs()); dbgs() << '\n');
 
             switch (I->getOpcode()) {
                 case Instruction::Call:
@@ -186,13 +180,12 @@ namespace detector {
 //        }
 //        errs() << "End of setDropInst\n";
         std::set<const Use *> NoDropVisited;
-        errs() << "Visited\n";
+        LLVM_DEBUG(dbgs() << "Visited\n");
         for (const Use *U : Visisted) {
             Instruction *UI = cast<Instruction>(U->getUser());
             if (setDropInst.find(UI) == setDropInst.end()) {
                 NoDropVisited.insert(U);
-                UI->print(errs());
-                errs() << '\n';
+                LLVM_DEBUG(UI->print(dbgs()); dbgs() << '\n');
             }
         }
 //        errs() << "End of Visited\n";
@@ -220,14 +213,11 @@ namespace detector {
             }
             if (canPostDominate) {
                 // Debug
-                errs() << "DropInst can be post dominated by the Instruction:\n";
-                if (Instruction *UI = cast<Instruction>(U->getUser())) {
-                    UI->print(errs());
-                    errs() << '\n';
-                    errs() << "In Function, BB:\n";
-                    errs() << UI->getParent()->getParent()->getName() << ", " << UI->getParent()->getName() << '\n';
-                }
-                errs() << '\n';
+                LLVM_DEBUG(dbgs() << "DropInst can be post dominated by the Instruction:\n";
+                           Instruction *UI = cast<Instruction>(U->getUser());
+                           UI->print(dbgs()); dbgs() << '\n';
+                           dbgs() << "In Function, BB:\n";
+                           dbgs() << UI->getParent()->getParent()->getName() << ", " << UI->getParent()->getName() << "\n\n");
                 break;
             }
         }
@@ -414,12 +404,10 @@ namespace detector {
         errs() << "In Function: " << DropFunc->getName() << "\n";
         printDebugInfo(DropInst);
         errs() << "DropBB: " << DropBB->getName() << "\n";
-        DropInst->print(errs());
-        errs() << "\n";
+        LLVM_DEBUG(DropInst->print(dbgs()); dbgs() << "\n");
         printDebugInfo(UseAfterDrop);
         errs() << "UseBB: " << UseBB->getName() << "\n";
-        UseAfterDrop->print(errs());
-        errs() << "\n";
+        LLVM_DEBUG(UseAfterDrop->print(dbgs()); dbgs() << "\n");
         return true;
     }
 
@@ -730,9 +718,7 @@ namespace detector {
 //                }
                 auto result = AA.alias(Curr, AI);
 //                errs() << "Result:\n";
-                Curr->print(errs());
-                errs() << "\n";
-                errs() << result << "\n";
+                LLVM_DEBUG(Curr->print(dbgs()); dbgs() << "\n" << result << "\n");
 //                if (result != NoAlias) {
                     if (Instruction *CI = dyn_cast<Instruction>(Curr)) {
                         for (Instruction *DI : kv.second) {
@@ -746,9 +732,7 @@ namespace detector {
                         }
                     }
                     for (User *U : Curr->users()) {
-                        errs() << "Users:\n";
-                        U->print(errs());
-                        errs() << "\n";
+                        LLVM_DEBUG(dbgs() << "Users:\n"; U->print(dbgs()); dbgs() << "\n");
 
                         if (Value *V = dyn_cast<Value>(U)) {
                             if (Visited.find(V) == Visited.end()) {
@@ -772,20 +756,14 @@ namespace detector {
                 if (UI) {
                 auto result = AA.alias(I, UI);
                 if (result != NoAlias) {
-                    errs() << "AliasAnalysis:\n";
-                    I->print(errs());
-                    errs() << "\n";
-                    UI->print(errs());
-                    errs() << "\n";
-                    errs() << "AliasResult:" << result << "\n";
+                    LLVM_DEBUG(dbgs() << "AliasAnalysis:\n"; I->print(dbgs()); dbgs() << "\n";
+                               UI->print(dbgs()); dbgs() << "\n" << "AliasResult:" << result << "\n");
                     for (User *NU : UI->users()) {
                         for (Instruction *DI : kv.second) {
                             if (Instruction *NUI = dyn_cast<Instruction>(NU)) {
                                 if (isReachableInst(DI, NUI)) {
                                     errs() << "Use After Free!\n";
-                                    DI->print(errs());
-                                    NUI->print(errs());
-                                    errs() << "\n";
+                                    LLVM_DEBUG(DI->print(dbgs()); NUI->print(dbgs()); dbgs() << "\n");
                                     return true;
                                 }
                             }
@@ -848,12 +826,9 @@ namespace detector {
                                                     if (isEscapeInst(UI4, DropInst)) {
                                                         printUseAfterFreeDebugInfo(DropInst, UI4);
                                                         // Debug
-                                                        UI3->print(errs());
-                                                        errs() << "\n";
-                                                        UI2->print(errs());
-                                                        errs() << "\n";
-                                                        UI->print(errs());
-                                                        errs() << "\n";
+                                                        LLVM_DEBUG(UI3->print(dbgs()); dbgs() << "\n";
+                                                                   UI2->print(dbgs()); dbgs() << "\n";
+                                                                   UI->print(dbgs()); dbgs() << "\n");
                                                         return true;
                                                     }
                                                 }
@@ -874,10 +849,8 @@ namespace detector {
                             if (isEscapeInst(UI2, DropInst)) {
                                 printUseAfterFreeDebugInfo(DropInst, UI2);
                                 // Debug
-                                UI2->print(errs());
-                                errs() << "\n";
-                                UI->print(errs());
-                                errs() << "\n";
+                                LLVM_DEBUG(UI2->print(dbgs()); dbgs() << "\n";
+                                           UI->print(dbgs()); dbgs() << "\n");
                                 return true;
                             }
                         }
@@ -918,30 +891,21 @@ namespace detector {
         Value *V = I->getOperand(0);
         for (User *U : V->users()) {
             if (Instruction *UI = cast<Instruction>(U)) {
-                UI->print(errs());
-                errs() << '\n';
+                LLVM_DEBUG(UI->print(dbgs()); dbgs() << '\n');
                 for (User *U2 : UI->users()) {
                     if (Instruction *UI2 = cast<Instruction>(U2)) {
-                        errs() << "\t";
-                        UI2->print(errs());
-                        errs() << "\t\n";
+                        LLVM_DEBUG(dbgs() << "\t"; UI2->print(dbgs()); dbgs() << "\t\n");
                         for (User *U3 : UI2->users()) {
                             if (Instruction *UI3 = cast<Instruction>(U3)) {
-                                errs() << "\t\t";
-                                UI3->print(errs());
-                                errs() << "\t\t\n";
+                                LLVM_DEBUG(dbgs() << "\t\t"; UI3->print(dbgs()); dbgs() << "\t\t\n");
                             }
                             for (User *U4 : U3->users()) {
                                 if (Instruction *UI4 = cast<Instruction>(U4)) {
-                                    errs() << "\t\t\t";
-                                    UI4->print(errs());
-                                    errs() << "\t\t\n";
+                                    LLVM_DEBUG(dbgs() << "\t\t\t"; UI4->print(dbgs()); dbgs() << "\t\t\n");
                                     if (isReachableInBB(I, UI4) || isReachableAcrossBB(I, UI4)) {
                                         errs() << "Reachable!\n";
-                                        I->print(errs());
-                                        errs() << "\n";
-                                        UI4->print(errs());
-                                        errs() << "\n";
+                                        LLVM_DEBUG(I->print(dbgs()); dbgs() << "\n";
+                                                   UI4->print(dbgs()); dbgs() << "\n");
                                         return true;
                                     }
                                 }
@@ -1001,11 +965,11 @@ namespace detector {
             return false;
         }
 
-        errs() << "Alloca\n";
-        for (Instruction *I : setAllocaInst) {
-            I->print(errs());
-            errs() << "\n";
-        }
+        LLVM_DEBUG(dbgs() << "Alloca\n";
+                   for (Instruction *I : setAllocaInst) {
+                       I->print(dbgs());
+                       dbgs() << "\n";
+                   });
 
 //        errs() << "Alloca has drop\n";
 //        std::map<Instruction *, std::set<Instruction *>> mapAllocaToDropInstFiltered;
@@ -1088,7 +1052,12 @@ namespace detector {
         return true;
     }
 
-    bool UseAfterFreeDetector::runOnModule(llvm::Module &M) {
+    bool UseAfterFreeDetector::runOnModule(Module &M) {
+        LegacyFuncAnalyses Analyses(*this);
+        return detect(M, Analyses);
+    }
+
+    bool UseAfterFreeDetector::detect(Module &M, FuncAnalyses &Analyses) {
         for (Function &F : M) {
             if (F.begin() == F.end()) {
                 continue;
@@ -1104,7 +1073,7 @@ namespace detector {
 //            if (F.getName() != "_ZN7openssl3cms14CmsContentInfo7encrypt17h3ef6cac406f7cd43E") {
 //                continue;
 //            }
-            LoopInfo &LoopInfo = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+            LoopInfo &LoopInfo = Analyses.getLoopInfo(F);
             std::set<Instruction *> setDropInst;
             collectDropInsts(&F, setDropInst, LoopInfo);
 //            errs() << F.getName() << "\n";
@@ -1164,11 +1133,8 @@ namespace detector {
                             for (Instruction *R: setReturn) {
                                 if (PDT.dominates(R->getParent(), UI->getParent())) {
                                     // Debug
-                                    errs() << "Return: ";
-                                    R->print(errs());
-                                    errs() << "postdom\n";
-                                    UI->print(errs());
-                                    errs() << '\n';
+                                    LLVM_DEBUG(dbgs() << "Return: "; R->print(dbgs()); dbgs() << "postdom\n";
+                                               UI->print(dbgs()); dbgs() << '\n');
                                     return true;
                                 }
                             }
@@ -1241,6 +1207,14 @@ namespace detector {
 //        return false;
 //    }
 
+    PreservedAnalyses UseAfterFreeDetectorPass::run(Module &M, ModuleAnalysisManager &MAM) {
+        FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+        NewPMFuncAnalyses Analyses(FAM);
+        UseAfterFreeDetector Detector;
+        Detector.detect(M, Analyses);
+        return PreservedAnalyses::all();
+    }
+
 }  // namespace detector
 
 
@@ -1249,3 +1223,9 @@ static RegisterPass<detector::UseAfterFreeDetector> X(
         "Detect Use After Free",
         false,
         true);
+
+#ifndef RBD_LINK_INTO_TOOLS
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo llvmGetPassPluginInfo() {
+    return detector::getDetectorPluginInfo<detector::UseAfterFreeDetectorPass>("UseAfterFreeDetector");
+}
+#endif
@@ -0,0 +1,57 @@
+; A lock held in outer is taken again by the Drop impl of a local type, which
+; core::ptr::drop_in_place reaches two calls down.
+%"Mutex<u32>" = type { i32 }
+%"MutexGuard<u32>" = type { %"Mutex<u32>"* }
+
+define %"MutexGuard<u32>"* @"_ZN8lock_api5mutex18Mutex$LT$R$C$T$GT$4lock17h0000000000000001E"(%"Mutex<u32>"* %m) !dbg !20 {
+  ret %"MutexGuard<u32>"* null
+}
+
+define void @"_ZN4core3ptr18real_drop_in_place17h0000000000000002E"(%"MutexGuard<u32>"* %g) !dbg !21 {
+  ret void
+}
+
+define void @"_ZN4core3ptr13drop_in_place17h0000000000000003E"(%"Mutex<u32>"* %m) !dbg !25 {
+  call void @"_ZN4core3ptr13drop_in_place17h0000000000000004E"(%"Mutex<u32>"* %m), !dbg !40
+  ret void
+}
+
+define void @"_ZN4core3ptr13drop_in_place17h0000000000000004E"(%"Mutex<u32>"* %m) !dbg !26 {
+  call void @"_ZN52_$LT$lib..Local$u20$as$u20$core..ops..drop..Drop$GT$4drop17h0000000000000005E"(%"Mutex<u32>"* %m), !dbg !41
+  ret void
+}
+
+define void @"_ZN52_$LT$lib..Local$u20$as$u20$core..ops..drop..Drop$GT$4drop17h0000000000000005E"(%"Mutex<u32>"* %m) !dbg !22 {
+  %g = call %"MutexGuard<u32>"* @"_ZN8lock_api5mutex18Mutex$LT$R$C$T$GT$4lock17h0000000000000001E"(%"Mutex<u32>"* %m), !dbg !30
+  call void @"_ZN4core3ptr18real_drop_in_place17h0000000000000002E"(%"MutexGuard<u32>"* %g), !dbg !31
+  ret void
+}
+
+define void @outer(%"Mutex<u32>"* %m) !dbg !23 {
+  %g = call %"MutexGuard<u32>"* @"_ZN8lock_api5mutex18Mutex$LT$R$C$T$GT$4lock17h0000000000000001E"(%"Mutex<u32>"* %m), !dbg !32
+  call void @"_ZN4core3ptr13drop_in_place17h0000000000000003E"(%"Mutex<u32>"* %m), !dbg !33
+  call void @"_ZN4core3ptr18real_drop_in_place17h0000000000000002E"(%"MutexGuard<u32>"* %g), !dbg !34
+  ret void
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!2, !3}
+!0 = distinct !DICompileUnit(language: DW_LANG_Rust, file: !1, producer: "rustc", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug)
+!1 = !DIFile(filename: "src/lib.rs", directory: "/work/crate")
+!2 = !{i32 2, !"Debug Info Version", i32 3}
+!3 = !{i32 7, !"Dwarf Version", i32 4}
+!4 = !DIFile(filename: "ptr/mod.rs", directory: "")
+!10 = !DISubroutineType(types: !{})
+!20 = distinct !DISubprogram(name: "lock", scope: !4, file: !4, line: 1, type: !10, unit: !0)
+!21 = distinct !DISubprogram(name: "real_drop_in_place", scope: !4, file: !4, line: 2, type: !10, unit: !0)
+!22 = distinct !DISubprogram(name: "drop", scope: !1, file: !1, line: 10, type: !10, unit: !0)
+!23 = distinct !DISubprogram(name: "outer", scope: !1, file: !1, line: 20, type: !10, unit: !0)
+!25 = distinct !DISubprogram(name: "drop_in_place", scope: !4, file: !4, line: 3, type: !10, unit: !0)
+!26 = distinct !DISubprogram(name: "drop_in_place", scope: !4, file: !4, line: 3, type: !10, unit: !0)
+!30 = !DILocation(line: 11, scope: !22)
+!31 = !DILocation(line: 12, scope: !22)
+!32 = !DILocation(line: 21, scope: !23)
+!33 = !DILocation(line: 22, scope: !23)
+!34 = !DILocation(line: 23, scope: !23)
+!40 = !DILocation(line: 4, scope: !25)
+!41 = !DILocation(line: 4, scope: !26)
@@ -0,0 +1,172 @@
+#include "LazyLoad.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/DebugLoc.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Error.h"
+
+#include "Common/CallerFunc.h"
+
+#define DEBUG_TYPE "rbd"
+
+using namespace llvm;
+
+namespace detector {
+
+    // Monomorphizations of core/std/alloc items and of their trait impls,
+    // e.g. _ZN4core3ptr... or _ZN<len>_$LT$alloc..vec..Vec$LT$T$GT$...
+    static bool isLibraryFunc(StringRef Name) {
+        if (!Name.consume_front("_ZN")) {
+            return false;
+        }
+        unsigned Len;
+        if (Name.consumeInteger(10, Len)) {
+            return false;
+        }
+        static const char *LibraryCrates[] = {"core", "std", "alloc"};
+        for (const char *Crate : LibraryCrates) {
+            StringRef CrateName(Crate);
+            if (Len == CrateName.size() && Name.startswith(CrateName)) {
+                return true;
+            }
+            if (Name.startswith(("_$LT$" + CrateName + "..").str())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool isLockAPI(StringRef Name) {
+        return Name.find("$GT$4lock") != StringRef::npos
+               || Name.find("$GT$4read") != StringRef::npos
+               || Name.find("$GT$5write") != StringRef::npos
+               || Name.find("HandyRwLock") != StringRef::npos;
+    }
+
+    static bool isDropAPI(StringRef Name) {
+        return Name.find("drop_in_place") != StringRef::npos || Name.startswith("_ZN4core3mem4drop17h");
+    }
+
+    static bool isCellAPI(StringRef Name) {
+        return Name.startswith("_ZN4core4cell");
+    }
+
+    // Same test as isLocalCrateInst in the detectors: library code has no directory.
+    static bool isLocalCrateFunc(Function &F) {
+        for (BasicBlock &BB : F) {
+            for (Instruction &I : BB) {
+                const DebugLoc &Loc = I.getDebugLoc();
+                if (Loc && Loc->getDirectory() != "") {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    static bool materialize(Function &F, raw_ostream &ErrOS) {
+        if (Error E = F.materialize()) {
+            logAllUnhandledErrors(std::move(E), ErrOS, "Cannot read " + F.getName() + ": ");
+            return false;
+        }
+        return true;
+    }
+
+    bool materializeReachable(Module &M, raw_ostream &ErrOS) {
+        // Only a body tells whether a function is local-crate code, so the
+        // bodies outside core/std/alloc are read to find the roots.
+        unsigned NumBodies = 0;
+        std::vector<Function *> WorkList;
+        std::set<Function *> Reached;
+        for (Function &F : M) {
+            if (F.isDeclaration()) {
+                continue;
+            }
+            ++NumBodies;
+            if (isLibraryFunc(F.getName())) {
+                continue;
+            }
+            if (F.isMaterializable() && !materialize(F, ErrOS)) {
+                return false;
+            }
+            if (isLocalCrateFunc(F)) {
+                WorkList.push_back(&F);
+                Reached.insert(&F);
+            }
+        }
+        std::set<Function *> setRoot(Reached);
+
+        // Read the callees as the traversal reaches them, and note the callers
+        // of each to find the functions on a path to a lock, drop or Cell API.
+        std::map<Function *, std::vector<Function *>> mapCallers;
+        std::vector<Function *> vecAPI;
+        while (!WorkList.empty()) {
+            Function *Curr = WorkList.back();
+            WorkList.pop_back();
+            for (BasicBlock &BB : *Curr) {
+                for (Instruction &I : BB) {
+                    CallSite CS;
+                    Function *Callee = getCalledFunc(&I, CS);
+                    if (!Callee) {
+                        continue;
+                    }
+                    mapCallers[Callee].push_back(Curr);
+                    if (!Reached.insert(Callee).second) {
+                        continue;
+                    }
+                    StringRef Name = Callee->getName();
+                    if (isLockAPI(Name) || isDropAPI(Name) || isCellAPI(Name)) {
+                        vecAPI.push_back(Callee);
+                    }
+                    if (Callee->isMaterializable() && !materialize(*Callee, ErrOS)) {
+                        return false;
+                    }
+                    if (!Callee->isDeclaration()) {
+                        WorkList.push_back(Callee);
+                    }
+                }
+            }
+        }
+
+        // The roots, and every reached function that can call into an API.
+        std::set<Function *> setKeep(setRoot);
+        std::set<Function *> setToAPI(vecAPI.begin(), vecAPI.end());
+        while (!vecAPI.empty()) {
+            Function *Curr = vecAPI.back();
+            vecAPI.pop_back();
+            setKeep.insert(Curr);
+            for (Function *Caller : mapCallers[Curr]) {
+                if (setToAPI.insert(Caller).second) {
+                    vecAPI.push_back(Caller);
+                }
+            }
+        }
+
+        unsigned NumKept = 0;
+        for (Function &F : M) {
+            if (F.isDeclaration()) {
+                continue;
+            }
+            if (setKeep.find(&F) != setKeep.end()) {
+                ++NumKept;
+                continue;
+            }
+            // A declaration cannot stay in a comdat.
+            F.deleteBody();
+            F.setComdat(nullptr);
+        }
+        LLVM_DEBUG(dbgs() << "Kept " << NumKept << " of " << NumBodies << " function bodies\n");
+
+        if (Error E = M.materializeAll()) {
+            logAllUnhandledErrors(std::move(E), ErrOS, "Cannot read " + M.getModuleIdentifier() + ": ");
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef RUSTBUGDETECTOR_LAZYLOAD_H
+#define RUSTBUGDETECTOR_LAZYLOAD_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace detector {
+
+    // M is opened with getLazyIRFileModule, so only the symbol table and the
+    // globals are read. Materialize the bodies outside core/std/alloc to find the
+    // local-crate functions, then the bodies reached from those through calls.
+    // The local-crate functions and the reached functions on a call path to a
+    // lock, drop or Cell API keep their bodies; every other body is dropped and
+    // its function becomes a declaration, so the detectors never walk into it.
+    bool materializeReachable(llvm::Module &M, llvm::raw_ostream &ErrOS);
+}
+
+#endif //RUSTBUGDETECTOR_LAZYLOAD_H
@@ -0,0 +1,116 @@
+#include "Shard.h"
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils.h"
+
+#include "Common/Parallel.h"
+#include "Common/Snapshot.h"
+#include "Common/SnapshotExtractor.h"
+
+#define DEBUG_TYPE "rbd"
+
+using namespace llvm;
+
+namespace detector {
+
+    bool writeShardSnapshot(const std::string &Filename, unsigned Index, unsigned NumShards,
+                            bool Mem2Reg, bool Cleanup, StringRef OutPath, raw_ostream &ErrOS) {
+        LLVMContext Context;
+        SMDiagnostic Err;
+        std::unique_ptr<Module> M = getLazyIRFileModule(Filename, Err, Context);
+        if (!M) {
+            Err.print("rbd", ErrOS);
+            return false;
+        }
+
+        std::vector<Function *> vecShardFunc;
+        unsigned NumBodies = 0;
+        for (Function &F : *M) {
+            if (F.isDeclaration()) {
+                continue;
+            }
+            if (NumBodies++ % NumShards == Index) {
+                vecShardFunc.push_back(&F);
+            }
+        }
+        LLVM_DEBUG(dbgs() << "Shard " << Index << " reads " << vecShardFunc.size() << " of "
+                          << NumBodies << " function bodies\n");
+
+        for (Function *F : vecShardFunc) {
+            if (Error E = F->materialize()) {
+                logAllUnhandledErrors(std::move(E), ErrOS, "Cannot read " + F->getName() + ": ");
+                return false;
+            }
+            if (verifyFunction(*F, &ErrOS)) {
+                ErrOS << "rbd: " << Filename << ": " << F->getName() << " is broken\n";
+                return false;
+            }
+        }
+
+        // Per function, so that the bodies of the other shards stay unread.
+        legacy::FunctionPassManager FPM(M.get());
+        if (Mem2Reg) {
+            FPM.add(createPromoteMemoryToRegisterPass());
+        }
+        if (Cleanup) {
+            FPM.add(createDeadCodeEliminationPass());
+        }
+        FPM.doInitialization();
+        for (Function *F : vecShardFunc) {
+            FPM.run(*F);
+        }
+        FPM.doFinalization();
+
+        SnapshotWriter Writer;
+        extractSnapshot(*M, Writer);
+        return Writer.write(OutPath, ErrOS);
+    }
+
+    bool runShardProcesses(StringRef Program, ArrayRef<std::string> Args, unsigned NumShards,
+                           unsigned NumJobs, std::vector<std::string> &vecShardFile, raw_ostream &ErrOS) {
+        for (unsigned Shard = 0; Shard < NumShards; ++Shard) {
+            SmallString<128> Path;
+            if (std::error_code EC = sys::fs::createTemporaryFile("rbd-shard", "rbds", Path)) {
+                ErrOS << "rbd: cannot create a shard snapshot file: " << EC.message() << '\n';
+                return false;
+            }
+            vecShardFile.push_back(Path.str().str());
+        }
+
+        std::vector<char> vecFailed(NumShards, false);
+        runOrderedTasks(NumShards, NumJobs, [&](unsigned Shard, raw_ostream &OS) {
+            std::vector<std::string> vecArg(Args.begin(), Args.end());
+            vecArg.push_back("-shard-index=" + std::to_string(Shard));
+            vecArg.push_back("-shard-out=" + vecShardFile[Shard]);
+            std::vector<StringRef> vecArgRef(vecArg.begin(), vecArg.end());
+            std::string ErrMsg;
+            int Status = sys::ExecuteAndWait(Program, vecArgRef, None, {}, 0, 0, &ErrMsg);
+            if (Status != 0) {
+                OS << "rbd: shard " << Shard << " of " << NumShards << " failed";
+                if (!ErrMsg.empty()) {
+                    OS << ": " << ErrMsg;
+                }
+                OS << '\n';
+                vecFailed[Shard] = true;
+            }
+        }, ErrOS);
+        for (char Failed : vecFailed) {
+            if (Failed) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
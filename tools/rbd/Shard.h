@@ -0,0 +1,27 @@
+#ifndef RUSTBUGDETECTOR_SHARD_H
+#define RUSTBUGDETECTOR_SHARD_H
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace detector {
+
+    // Child side of rbd -shards. Open Filename lazily and materialize only the
+    // function bodies of shard Index: every NumShards-th defined function in
+    // module order, starting at Index. Prepare them as rbd does and write their
+    // snapshot to OutPath. The other bodies are never read.
+    bool writeShardSnapshot(const std::string &Filename, unsigned Index, unsigned NumShards,
+                            bool Mem2Reg, bool Cleanup, llvm::StringRef OutPath, llvm::raw_ostream &ErrOS);
+
+    // Parent side: run Program with Args plus -shard-index and -shard-out once
+    // per shard, at most NumJobs at a time, and return the snapshot file of every
+    // shard in vecShardFile. The caller removes the files, also on failure.
+    bool runShardProcesses(llvm::StringRef Program, llvm::ArrayRef<std::string> Args, unsigned NumShards,
+                           unsigned NumJobs, std::vector<std::string> &vecShardFile, llvm::raw_ostream &ErrOS);
+}
+
+#endif //RUSTBUGDETECTOR_SHARD_H
@@ -0,0 +1,423 @@
+// rbd: parse and verify one bitcode module, then run the selected detectors on it
+// in a single pass manager, so the module is loaded once and analyses are shared.
+// Given a directory such as target/debug/deps, it checks every bitcode file in it
+// and writes one report for all of them. A snapshot written by -write-snapshot
+// can be given in place of the bitcode, for the detectors that read snapshots.
+// With -shards, child rbd processes each extract a snapshot of a part of the
+// function bodies and this process checks their merged snapshot.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils.h"
+
+#include "AtomicControlDepDetector/AtomicControlDepDetector.h"
+#include "CellIMDetector/CellIMDetector.h"
+#include "DoubleLockDetector/DoubleLockDetector.h"
+#include "InvalidFreeDetector/InvalidFreeDetector.h"
+#include "NewCellIMDetector/NewCellIMDetector.h"
+#include "NewDoubleLockDetector/NewDoubleLockDetector.h"
+#include "NewDoubleLockDetector/SnapshotDoubleLock.h"
+#include "NewUseAfterFreeDetector/NewUseAfterFreeDetector.h"
+#include "PrintLock/PrintLock.h"
+#include "PrintManualDrop/PrintManualDrop.h"
+#include "RustDoubleLockDetector/RustDoubleLockDetector.h"
+#include "SameLockInSameFuncDetector/SameLockInSameFuncDetector.h"
+#include "UseAfterFreeDetector/UseAfterFreeDetector.h"
+
+#include "Common/Parallel.h"
+#include "Common/Report.h"
+#include "Common/Snapshot.h"
+#include "Common/SnapshotExtractor.h"
+#include "Common/SummaryDB.h"
+
+#include "LazyLoad.h"
+#include "Shard.h"
+
+using namespace llvm;
+using namespace detector;
+
+// In the order they run.
+enum DetectorKind {
+    NewDoubleLock,
+    DoubleLock,
+    RustDoubleLock,
+    SameLock,
+    UseAfterFree,
+    NewUseAfterFree,
+    InvalidFree,
+    CellIM,
+    NewCellIM,
+    AtomicControlDep,
+    PrintLockFuncs,
+    PrintManualDropFuncs,
+};
+
+static cl::opt<std::string> InputFilename(cl::Positional, cl::desc("<input bitcode or directory>"), cl::Required);
+
+static cl::opt<unsigned> NumJobs(
+        "jobs",
+        cl::desc("Number of modules of a directory checked at once, each in its own LLVMContext"),
+        cl::init(1));
+
+static cl::opt<bool> Mem2Reg(
+        "mem2reg",
+        cl::desc("Promote allocas to registers before the detectors run, like opt -mem2reg"),
+        cl::init(true));
+
+static cl::opt<bool> Cleanup(
+        "cleanup",
+        cl::desc("Also remove dead instructions before the detectors run"),
+        cl::init(false));
+
+static cl::opt<bool> LazyLoad(
+        "lazy",
+        cl::desc("Only read the bodies of local-crate functions and of the functions they reach"),
+        cl::init(false));
+
+static cl::opt<std::string> WriteSnapshot(
+        "write-snapshot",
+        cl::desc("Write the facts the detectors read to this snapshot file, which rbd reads in place of the bitcode"),
+        cl::value_desc("filename"),
+        cl::init(""));
+
+static cl::opt<std::string> WriteSummaryDB(
+        "write-summary-db",
+        cl::desc("Add the lock facts of the external crate functions of the module to this -rbd-summary-db file"),
+        cl::value_desc("filename"),
+        cl::init(""));
+
+static cl::opt<unsigned> NumShards(
+        "shards",
+        cl::desc("Split the function bodies of the module over this many rbd processes, "
+                 "each reading only its part, and check the merged snapshot of their facts"),
+        cl::init(1));
+
+static cl::opt<unsigned> ShardIndex("shard-index", cl::desc("Shard a child process of -shards reads"),
+                                    cl::Hidden, cl::init(0));
+
+static cl::opt<std::string> ShardOut("shard-out", cl::desc("Snapshot a child process of -shards writes"),
+                                     cl::Hidden, cl::init(""));
+
+static cl::bits<DetectorKind> Detectors(
+        "detectors", cl::desc("Detectors to run on the module"), cl::CommaSeparated, cl::ZeroOrMore,
+        cl::values(
+                clEnumValN(NewDoubleLock, "new-double-lock", "NewDoubleLockDetector"),
+                clEnumValN(DoubleLock, "double-lock", "DoubleLockDetector"),
+                clEnumValN(RustDoubleLock, "rust-double-lock", "RustDoubleLockDetector"),
+                clEnumValN(SameLock, "same-lock", "SameLockInSameFuncDetector"),
+                clEnumValN(UseAfterFree, "use-after-free", "UseAfterFreeDetector"),
+                clEnumValN(NewUseAfterFree, "new-use-after-free", "NewUseAfterFreeDetector"),
+                clEnumValN(InvalidFree, "invalid-free", "InvalidFreeDetector"),
+                clEnumValN(CellIM, "cell-im", "CellIMDetector"),
+                clEnumValN(NewCellIM, "new-cell-im", "NewCellIMDetector"),
+                clEnumValN(AtomicControlDep, "atomic-control-dep", "AtomicControlDepDetector"),
+                clEnumValN(PrintLockFuncs, "print-lock", "PrintLock"),
+                clEnumValN(PrintManualDropFuncs, "print-manual-drop", "PrintManualDrop")));
+
+static Pass *createDetector(DetectorKind Kind, ReportCollector &Reports) {
+    switch (Kind) {
+        case NewDoubleLock:
+            return new NewDoubleLockDetector(&Reports);
+        case DoubleLock:
+            return new DoubleLockDetector(&Reports);
+        case RustDoubleLock:
+            return new RustDoubleLockDetector(&Reports);
+        case SameLock:
+            return new SameLockInSameFuncDetector(&Reports);
+        case UseAfterFree:
+            return new UseAfterFreeDetector();
+        case NewUseAfterFree:
+            return new NewUseAfterFreeDetector();
+        case InvalidFree:
+            return new InvalidFreeDetector();
+        case CellIM:
+            return new CellIMDetector();
+        case NewCellIM:
+            return new NewCellIMDetector();
+        case AtomicControlDep:
+            return new AtomicControlDepDetector();
+        case PrintLockFuncs:
+            return new PrintLock();
+        case PrintManualDropFuncs:
+            return new PrintManualDrop();
+    }
+    return nullptr;
+}
+
+// The command line, passed on to the -shards child processes.
+static std::vector<std::string> vecProgramArg;
+
+// Only NewDoubleLockDetector runs on a snapshot.
+static bool checkSnapshotDetectors(const std::string &Filename, raw_ostream &ErrOS) {
+    for (unsigned Kind = NewDoubleLock + 1; Kind <= PrintManualDropFuncs; ++Kind) {
+        if (Detectors.isSet(static_cast<DetectorKind>(Kind))) {
+            ErrOS << "rbd: " << Filename << ": only new-double-lock runs on a snapshot\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Nothing is parsed and no LLVMContext is created.
+static bool runOnSnapshot(const std::string &Filename, ReportCollector &Reports, raw_ostream &ErrOS) {
+    if (!checkSnapshotDetectors(Filename, ErrOS)) {
+        return false;
+    }
+    Snapshot S;
+    if (!S.load(Filename, ErrOS)) {
+        return false;
+    }
+    if (Detectors.isSet(NewDoubleLock)) {
+        detectDoubleLocks(S, Reports);
+    }
+    return true;
+}
+
+// Parse, verify and check one module. The findings go to Reports and the errors to ErrOS.
+static bool runDetectors(const std::string &Filename, ReportCollector &Reports, raw_ostream &ErrOS) {
+    if (Snapshot::isSnapshotFile(Filename)) {
+        if (!WriteSummaryDB.empty()) {
+            ErrOS << "rbd: " << Filename << ": -write-summary-db takes a bitcode file, not a snapshot\n";
+            return false;
+        }
+        return runOnSnapshot(Filename, Reports, ErrOS);
+    }
+
+    LLVMContext Context;
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = LazyLoad ? getLazyIRFileModule(Filename, Err, Context)
+                                         : parseIRFile(Filename, Err, Context);
+    if (!M) {
+        Err.print("rbd", ErrOS);
+        return false;
+    }
+    if (LazyLoad && !materializeReachable(*M, ErrOS)) {
+        return false;
+    }
+    if (verifyModule(*M, &ErrOS)) {
+        ErrOS << "rbd: " << Filename << ": the module is broken\n";
+        return false;
+    }
+
+    // The module is prepared in place instead of through an .m2r.bc file written by opt.
+    legacy::PassManager PM;
+    if (Mem2Reg) {
+        PM.add(createPromoteMemoryToRegisterPass());
+    }
+    if (Cleanup) {
+        PM.add(createDeadCodeEliminationPass());
+    }
+    for (unsigned Kind = NewDoubleLock; Kind <= PrintManualDropFuncs; ++Kind) {
+        if (Detectors.isSet(static_cast<DetectorKind>(Kind))) {
+            PM.add(createDetector(static_cast<DetectorKind>(Kind), Reports));
+        }
+    }
+    PM.run(*M);
+
+    // Facts of the external functions of this module join those already in the file.
+    if (!WriteSummaryDB.empty()) {
+        SummaryDB DB;
+        if (sys::fs::exists(WriteSummaryDB) && !DB.load(WriteSummaryDB, ErrOS)) {
+            return false;
+        }
+        buildSummaryDB(*M, DB);
+        if (!DB.save(WriteSummaryDB, ErrOS)) {
+            return false;
+        }
+    }
+
+    // The detectors leave the module as it is, so the snapshot sees the same IR they did.
+    if (!WriteSnapshot.empty()) {
+        SnapshotWriter Writer;
+        extractSnapshot(*M, Writer);
+        if (!Writer.write(WriteSnapshot, ErrOS)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Merge the shard snapshots into -write-snapshot, or a temporary file, and check it.
+static bool mergeShards(const std::vector<std::string> &vecShardFile, ReportCollector &Reports,
+                        raw_ostream &ErrOS) {
+    std::vector<Snapshot> vecSnapshot(vecShardFile.size());
+    std::vector<const Snapshot *> vecInput;
+    for (unsigned Shard = 0; Shard < vecShardFile.size(); ++Shard) {
+        if (!vecSnapshot[Shard].load(vecShardFile[Shard], ErrOS)) {
+            return false;
+        }
+        vecInput.push_back(&vecSnapshot[Shard]);
+    }
+    SnapshotWriter Writer;
+    mergeSnapshots(vecInput, Writer);
+
+    std::string MergedPath = WriteSnapshot;
+    if (MergedPath.empty()) {
+        SmallString<128> Path;
+        if (std::error_code EC = sys::fs::createTemporaryFile("rbd-merged", "rbds", Path)) {
+            ErrOS << "rbd: cannot create the merged snapshot file: " << EC.message() << '\n';
+            return false;
+        }
+        MergedPath = Path.str().str();
+    }
+    Snapshot Merged;
+    bool Succeeded = Writer.write(MergedPath, ErrOS) && Merged.load(MergedPath, ErrOS);
+    if (Succeeded && Detectors.isSet(NewDoubleLock)) {
+        detectDoubleLocks(Merged, Reports);
+    }
+    if (WriteSnapshot.empty()) {
+        sys::fs::remove(MergedPath);
+    }
+    return Succeeded;
+}
+
+// Peak memory is that of the largest shard, not of the whole module.
+static bool runSharded(const std::string &Filename, ReportCollector &Reports, raw_ostream &ErrOS) {
+    if (Snapshot::isSnapshotFile(Filename)) {
+        ErrOS << "rbd: " << Filename << ": -shards takes a bitcode file, not a snapshot\n";
+        return false;
+    }
+    if (LazyLoad || !WriteSummaryDB.empty()) {
+        ErrOS << "rbd: -lazy and -write-summary-db read the whole module, they cannot be combined with -shards\n";
+        return false;
+    }
+    if (!checkSnapshotDetectors(Filename, ErrOS)) {
+        return false;
+    }
+    std::string Program = sys::fs::getMainExecutable(vecProgramArg[0].c_str(),
+                                                     reinterpret_cast<void *>(reinterpret_cast<intptr_t>(&runSharded)));
+    std::vector<std::string> vecShardFile;
+    bool Succeeded = runShardProcesses(Program, vecProgramArg, NumShards, NumJobs, vecShardFile, ErrOS)
+                     && mergeShards(vecShardFile, Reports, ErrOS);
+    for (const std::string &File : vecShardFile) {
+        sys::fs::remove(File);
+    }
+    return Succeeded;
+}
+
+// The crate bitcode files of Dir, in name order. The per-codegen-unit files of
+// incremental builds are skipped, the README warns against them.
+static bool collectBitcodeFiles(const std::string &Dir, std::vector<std::string> &vecFile) {
+    std::error_code EC;
+    for (sys::fs::directory_iterator It(Dir, EC), End; It != End && !EC; It.increment(EC)) {
+        StringRef Path = It->path();
+        StringRef Name = sys::path::filename(Path);
+        if (sys::path::extension(Name) != ".bc" || Name.endswith(".rcgu.bc") || Name.contains("-cgu.")) {
+            continue;
+        }
+        if (sys::fs::is_regular_file(Path)) {
+            vecFile.push_back(Path.str());
+        }
+    }
+    if (EC) {
+        errs() << "rbd: " << Dir << ": " << EC.message() << '\n';
+        return false;
+    }
+    std::sort(vecFile.begin(), vecFile.end());
+    return true;
+}
+
+// Modules run on NumJobs threads; their findings are merged in file order,
+// so the report does not depend on -jobs. AllChecked is cleared when a module
+// could not be parsed, verified or extracted.
+static bool runBatch(const std::string &Dir, ReportCollector &Reports, bool &AllChecked) {
+    std::vector<std::string> vecFile;
+    if (!collectBitcodeFiles(Dir, vecFile)) {
+        return false;
+    }
+    if (vecFile.empty()) {
+        errs() << "rbd: " << Dir << ": no bitcode files\n";
+        return false;
+    }
+
+    std::vector<ReportCollector> vecModuleReports(vecFile.size());
+    std::vector<ModuleRun> vecRun(vecFile.size());
+    runOrderedTasks(vecFile.size(), NumJobs, [&](unsigned File, raw_ostream &OS) {
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+        bool Succeeded = runDetectors(vecFile[File], vecModuleReports[File], OS);
+        ModuleRun &Run = vecRun[File];
+        Run.Module = vecFile[File];
+        Run.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+        Run.NumFindings = vecModuleReports[File].size();
+        Run.Failed = !Succeeded;
+    }, errs());
+
+    for (unsigned File = 0; File < vecFile.size(); ++File) {
+        Reports.addModule(vecModuleReports[File], vecRun[File]);
+        if (vecRun[File].Failed) {
+            AllChecked = false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    InitLLVM X(argc, argv);
+
+    PassRegistry &Registry = *PassRegistry::getPassRegistry();
+    initializeCore(Registry);
+    initializeAnalysis(Registry);
+    initializeScalarOpts(Registry);
+    initializeTransformUtils(Registry);
+
+    cl::ParseCommandLineOptions(argc, argv, "Rust bug detectors on LLVM bitcode\n");
+    vecProgramArg.assign(argv, argv + argc);
+    if (!ShardOut.empty()) {
+        if (ShardIndex >= NumShards) {
+            errs() << "rbd: -shard-index must be less than -shards\n";
+            return 1;
+        }
+        return writeShardSnapshot(InputFilename, ShardIndex, NumShards, Mem2Reg, Cleanup, ShardOut, errs()) ? 0 : 1;
+    }
+    if (!Detectors.getBits() && WriteSnapshot.empty() && WriteSummaryDB.empty()) {
+        errs() << "rbd: give -detectors, -write-snapshot or -write-summary-db\n";
+        return 1;
+    }
+
+    // The lock detectors share one report, written once every detector has run.
+    ReportCollector Reports;
+    bool AllChecked = true;
+    if (NumShards == 0) {
+        errs() << "rbd: -shards must be at least 1\n";
+        return 1;
+    }
+    if (sys::fs::is_directory(InputFilename)) {
+        if (!WriteSnapshot.empty() || !WriteSummaryDB.empty() || NumShards > 1) {
+            errs() << "rbd: -write-snapshot, -write-summary-db and -shards take one bitcode file, not a directory\n";
+            return 1;
+        }
+        if (!runBatch(InputFilename, Reports, AllChecked)) {
+            return 1;
+        }
+    } else if (NumShards > 1) {
+        if (!runSharded(InputFilename, Reports, errs())) {
+            return 1;
+        }
+    } else if (!runDetectors(InputFilename, Reports, errs())) {
+        return 1;
+    }
+
+    // The findings of the modules that were checked are still written.
+    if (!Reports.write("rbd")) {
+        return 1;
+    }
+    return AllChecked ? 0 : 1;
+}